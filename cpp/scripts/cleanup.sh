@@ -1,8 +1,23 @@
 #!/bin/bash
 
+rm -f base64url
+rm -f discovery_snapshot
 rm -f json
+rm -f json_bind
+rm -f json_file
+rm -f json_lines
+rm -f json_path
+rm -f json_reusable_parser
+rm -f jwks
+rm -f jwt
 rm -f main
-rm -f tiny_web_server
-rm -f tiny_web_client
 rm -f open_browser
+rm -f percent_encoding
+rm -f pkce
+rm -f random_string
+rm -f single_flight
+rm -f tiny_web_client
+rm -f tiny_web_server
+rm -f token_cache
 rm -f url
+rm -f url_cache
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_BASE64URL=1 -x c++ base64url.h -o base64url -std=c++2a
+echo "Running..."
+./base64url
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_DISCOVERY_SNAPSHOT=1 discovery_snapshot.cpp -o discovery_snapshot -std=c++2a
+echo "Running..."
+./discovery_snapshot
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
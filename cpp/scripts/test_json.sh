@@ -1,7 +1,7 @@
 #!/bin/bash
 
 echo "Compiling..."
-g++ -g -DTEST_JSON=1 json_parser.cpp -o json -std=c++2a
+g++ -g -DTEST_JSON=1 -x c++ json_parser.h -o json -std=c++2a
 echo "Running..."
 ./json
 if [ $? == 0 ]; then
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_JSON_BIND=1 -x c++ json_bind.h -o json_bind -std=c++2a
+echo "Running..."
+./json_bind
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
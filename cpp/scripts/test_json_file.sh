@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_JSON_FILE=1 -x c++ json_file.h -o json_file -std=c++2a
+echo "Running..."
+./json_file
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
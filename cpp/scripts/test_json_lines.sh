@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -O2 -pthread -DTEST_JSON_LINES=1 -x c++ json_lines.h -o json_lines -std=c++2a
+echo "Running..."
+./json_lines "$@"
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
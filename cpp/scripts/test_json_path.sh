@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_JSON_PATH=1 -x c++ json_path.h -o json_path -std=c++2a
+echo "Running..."
+./json_path
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_JSON_REUSABLE_PARSER=1 -x c++ json_reusable_parser.h -o json_reusable_parser -std=c++2a
+echo "Running..."
+./json_reusable_parser
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
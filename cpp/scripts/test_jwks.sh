@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_JWKS=1 jwks.cpp jwt.cpp -o jwks -std=c++2a -lcrypto -pthread
+echo "Running..."
+./jwks
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_PERCENT_ENCODING=1 -x c++ percent_encoding.h -o percent_encoding -std=c++2a
+echo "Running..."
+./percent_encoding
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
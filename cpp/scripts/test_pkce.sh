@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_PKCE=1 pkce.cpp random_string.cpp -o pkce -std=c++2a -lcrypto -pthread
+echo "Running..."
+./pkce
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
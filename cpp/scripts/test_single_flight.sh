@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_SINGLE_FLIGHT=1 -x c++ single_flight.h -o single_flight -std=c++2a -pthread
+echo "Running..."
+./single_flight
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
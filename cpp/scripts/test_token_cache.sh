@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_TOKEN_CACHE=1 token_cache.cpp -o token_cache -std=c++2a -pthread
+echo "Running..."
+./token_cache
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 echo "Compiling..."
-g++ -g -DTEST_URL=1 url.cpp -o url -std=c++2a
+g++ -g -DTEST_URL=1 -x c++ url.h -o url -std=c++2a
 echo "Running..."
 ./url
 if [ $? == 0 ]; then
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+echo "Compiling..."
+g++ -g -DTEST_URL_CACHE=1 -pthread -x c++ url_cache.h -o url_cache -std=c++2a
+echo "Running..."
+./url_cache
+if [ $? == 0 ]; then
+    echo "SUCCESS"
+else
+    echo "FAILED"
+fi
\ No newline at end of file
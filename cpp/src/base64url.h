@@ -0,0 +1,158 @@
+#ifndef OAUTH2_BASE64URL_H
+#define OAUTH2_BASE64URL_H
+
+// ----------------------------------------------------------
+// base64url without padding (RFC 4648 section 5), as used by
+// PKCE and every part of a JWT.  The _to functions write into
+// a buffer the caller made big enough, see the _size ones.
+// ----------------------------------------------------------
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "macros.h"
+
+constexpr char BASE64URL_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                      "abcdefghijklmnopqrstuvwxyz"
+                                      "0123456789-_";
+
+// 0xFF for characters that are not in the alphabet
+struct Base64UrlTable
+{
+    std::uint8_t values[256];
+
+    constexpr Base64UrlTable() : values()
+    {
+        for ( int ii = 0; ii < 256; ii++ ) {
+            values[ii] = 0xFF;
+        }
+        for ( int ii = 0; ii < 64; ii++ ) {
+            values[static_cast<unsigned char>(BASE64URL_ALPHABET[ii])] = static_cast<std::uint8_t>(ii);
+        }
+    }
+};
+
+constexpr Base64UrlTable base64url_table = Base64UrlTable();
+
+ENTRYPOINT inline
+size_t base64url_encoded_size(size_t size)
+{
+    return (size * 4 + 2) / 3;
+}
+
+ENTRYPOINT inline
+char* base64url_encode_to(char* out, const unsigned char* data, size_t size)
+{
+    size_t ii = 0;
+    for ( ; ii + 3 <= size; ii += 3 ) {
+        const std::uint32_t group = std::uint32_t(data[ii]) << 16 | std::uint32_t(data[ii + 1]) << 8 | data[ii + 2];
+        *out++ = BASE64URL_ALPHABET[(group >> 18) & 0x3F];
+        *out++ = BASE64URL_ALPHABET[(group >> 12) & 0x3F];
+        *out++ = BASE64URL_ALPHABET[(group >> 6) & 0x3F];
+        *out++ = BASE64URL_ALPHABET[group & 0x3F];
+    }
+    if ( size - ii == 1 ) {
+        *out++ = BASE64URL_ALPHABET[data[ii] >> 2];
+        *out++ = BASE64URL_ALPHABET[(data[ii] & 0x03) << 4];
+    } else if ( size - ii == 2 ) {
+        *out++ = BASE64URL_ALPHABET[data[ii] >> 2];
+        *out++ = BASE64URL_ALPHABET[(data[ii] & 0x03) << 4 | data[ii + 1] >> 4];
+        *out++ = BASE64URL_ALPHABET[(data[ii + 1] & 0x0F) << 2];
+    }
+    return out;
+}
+
+ENTRYPOINT inline
+void base64url_encode_append(std::string& out, const unsigned char* data, size_t size)
+{
+    const size_t start = out.size();
+    out.resize(start + base64url_encoded_size(size));
+    base64url_encode_to(&out[start], data, size);
+}
+
+// Most bytes text can decode to.
+ENTRYPOINT inline
+size_t base64url_decoded_size(size_t size)
+{
+    return size / 4 * 3 + (size % 4 == 0 ? 0 : size % 4 - 1);
+}
+
+// Decodes text into out, which needs base64url_decoded_size bytes,
+// and returns the end, or nullptr when text is not unpadded
+// base64url.  Bits left over in the last character must be zero
+// so every value has exactly one encoding.
+ENTRYPOINT inline
+unsigned char* base64url_decode_to(unsigned char* out, std::string_view text)
+{
+    if ( text.size() % 4 == 1 ) {
+        return nullptr;
+    }
+    std::uint32_t group = 0;
+    int bits = 0;
+    for ( char ch : text ) {
+        const std::uint8_t value = base64url_table.values[static_cast<unsigned char>(ch)];
+        if ( value == 0xFF ) {
+            return nullptr;
+        }
+        group = (group << 6) | value;
+        bits += 6;
+        if ( bits >= 8 ) {
+            bits -= 8;
+            *out++ = static_cast<unsigned char>(group >> bits);
+            group &= (1u << bits) - 1;
+        }
+    }
+    if ( group != 0 ) {
+        return nullptr;
+    }
+    return out;
+}
+
+// Returns false, and leaves out as it was, when text is not valid.
+ENTRYPOINT inline
+bool base64url_decode_append(std::string& out, std::string_view text)
+{
+    const size_t start = out.size();
+    out.resize(start + base64url_decoded_size(text.size()));
+    auto* begin = reinterpret_cast<unsigned char*>(&out[start]);
+    unsigned char* end = base64url_decode_to(begin, text);
+    if ( end == nullptr ) {
+        out.resize(start);
+        return false;
+    }
+    out.resize(start + static_cast<size_t>(end - begin));
+    return true;
+}
+
+#ifdef TEST_BASE64URL
+#include <iostream>
+
+int main()
+{
+    // RFC 4648 section 10, without the padding
+    const char* tests[][2] = {
+        {"", ""}, {"f", "Zg"}, {"fo", "Zm8"}, {"foo", "Zm9v"}, {"foob", "Zm9vYg"},
+        {"fooba", "Zm9vYmE"}, {"foobar", "Zm9vYmFy"}, {"\xfb\xff", "-_8"},
+    };
+    int failures = 0;
+    for ( auto const& test : tests ) {
+        std::string encoded;
+        const std::string_view plain = test[0];
+        base64url_encode_append(encoded, reinterpret_cast<const unsigned char*>(plain.data()), plain.size());
+        std::string decoded;
+        const bool ok = base64url_decode_append(decoded, test[1]);
+        std::cout << '"' << plain << "\" " << encoded << '\n';
+        failures += encoded != test[1] || !ok || decoded != plain;
+    }
+    // padding, other alphabets, impossible lengths and stray bits
+    for ( const char* bad : {"Zg==", "Zm9v+A", "Zm9v/A", "Z", "Zh"} ) {
+        std::string decoded;
+        failures += base64url_decode_append(decoded, bad);
+    }
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_BASE64URL_H */
@@ -1,129 +1,295 @@
 #ifndef OAUTH2_CHAR_UTILS_H
 #define OAUTH2_CHAR_UTILS_H
-#include <string>
-
-static inline bool is_whitespace(char);
-
-static inline bool is_sign(char);
-
-static inline bool is_exponent(char);
-
-static inline bool is_decimal_point(char);
-
-static inline bool is_quote(char);
-
-static inline bool is_comma(char);
-
-static inline bool is_colon(char);
 
-static inline bool is_keyword(const std::string&);
-
-static inline bool is_alpha(char);
-
-static inline bool is_key(char);
-
-static inline bool is_digit(char);
-
-static inline bool is_domain_character(char);
+// ----------------------------------------------------------
+// Character classes
+// Every byte's classes are looked up in one 256 entry table
+// built by the compiler, so each is_ function is a load and a
+// test rather than a chain of comparisons.
+//
+// The char_find_invalid_ functions check a whole URL component
+// at once and return the offset of the first byte that is not
+// allowed in it, or npos.  With AVX2 or SSSE3 they test 32 or
+// 16 bytes at a time: the low nibble of each byte picks a row
+// of allowed high nibbles from a 16 byte table.  Everything
+// outside ASCII is rejected, as none of the URL classes allow it.
+// ----------------------------------------------------------
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#define CHAR_UTILS_SSSE3 1
+#endif
+
+// std::is_constant_evaluated is C++20, the builtin is available
+// earlier.  Without it the span checks always use the table.
+#if defined(__GNUC__) || defined(__clang__)
+#define CHAR_UTILS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define CHAR_UTILS_CONSTANT_EVALUATED() true
+#endif
+
+// character classes, one bit each
+constexpr std::uint32_t CHAR_WHITESPACE = 1u << 0;
+constexpr std::uint32_t CHAR_SIGN = 1u << 1;
+constexpr std::uint32_t CHAR_EXPONENT = 1u << 2;
+constexpr std::uint32_t CHAR_DECIMAL_POINT = 1u << 3;
+constexpr std::uint32_t CHAR_QUOTE = 1u << 4;
+constexpr std::uint32_t CHAR_COMMA = 1u << 5;
+constexpr std::uint32_t CHAR_COLON = 1u << 6;
+constexpr std::uint32_t CHAR_ALPHA = 1u << 7;
+constexpr std::uint32_t CHAR_KEY = 1u << 8;
+constexpr std::uint32_t CHAR_DIGIT = 1u << 9;
+constexpr std::uint32_t CHAR_DOMAIN = 1u << 10;
+constexpr std::uint32_t CHAR_SUB_DELIMS = 1u << 11;
+constexpr std::uint32_t CHAR_HEX_DIGIT = 1u << 12;
+constexpr std::uint32_t CHAR_PCT_ENCODED = 1u << 13;
+constexpr std::uint32_t CHAR_UNRESERVED = 1u << 14;
+constexpr std::uint32_t CHAR_PCHAR = 1u << 15;
+// See the RFC 3986, a query allows the same characters
+constexpr std::uint32_t CHAR_FRAGMENT = 1u << 16;
+constexpr std::uint32_t CHAR_PATH = 1u << 17;
+// left as they are when percent-encoding a path or a form
+constexpr std::uint32_t CHAR_PATH_LITERAL = 1u << 18;
+constexpr std::uint32_t CHAR_FORM_LITERAL = 1u << 19;
+
+// The definitions of the classes, only used to fill the table.
+static constexpr std::uint32_t char_classes_of(const unsigned char ch)
+{
+    const bool alpha = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+    const bool digit = ch >= '0' && ch <= '9';
+    const bool sub_delims = ch == '!' || ch == '$' || ch == '&' || ch == '\'' || ch == '(' || ch == ')' ||
+                            ch == '*' || ch == '+' || ch == ',' || ch == ';' || ch == '=';
+    const bool hex_digit = digit || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+    const bool pct_encoded = ch == '%' || hex_digit;
+    const bool unreserved = ch == '-' || ch == '.' || ch == '_' || ch == '~' || alpha || digit;
+    const bool pchar = ch == ':' || ch == '@' || unreserved || pct_encoded || sub_delims;
+    const bool fragment = ch == '/' || ch == '?' || pchar;
+
+    std::uint32_t classes = 0;
+    // RFC 8259 whitespace, a NUL is not
+    classes |= ch == 0x20 || ch == 0x0A || ch == 0x0D || ch == 0x09 ? CHAR_WHITESPACE : 0;
+    classes |= ch == '+' || ch == '-' ? CHAR_SIGN : 0;
+    classes |= ch == 'e' || ch == 'E' ? CHAR_EXPONENT : 0;
+    classes |= ch == '.' ? CHAR_DECIMAL_POINT : 0;
+    classes |= ch == '"' || ch == '\'' ? CHAR_QUOTE : 0;
+    classes |= ch == ',' ? CHAR_COMMA : 0;
+    classes |= ch == ':' ? CHAR_COLON : 0;
+    classes |= alpha ? CHAR_ALPHA : 0;
+    classes |= alpha || digit || ch == '_' ? CHAR_KEY : 0;
+    classes |= digit ? CHAR_DIGIT : 0;
+    classes |= alpha || digit || ch == '-' || ch == '.' ? CHAR_DOMAIN : 0;
+    classes |= sub_delims ? CHAR_SUB_DELIMS : 0;
+    classes |= hex_digit ? CHAR_HEX_DIGIT : 0;
+    classes |= pct_encoded ? CHAR_PCT_ENCODED : 0;
+    classes |= unreserved ? CHAR_UNRESERVED : 0;
+    classes |= pchar ? CHAR_PCHAR : 0;
+    classes |= fragment ? CHAR_FRAGMENT : 0;
+    classes |= ch == '/' || fragment ? CHAR_PATH : 0;
+    classes |= ch == '/' || ch == ':' || ch == '@' || unreserved || sub_delims ? CHAR_PATH_LITERAL : 0;
+    classes |= alpha || digit || ch == '*' || ch == '-' || ch == '.' || ch == '_' ? CHAR_FORM_LITERAL : 0;
+    return classes;
+}
 
-static inline bool is_sub_delims(char);
+static constexpr std::array<std::uint32_t, 256> char_make_class_table()
+{
+    std::array<std::uint32_t, 256> table{};
+    for (size_t ii = 0; ii < table.size(); ii++)
+    {
+        table[ii] = char_classes_of(static_cast<unsigned char>(ii));
+    }
+    return table;
+}
 
-static inline bool is_hex_digit(char);
+static constexpr std::array<std::uint32_t, 256> char_class_table = char_make_class_table();
 
-static inline bool is_pct_encoded(char);
+static constexpr inline bool char_is(const char ch, const std::uint32_t classes) {
+    return (char_class_table[static_cast<unsigned char>(ch)] & classes) != 0;
+}
 
-static inline bool is_unreserved(char);
+static constexpr inline bool is_whitespace(const char ch) {
+    return char_is(ch, CHAR_WHITESPACE);
+}
 
-static inline bool is_pchar(char);
+static constexpr inline bool is_sign(const char ch) {
+    return char_is(ch, CHAR_SIGN);
+}
 
-// See the RFC 3986.
-static inline bool is_fragment(char);
+static constexpr inline bool is_exponent(const char ch) {
+    return char_is(ch, CHAR_EXPONENT);
+}
 
-static inline bool is_valid_path_char(char);
+static constexpr inline bool is_decimal_point(const char ch) {
+    return char_is(ch, CHAR_DECIMAL_POINT);
+}
 
-static inline bool is_whitespace(const char ch) {
-    return ch == 0x00|| ch == 0x20 || ch == 0x0A || ch == 0x0D || ch == 0x09;
+static constexpr inline bool is_quote(const char ch) {
+    return char_is(ch, CHAR_QUOTE);
 }
 
-static inline bool is_sign(const char ch) {
-    return ch == '+' || ch == '-';
+static constexpr inline bool is_comma(const char ch) {
+    return char_is(ch, CHAR_COMMA);
 }
 
-static inline bool is_exponent(const char ch) {
-    return ch == 'e' || ch == 'E';
+static constexpr inline bool is_colon(const char ch) {
+    return char_is(ch, CHAR_COLON);
 }
 
-static inline bool is_decimal_point(const char ch) {
-    return ch == '.';
+static inline bool is_keyword(const std::string& text) {
+    return text == "true" || text == "false" || text == "null";
 }
 
-static inline bool is_quote(const char ch) {
-    return ch == '"' || ch == '\'';
+static constexpr inline bool is_alpha(const char ch) {
+    return char_is(ch, CHAR_ALPHA);
 }
 
-static inline bool is_comma(const char ch) {
-    return ch == ',';
+static constexpr inline bool is_key(const char ch) {
+    return char_is(ch, CHAR_KEY);
 }
 
-static inline bool is_colon(const char ch) {
-    return ch == ':';
+static constexpr inline bool is_digit(const char n) {
+    return char_is(n, CHAR_DIGIT);
 }
 
-static inline bool is_keyword(const std::string& text) {
-    return text == "true" || text == "false" || text == "null";
+static constexpr inline bool is_domain_character(const char ch) {
+    return char_is(ch, CHAR_DOMAIN);
 }
 
-static inline bool is_alpha(const char ch) {
-    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+static constexpr inline bool is_sub_delims(const char ch) {
+    return char_is(ch, CHAR_SUB_DELIMS);
 }
 
-static inline bool is_key(const char ch) {
-    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch>= '0' && ch <= '9') || ch == '_';
+static constexpr inline bool is_hex_digit(const char ch) {
+    return char_is(ch, CHAR_HEX_DIGIT);
 }
 
-static inline bool is_digit(const char n) {
-    return n >= '0' && n <= '9';
+static constexpr inline bool is_pct_encoded(const char ch) {
+    return char_is(ch, CHAR_PCT_ENCODED);
 }
 
-static inline bool is_domain_character(const char ch) {
-    return is_alpha(ch) || is_digit(ch) || ch == '-' || ch == '.';
+static constexpr inline bool is_unreserved(const char ch) {
+    return char_is(ch, CHAR_UNRESERVED);
 }
 
+static constexpr inline bool is_pchar(const char ch) {
+    return char_is(ch, CHAR_PCHAR);
+}
 
-static inline bool is_sub_delims(const char ch) {
-    return ch == '!' || ch == '$' || ch == '&' || ch == '\'' || ch == '(' || ch == ')' ||
-           ch == '*' || ch == '+' || ch == ',' || ch == ';' || ch == '=';
+// See the RFC 3986.
+static constexpr inline bool is_fragment(const char ch) {
+    return char_is(ch, CHAR_FRAGMENT);
 }
 
-static inline bool is_hex_digit(const char ch) {
-    return ch == 'a' || ch == 'A' ||
-           ch == 'b' || ch == 'B' ||
-           ch == 'c' || ch == 'C' ||
-           ch == 'd' || ch == 'D' ||
-           ch == 'e' || ch == 'E' ||
-           ch == 'f' || ch == 'F' ||
-           is_digit(ch);
+static constexpr inline bool is_valid_path_char(const char ch) {
+    return char_is(ch, CHAR_PATH);
 }
 
-static inline bool is_pct_encoded(const char ch) {
-    return ch == '%' || is_hex_digit(ch);
+// Bit h of row[lo] is set when byte (h << 4 | lo) is in the class,
+// column[h] selects bit h for the seven bit high nibbles.
+template<std::uint32_t Classes>
+struct CharNibbleTables
+{
+    static constexpr std::array<std::uint8_t, 16> make_rows()
+    {
+        std::array<std::uint8_t, 16> rows{};
+        for (size_t ii = 0; ii < 128; ii++)
+        {
+            if ((char_class_table[ii] & Classes) != 0)
+            {
+                rows[ii & 0x0F] = static_cast<std::uint8_t>(rows[ii & 0x0F] | (1u << (ii >> 4)));
+            }
+        }
+        return rows;
+    }
+
+    static constexpr std::array<std::uint8_t, 16> rows = make_rows();
+    static constexpr std::array<std::uint8_t, 16> columns = {1, 2, 4, 8, 16, 32, 64, 128,
+                                                             0, 0, 0, 0, 0, 0, 0, 0};
+};
+
+#if defined(CHAR_UTILS_SSSE3)
+static inline unsigned char_count_trailing_zeros(const std::uint32_t mask) {
+    return static_cast<unsigned>(__builtin_ctz(mask));
+}
+#endif
+
+// Offset of the first byte of text that is in none of Classes,
+// or npos when all of them are.
+template<std::uint32_t Classes>
+static constexpr inline size_t char_find_invalid(const std::string_view text) {
+    size_t ii = 0;
+#if defined(CHAR_UTILS_SSSE3)
+    if (!CHAR_UTILS_CONSTANT_EVALUATED())
+    {
+        using Tables = CharNibbleTables<Classes>;
+        const char *data = text.data();
+#if defined(__AVX2__)
+        {
+            const __m256i rows = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::rows.data())));
+            const __m256i columns = _mm256_broadcastsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::columns.data())));
+            const __m256i nibble = _mm256_set1_epi8(0x0F);
+            for (; text.size() - ii >= 32; ii += 32)
+            {
+                const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + ii));
+                const __m256i row = _mm256_shuffle_epi8(rows, _mm256_and_si256(chunk, nibble));
+                const __m256i column = _mm256_shuffle_epi8(
+                        columns, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble));
+                const __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(row, column), _mm256_setzero_si256());
+                const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(invalid));
+                if (mask != 0)
+                {
+                    return ii + char_count_trailing_zeros(mask);
+                }
+            }
+        }
+#endif
+        const __m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::rows.data()));
+        const __m128i columns = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Tables::columns.data()));
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        for (; text.size() - ii >= 16; ii += 16)
+        {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + ii));
+            const __m128i row = _mm_shuffle_epi8(rows, _mm_and_si128(chunk, nibble));
+            const __m128i column = _mm_shuffle_epi8(columns, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble));
+            const __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(row, column), _mm_setzero_si128());
+            const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(invalid));
+            if (mask != 0)
+            {
+                return ii + char_count_trailing_zeros(mask);
+            }
+        }
+    }
+#endif
+    for (; ii < text.size(); ii++)
+    {
+        if (!char_is(text[ii], Classes))
+        {
+            return ii;
+        }
+    }
+    return std::string_view::npos;
 }
 
-static inline bool is_unreserved(const char ch) {
-    return ch == '-' || ch == '.' || ch == '_' || ch == '~' || is_alpha(ch) || is_digit(ch);
+static constexpr inline size_t char_find_invalid_domain(const std::string_view text) {
+    return char_find_invalid<CHAR_DOMAIN>(text);
 }
 
-static inline bool is_pchar(const char ch) {
-    return ch == ':' || ch == '@' || is_unreserved(ch) || is_pct_encoded(ch) || is_sub_delims(ch);
+static constexpr inline size_t char_find_invalid_path(const std::string_view text) {
+    return char_find_invalid<CHAR_PATH>(text);
 }
 
-// See the RFC 3986.
-static inline bool is_fragment(const char ch) {
-    return ch == '/' || ch == '?' || is_pchar(ch);
+static constexpr inline size_t char_find_invalid_fragment(const std::string_view text) {
+    return char_find_invalid<CHAR_FRAGMENT>(text);
 }
 
-static inline bool is_valid_path_char(const char ch) {
-    return ch == '/' || is_fragment(ch);
+static constexpr inline size_t char_find_invalid_query(const std::string_view text) {
+    return char_find_invalid<CHAR_FRAGMENT>(text);
 }
 
 #endif /* OAUTH2_CHAR_UTILS_H */
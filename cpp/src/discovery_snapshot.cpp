@@ -0,0 +1,345 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "discovery_snapshot.h"
+
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+#include <process.h>
+#define snapshot_pid _getpid
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define snapshot_pid getpid
+#endif
+
+static constexpr char SNAPSHOT_MAGIC[8] = {'O', 'A', '2', 'S', 'N', 'A', 'P', '\0'};
+static constexpr std::uint32_t SNAPSHOT_VERSION = 2;
+// magic, version, field count, saved at, max age, JWKS fetched at,
+// checksum, unused
+static constexpr size_t SNAPSHOT_HEADER_SIZE = 8 + 4 + 4 + 8 + 8 + 8 + 4 + 4;
+static constexpr size_t SNAPSHOT_CHECKSUM_OFFSET = 40;
+static constexpr size_t SNAPSHOT_TABLE_SIZE = SNAPSHOT_FIELD_COUNT * 8;
+
+static void put_u32(std::string &out, std::uint32_t value) {
+    for (int ii = 0; ii < 4; ii++) {
+        out.push_back(static_cast<char>((value >> (8 * ii)) & 0xff));
+    }
+}
+
+static void put_i64(std::string &out, std::int64_t value) {
+    const auto bits = static_cast<std::uint64_t>(value);
+    for (int ii = 0; ii < 8; ii++) {
+        out.push_back(static_cast<char>((bits >> (8 * ii)) & 0xff));
+    }
+}
+
+static std::uint32_t get_u32(const unsigned char *in) {
+    return static_cast<std::uint32_t>(in[0]) | static_cast<std::uint32_t>(in[1]) << 8 |
+           static_cast<std::uint32_t>(in[2]) << 16 | static_cast<std::uint32_t>(in[3]) << 24;
+}
+
+static std::int64_t get_i64(const unsigned char *in) {
+    std::uint64_t bits = 0;
+    for (int ii = 7; ii >= 0; ii--) {
+        bits = bits << 8 | in[ii];
+    }
+    return static_cast<std::int64_t>(bits);
+}
+
+// FNV-1a, only there to notice a damaged file
+static std::uint32_t snapshot_checksum(const unsigned char *data, size_t size) {
+    std::uint32_t hash = 2166136261u;
+    for (size_t ii = 0; ii < size; ii++) {
+        hash = (hash ^ data[ii]) * 16777619u;
+    }
+    return hash;
+}
+
+std::string snapshot_default_path() {
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    const char *base = std::getenv("LOCALAPPDATA");
+    if (base == nullptr || *base == '\0') {
+        return {};
+    }
+    return std::string(base) + "\\oauth2_cpp\\discovery.snapshot";
+#else
+    const char *cache = std::getenv("XDG_CACHE_HOME");
+    // the spec says a relative XDG_CACHE_HOME is to be ignored
+    if (cache != nullptr && cache[0] == '/') {
+        return std::string(cache) + "/oauth2_cpp/discovery.snapshot";
+    }
+    const char *home = std::getenv("HOME");
+    if (home == nullptr || home[0] != '/') {
+        return {};
+    }
+    return std::string(home) + "/.cache/oauth2_cpp/discovery.snapshot";
+#endif
+}
+
+bool snapshot_write(std::string const &path, SnapshotValues const &values, std::string &error) {
+    size_t size = SNAPSHOT_HEADER_SIZE + SNAPSHOT_TABLE_SIZE;
+    for (std::string const &field : values.fields) {
+        size += field.size();
+    }
+    if (size > UINT32_MAX) {
+        error = "snapshot too large";
+        return false;
+    }
+    std::string out;
+    out.reserve(size);
+    out.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put_u32(out, SNAPSHOT_VERSION);
+    put_u32(out, static_cast<std::uint32_t>(SNAPSHOT_FIELD_COUNT));
+    put_i64(out, std::chrono::duration_cast<std::chrono::seconds>(values.saved_at.time_since_epoch()).count());
+    put_i64(out, values.max_age.count());
+    put_i64(out, std::chrono::duration_cast<std::chrono::seconds>(values.jwks_fetched_at.time_since_epoch()).count());
+    // checksum, filled in below
+    put_u32(out, 0);
+    put_u32(out, 0);
+    size_t offset = SNAPSHOT_HEADER_SIZE + SNAPSHOT_TABLE_SIZE;
+    for (std::string const &field : values.fields) {
+        put_u32(out, static_cast<std::uint32_t>(offset));
+        put_u32(out, static_cast<std::uint32_t>(field.size()));
+        offset += field.size();
+    }
+    for (std::string const &field : values.fields) {
+        out += field;
+    }
+    const std::uint32_t checksum = snapshot_checksum(
+            reinterpret_cast<const unsigned char *>(out.data()) + SNAPSHOT_HEADER_SIZE,
+            out.size() - SNAPSHOT_HEADER_SIZE);
+    std::string sum;
+    put_u32(sum, checksum);
+    out.replace(SNAPSHOT_CHECKSUM_OFFSET, 4, sum);
+
+    // the directory is ours alone
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    std::error_code directory_error;
+    if (!directory.empty() && std::filesystem::create_directories(directory, directory_error)) {
+        std::filesystem::permissions(directory, std::filesystem::perms::owner_all, directory_error);
+    }
+
+    // two runs may write at once, each renames its own file
+    const std::string temporary = path + '.' + std::to_string(snapshot_pid()) + ".tmp";
+    std::remove(temporary.c_str());
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), static_cast<std::streamsize>(out.size())) || !file.flush()) {
+            file.close();
+            std::remove(temporary.c_str());
+            error = "cannot write '" + temporary + "'";
+            return false;
+        }
+    }
+#else
+    {
+        // readable by us only, and never through a planted link
+        const int file = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+        size_t written = 0;
+        while (file >= 0 && written < out.size()) {
+            const ssize_t bytes = ::write(file, out.data() + written, out.size() - written);
+            if (bytes <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(bytes);
+        }
+        if (file < 0 || written != out.size() || ::close(file) != 0) {
+            if (file >= 0) {
+                std::remove(temporary.c_str());
+            }
+            error = "cannot write '" + temporary + "'";
+            return false;
+        }
+    }
+#endif
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    const bool renamed = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    const bool renamed = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        std::remove(temporary.c_str());
+        error = "cannot replace '" + path + "'";
+        return false;
+    }
+    return true;
+}
+
+bool DiscoverySnapshot::open(std::string const &path) {
+    table_ = nullptr;
+    error_.clear();
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(__WINDOWS__)
+    // it says where to send the user and which keys to trust, so
+    // nobody else may have written it
+    struct stat file_stat{};
+    if (::stat(path.c_str(), &file_stat) == 0 &&
+        (file_stat.st_uid != geteuid() || (file_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0)) {
+        file_.close();
+        error_ = "'" + path + "' is not owned by us alone";
+        return false;
+    }
+#endif
+    if (!file_.open(path, MappedFileAccess::RANDOM)) {
+        error_ = file_.error();
+        return false;
+    }
+    const auto *data = reinterpret_cast<const unsigned char *>(file_.data());
+    const size_t size = file_.size();
+    if (size < SNAPSHOT_HEADER_SIZE + SNAPSHOT_TABLE_SIZE ||
+        std::memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        error_ = "'" + path + "' is not a snapshot";
+    } else if (get_u32(data + 8) != SNAPSHOT_VERSION || get_u32(data + 12) != SNAPSHOT_FIELD_COUNT) {
+        error_ = "'" + path + "' is from another version";
+    } else if (get_u32(data + SNAPSHOT_CHECKSUM_OFFSET) != snapshot_checksum(data + SNAPSHOT_HEADER_SIZE, size - SNAPSHOT_HEADER_SIZE)) {
+        error_ = "'" + path + "' is damaged";
+    } else {
+        const unsigned char *table = data + SNAPSHOT_HEADER_SIZE;
+        for (size_t ii = 0; ii < SNAPSHOT_FIELD_COUNT && error_.empty(); ii++) {
+            const std::uint64_t offset = get_u32(table + ii * 8);
+            const std::uint64_t length = get_u32(table + ii * 8 + 4);
+            if (offset < SNAPSHOT_HEADER_SIZE + SNAPSHOT_TABLE_SIZE || offset + length > size) {
+                error_ = "'" + path + "' is damaged";
+            }
+        }
+    }
+    if (!error_.empty()) {
+        file_.close();
+        return false;
+    }
+    table_ = data + SNAPSHOT_HEADER_SIZE;
+    saved_at_ = get_i64(data + 16);
+    max_age_ = get_i64(data + 24);
+    jwks_fetched_at_ = get_i64(data + 32);
+    return true;
+}
+
+bool DiscoverySnapshot::is_valid() const {
+    return table_ != nullptr;
+}
+
+std::string const &DiscoverySnapshot::error() const {
+    return error_;
+}
+
+std::string_view DiscoverySnapshot::get(SnapshotField field) const {
+    const auto index = static_cast<size_t>(field);
+    if (table_ == nullptr || index >= SNAPSHOT_FIELD_COUNT) {
+        return {};
+    }
+    return {file_.data() + get_u32(table_ + index * 8), get_u32(table_ + index * 8 + 4)};
+}
+
+std::chrono::system_clock::time_point DiscoverySnapshot::saved_at() const {
+    return std::chrono::system_clock::time_point(std::chrono::seconds(saved_at_));
+}
+
+std::chrono::seconds DiscoverySnapshot::max_age() const {
+    return std::chrono::seconds(max_age_);
+}
+
+std::chrono::system_clock::time_point DiscoverySnapshot::jwks_fetched_at() const {
+    return std::chrono::system_clock::time_point(std::chrono::seconds(jwks_fetched_at_));
+}
+
+bool DiscoverySnapshot::is_fresh(std::chrono::system_clock::time_point now) const {
+    return is_valid() && saved_at() <= now && now < saved_at() + max_age();
+}
+
+SnapshotValues DiscoverySnapshot::values() const {
+    SnapshotValues values;
+    for (size_t ii = 0; ii < SNAPSHOT_FIELD_COUNT; ii++) {
+        values.fields[ii] = std::string(get(static_cast<SnapshotField>(ii)));
+    }
+    values.saved_at = saved_at();
+    values.max_age = max_age();
+    values.jwks_fetched_at = jwks_fetched_at();
+    return values;
+}
+
+#ifdef TEST_DISCOVERY_SNAPSHOT
+#include <iostream>
+
+int main() {
+    const std::string path = "discovery_snapshot_test.bin";
+    const auto now = std::chrono::system_clock::now();
+    SnapshotValues values;
+    values[SnapshotField::APPLICATION_CLIENT_ID] = "client-1234";
+    values[SnapshotField::ISSUER] = "https://issuer.example.com";
+    values[SnapshotField::AUTHORIZATION_ENDPOINT] = "https://issuer.example.com/authorize";
+    values[SnapshotField::JWKS_BODY] = std::string("{\"keys\": []}\0binary", 19);
+    values[SnapshotField::OPENID_ETAG] = "\"abc\"";
+    values.saved_at = now - std::chrono::minutes(5);
+    values.max_age = std::chrono::hours(1);
+    values.jwks_fetched_at = std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+    std::string error;
+    int failures = !snapshot_write(path, values, error);
+    DiscoverySnapshot snapshot;
+    failures += !snapshot.open(path);
+    std::cout << "open: " << snapshot.is_valid() << ' ' << snapshot.error() << '\n';
+    for (size_t ii = 0; ii < SNAPSHOT_FIELD_COUNT; ii++) {
+        failures += snapshot.get(static_cast<SnapshotField>(ii)) != values.fields[ii];
+    }
+    failures += !snapshot.is_fresh(now);
+    failures += snapshot.is_fresh(now + std::chrono::hours(1));
+    failures += snapshot.is_fresh(now - std::chrono::hours(1));
+    failures += snapshot.values().fields != values.fields;
+    failures += snapshot.jwks_fetched_at() != values.jwks_fetched_at;
+
+    // replacing the file leaves the open mapping alone
+    SnapshotValues changed = values;
+    changed[SnapshotField::APPLICATION_CLIENT_ID] = "client-5678";
+    failures += !snapshot_write(path, changed, error);
+    failures += snapshot.get(SnapshotField::APPLICATION_CLIENT_ID) != "client-1234";
+    {
+        DiscoverySnapshot reopened;
+        failures += !reopened.open(path) || reopened.get(SnapshotField::APPLICATION_CLIENT_ID) != "client-5678";
+    }
+
+    // a flipped byte or a short file is no snapshot
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    for (size_t cut : {bytes.size() - 1, size_t(20)}) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(cut));
+        DiscoverySnapshot broken;
+        failures += broken.open(path);
+        std::cout << "short: " << broken.error() << '\n';
+    }
+    bytes[bytes.size() - 3] ^= 1;
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    DiscoverySnapshot damaged;
+    failures += damaged.open(path) || damaged.is_fresh(now);
+    std::cout << "damaged: " << damaged.error() << '\n';
+
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(__WINDOWS__)
+    // written for us alone, and refused once others may write it
+    failures += !snapshot_write(path, values, error);
+    struct stat file_stat{};
+    failures += ::stat(path.c_str(), &file_stat) != 0 || (file_stat.st_mode & 0777) != 0600;
+    chmod(path.c_str(), 0666);
+    DiscoverySnapshot shared;
+    failures += shared.open(path);
+    std::cout << "shared: " << shared.error() << '\n';
+#endif
+
+    const std::string nested = "discovery_snapshot_test/cache/snapshot.bin";
+    failures += !snapshot_write(nested, values, error);
+    DiscoverySnapshot created;
+    failures += !created.open(nested);
+    std::filesystem::remove_all("discovery_snapshot_test");
+
+    DiscoverySnapshot missing;
+    failures += missing.open("no_such_snapshot.bin") || !missing.get(SnapshotField::APPLICATION_CLIENT_ID).empty();
+
+    std::remove(path.c_str());
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,122 @@
+#ifndef OAUTH2_DISCOVERY_SNAPSHOT_H
+#define OAUTH2_DISCOVERY_SNAPSHOT_H
+
+// What the login needs to know before it can open the browser
+// (the client ID, the provider's endpoints and its signing keys),
+// kept on disk between runs so a start with a fresh snapshot
+// makes no network calls at all.
+//
+// The file is mapped and read in place: a fixed header, a table
+// of (offset, length) pairs, one per SnapshotField, then the
+// strings.  Everything is little endian and read a byte at a
+// time, so the file moves between machines.  A checksum over the
+// table and strings catches a damaged file, which then counts as
+// no snapshot.  The checksum is no defence against someone who
+// means harm; that is why the file is private to its user, who
+// must own it for it to be read.  Writing goes to a temporary
+// file that is renamed over the old one, anyone with the old
+// one mapped keeps it.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "mapped_file.h"
+
+enum class SnapshotField : std::uint32_t {
+    // from GetApplicationEndpoint, CLIENT_ID is taken by config.h
+    APPLICATION_CLIENT_ID = 0,
+    OPENID_URL,
+    ISSUER,
+    AUTHORIZATION_ENDPOINT,
+    TOKEN_ENDPOINT,
+    USERINFO_ENDPOINT,
+    JWKS_URI,
+    // the JWK Set document as it was fetched
+    JWKS_BODY,
+    JWKS_CACHE_CONTROL,
+    // validators for revalidating each document, RFC 7232
+    APPLICATION_ETAG,
+    APPLICATION_LAST_MODIFIED,
+    OPENID_ETAG,
+    OPENID_LAST_MODIFIED,
+    JWKS_ETAG,
+    JWKS_LAST_MODIFIED,
+    COUNT
+};
+
+constexpr size_t SNAPSHOT_FIELD_COUNT = static_cast<size_t>(SnapshotField::COUNT);
+
+// The values to write, indexed by SnapshotField.
+struct SnapshotValues
+{
+    std::array<std::string, SNAPSHOT_FIELD_COUNT> fields;
+    // the wall clock time the documents were last known to be current
+    std::chrono::system_clock::time_point saved_at;
+    std::chrono::seconds max_age{0};
+    // when JWKS_BODY was fetched or revalidated, its max-age counts
+    // from here
+    std::chrono::system_clock::time_point jwks_fetched_at;
+
+    std::string &operator[](SnapshotField field)
+    {
+        return fields[static_cast<size_t>(field)];
+    }
+
+    std::string const &operator[](SnapshotField field) const
+    {
+        return fields[static_cast<size_t>(field)];
+    }
+};
+
+// $XDG_CACHE_HOME/oauth2_cpp/discovery.snapshot, or under
+// ~/.cache (%LOCALAPPDATA% on Windows); empty when there is no
+// home directory to put it in.
+std::string snapshot_default_path();
+
+// Writes values to path, readable by the current user only, and
+// creates its directory.  Returns false with error filled when it
+// could not.
+bool snapshot_write(std::string const &path, SnapshotValues const &values, std::string &error);
+
+class DiscoverySnapshot
+{
+public:
+    DiscoverySnapshot() = default;
+
+    // false, and no snapshot, when path is missing, not one we
+    // can read, or could have been written by another user
+    bool open(std::string const &path);
+
+    [[nodiscard]] bool is_valid() const;
+
+    [[nodiscard]] std::string const &error() const;
+
+    // points into the mapping, valid while this is open
+    [[nodiscard]] std::string_view get(SnapshotField field) const;
+
+    [[nodiscard]] std::chrono::system_clock::time_point saved_at() const;
+
+    [[nodiscard]] std::chrono::seconds max_age() const;
+
+    [[nodiscard]] std::chrono::system_clock::time_point jwks_fetched_at() const;
+
+    // Saved no longer than max_age before now.  A snapshot from
+    // the future (the clock went back) is not fresh.
+    [[nodiscard]] bool is_fresh(std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) const;
+
+    // a copy to change and write back
+    [[nodiscard]] SnapshotValues values() const;
+
+private:
+    MappedFile file_;
+    const unsigned char *table_ = nullptr;
+    std::int64_t saved_at_ = 0;
+    std::int64_t max_age_ = 0;
+    std::int64_t jwks_fetched_at_ = 0;
+    std::string error_;
+};
+
+#endif /* OAUTH2_DISCOVERY_SNAPSHOT_H */
@@ -0,0 +1,459 @@
+// ----------------------------------------------------------
+// JSON benchmarks
+// Google Benchmark over documents shaped like the ones this
+// client really parses: token responses, OpenID Connect
+// discovery documents, JWKS and large project listings, plus
+// deep and adversarial inputs that a hostile server could send.
+// Every benchmark reports bytes per second, allocations per
+// parse and the most heap live at once while parsing; the
+// process's max RSS is reported alongside.
+//
+// Run the conformance test too, a faster parser that accepts
+// the wrong documents is not an improvement.
+//
+// More documents can be added without recompiling: every *.json
+// file in the directory named by OAUTH2_JSON_CORPUS, or the
+// first argument left after the benchmark flags, is benchmarked
+// as well.
+// ----------------------------------------------------------
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <benchmark/benchmark.h>
+
+#include "json_parser.h"
+#include "json_reader.h"
+#include "json_bind.h"
+#include "json_reusable_parser.h"
+#include "oauth2_types.h"
+
+// ----------------------------------------------------------
+// Allocation tracking, every block carries its size in front so
+// delete can keep the live byte count right.
+// ----------------------------------------------------------
+
+static std::atomic<size_t> bench_allocations(0);
+static std::atomic<size_t> bench_live_bytes(0);
+static std::atomic<size_t> bench_peak_bytes(0);
+
+constexpr size_t BENCH_HEADER = alignof(std::max_align_t);
+
+void* operator new(size_t size)
+{
+    auto* block = static_cast<unsigned char*>(std::malloc(size + BENCH_HEADER));
+    if ( block == nullptr ) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    bench_allocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t live = bench_live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = bench_peak_bytes.load(std::memory_order_relaxed);
+    while ( live > peak && !bench_peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed) ) {
+    }
+    return block + BENCH_HEADER;
+}
+
+void operator delete(void* memory) noexcept
+{
+    if ( memory == nullptr ) {
+        return;
+    }
+    auto* block = static_cast<unsigned char*>(memory) - BENCH_HEADER;
+    bench_live_bytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+// Wraps the timed loop of a benchmark and turns what was
+// allocated during it into counters.
+class AllocationCounters
+{
+public:
+    explicit AllocationCounters(benchmark::State& state) : state_(state)
+    {
+        allocations_ = bench_allocations.load();
+        base_bytes_ = bench_live_bytes.load();
+        bench_peak_bytes.store(base_bytes_);
+    }
+
+    ~AllocationCounters()
+    {
+        const double iterations = static_cast<double>(state_.iterations());
+        state_.counters["allocs_per_parse"] =
+            iterations == 0 ? 0 : static_cast<double>(bench_allocations.load() - allocations_) / iterations;
+        state_.counters["peak_heap_bytes"] = static_cast<double>(bench_peak_bytes.load() - base_bytes_);
+        rusage usage = rusage {};
+        getrusage(RUSAGE_SELF, &usage);
+        state_.counters["max_rss_kb"] = static_cast<double>(usage.ru_maxrss);
+    }
+
+    AllocationCounters(AllocationCounters const &) = delete;
+    AllocationCounters& operator=(AllocationCounters const &) = delete;
+
+private:
+    benchmark::State& state_;
+    size_t allocations_;
+    size_t base_bytes_;
+};
+
+// ----------------------------------------------------------
+// Corpus
+// ----------------------------------------------------------
+
+static std::string bench_token(size_t length, char seed)
+{
+    std::string token;
+    token.reserve(length);
+    for ( size_t ii = 0; ii < length; ii++ ) {
+        token += "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"[(ii * 7 + seed) % 64];
+    }
+    return token;
+}
+
+static std::string bench_token_response()
+{
+    return "{\n"
+           "  \"access_token\": \"ya29." + bench_token(180, 1) + "\",\n"
+           "  \"expires_in\": 3599,\n"
+           "  \"refresh_token\": \"1//0g" + bench_token(100, 2) + "\",\n"
+           "  \"scope\": \"openid https://www.googleapis.com/auth/userinfo.email "
+           "https://www.googleapis.com/auth/cloud-platform\",\n"
+           "  \"token_type\": \"Bearer\",\n"
+           "  \"id_token\": \"eyJhbGciOiJSUzI1NiIsImtpZCI6IjFiZDY4NWY1In0." + bench_token(600, 3) + "." +
+           bench_token(342, 4) + "\"\n"
+           "}\n";
+}
+
+static std::string bench_discovery()
+{
+    return R"({
+ "issuer": "https://accounts.google.com",
+ "authorization_endpoint": "https://accounts.google.com/o/oauth2/v2/auth",
+ "device_authorization_endpoint": "https://oauth2.googleapis.com/device/code",
+ "token_endpoint": "https://oauth2.googleapis.com/token",
+ "userinfo_endpoint": "https://openidconnect.googleapis.com/v1/userinfo",
+ "revocation_endpoint": "https://oauth2.googleapis.com/revoke",
+ "jwks_uri": "https://www.googleapis.com/oauth2/v3/certs",
+ "response_types_supported": [
+  "code",
+  "token",
+  "id_token",
+  "code token",
+  "code id_token",
+  "token id_token",
+  "code token id_token",
+  "none"
+ ],
+ "subject_types_supported": [
+  "public"
+ ],
+ "id_token_signing_alg_values_supported": [
+  "RS256"
+ ],
+ "scopes_supported": [
+  "openid",
+  "email",
+  "profile"
+ ],
+ "token_endpoint_auth_methods_supported": [
+  "client_secret_post",
+  "client_secret_basic"
+ ],
+ "claims_supported": [
+  "aud",
+  "email",
+  "email_verified",
+  "exp",
+  "family_name",
+  "given_name",
+  "iat",
+  "iss",
+  "locale",
+  "name",
+  "picture",
+  "sub"
+ ],
+ "code_challenge_methods_supported": [
+  "plain",
+  "S256"
+ ],
+ "grant_types_supported": [
+  "authorization_code",
+  "refresh_token",
+  "urn:ietf:params:oauth:grant-type:device_code",
+  "urn:ietf:params:oauth:grant-type:jwt-bearer"
+ ]
+}
+)";
+}
+
+static std::string bench_jwks()
+{
+    std::string jwks = "{\n  \"keys\": [\n";
+    for ( int ii = 0; ii < 3; ii++ ) {
+        jwks += std::string(ii == 0 ? "" : ",\n") +
+                "    {\n"
+                "      \"e\": \"AQAB\",\n"
+                "      \"kty\": \"RSA\",\n"
+                "      \"alg\": \"RS256\",\n"
+                "      \"n\": \"" + bench_token(342, static_cast<char>(ii)) + "\",\n"
+                "      \"use\": \"sig\",\n"
+                "      \"kid\": \"" + bench_token(40, static_cast<char>(ii + 9)) + "\"\n"
+                "    }";
+    }
+    return jwks + "\n  ]\n}\n";
+}
+
+static std::string bench_projects(size_t count)
+{
+    std::string listing = "{\n  \"projects\": [\n";
+    for ( size_t ii = 0; ii < count; ii++ ) {
+        const std::string id = "project-" + std::to_string(ii * 7919 % 100000);
+        listing += std::string(ii == 0 ? "" : ",\n") +
+                   "    {\n"
+                   "      \"projectNumber\": \"" + std::to_string(100000000000 + ii * 37) + "\",\n"
+                   "      \"projectId\": \"" + id + "\",\n"
+                   "      \"lifecycleState\": \"ACTIVE\",\n"
+                   "      \"name\": \"My Project " + std::to_string(ii) + "\",\n"
+                   "      \"labels\": {\n"
+                   "        \"env\": \"" + (ii % 3 == 0 ? "prod" : "dev") + "\",\n"
+                   "        \"team\": \"identity\"\n"
+                   "      },\n"
+                   "      \"createTime\": \"2020-0" + std::to_string(1 + ii % 9) + "-14T10:23:45.123Z\",\n"
+                   "      \"parent\": {\n"
+                   "        \"type\": \"organization\",\n"
+                   "        \"id\": \"" + std::to_string(4000000 + ii % 5) + "\"\n"
+                   "      }\n"
+                   "    }";
+    }
+    return listing + "\n  ],\n  \"nextPageToken\": \"" + bench_token(64, 5) + "\"\n}\n";
+}
+
+// as deep as the default limit allows
+static std::string bench_deep_arrays()
+{
+    const size_t depth = JSON_DEFAULT_MAX_DEPTH;
+    return std::string(depth, '[') + "1" + std::string(depth, ']');
+}
+
+static std::string bench_deep_objects()
+{
+    std::string document;
+    for ( size_t ii = 0; ii < JSON_DEFAULT_MAX_DEPTH; ii++ ) {
+        document += "{\"a\":";
+    }
+    document += "null";
+    return document + std::string(JSON_DEFAULT_MAX_DEPTH, '}');
+}
+
+// a megabyte of '[' that has to be refused, not recursed into
+static std::string bench_too_deep()
+{
+    return std::string(1 << 20, '[');
+}
+
+// every character of a long string needs decoding
+static std::string bench_escapes()
+{
+    std::string text;
+    for ( int ii = 0; ii < 4096; ii++ ) {
+        text += ii % 4 == 0 ? "\\u00e9" : ii % 4 == 1 ? "\\n" : ii % 4 == 2 ? "\\ud83d\\ude00" : "\\\"";
+    }
+    return "[\"" + text + "\"]";
+}
+
+static std::string bench_wide_object(size_t count)
+{
+    std::string object = "{";
+    for ( size_t ii = 0; ii < count; ii++ ) {
+        object += (ii == 0 ? "\"k" : ",\"k") + std::to_string(ii) + "\":" + std::to_string(ii);
+    }
+    return object + "}";
+}
+
+static std::string bench_numbers(size_t count)
+{
+    std::string array = "[";
+    for ( size_t ii = 0; ii < count; ii++ ) {
+        array += (ii == 0 ? "" : ",") + std::to_string(ii * 2654435761u) + (ii % 2 ? ".25e-3" : "");
+    }
+    return array + "]";
+}
+
+struct BenchDocument
+{
+    std::string name;
+    std::string text;
+};
+
+static std::vector<BenchDocument> bench_corpus()
+{
+    return {
+        {"token_response", bench_token_response()},
+        {"discovery", bench_discovery()},
+        {"jwks", bench_jwks()},
+        {"projects_1000", bench_projects(1000)},
+        {"deep_arrays", bench_deep_arrays()},
+        {"deep_objects", bench_deep_objects()},
+        {"too_deep", bench_too_deep()},
+        {"escapes", bench_escapes()},
+        {"wide_object_10000", bench_wide_object(10000)},
+        {"numbers_10000", bench_numbers(10000)},
+    };
+}
+
+static void bench_load_directory(std::filesystem::path const & directory, std::vector<BenchDocument>& corpus)
+{
+    std::error_code error;
+    for ( auto const & entry : std::filesystem::directory_iterator(directory, error) ) {
+        if ( entry.path().extension() != ".json" ) {
+            continue;
+        }
+        std::ifstream in(entry.path(), std::ios::binary);
+        corpus.push_back({"file:" + entry.path().filename().string(),
+                          std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>())});
+    }
+    if ( error ) {
+        std::cerr << "Cannot read corpus directory " << directory << ": " << error.message() << '\n';
+    }
+}
+
+// ----------------------------------------------------------
+// Benchmarks
+// ----------------------------------------------------------
+
+static void bench_finish(benchmark::State& state, std::string const & text)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+// json_create_from_string, fresh parse state every time
+static void bench_dom(benchmark::State& state, std::string const & text)
+{
+    {
+        AllocationCounters counters(state);
+        for ( auto _ : state ) {
+            JsonItem item = json_create_from_string(text);
+            benchmark::DoNotOptimize(item);
+        }
+    }
+    bench_finish(state, text);
+}
+
+// a warm JsonParser building the same tree
+static void bench_reusable_dom(benchmark::State& state, std::string const & text)
+{
+    JsonParser parser = json_parser_create();
+    json_parser_parse(parser, text);
+    {
+        AllocationCounters counters(state);
+        for ( auto _ : state ) {
+            JsonItem item = json_parser_parse(parser, text);
+            benchmark::DoNotOptimize(item);
+        }
+    }
+    bench_finish(state, text);
+}
+
+// every token pulled and every string decoded, no tree
+static void bench_reader(benchmark::State& state, std::string const & text)
+{
+    JsonParser parser = json_parser_create();
+    {
+        AllocationCounters counters(state);
+        for ( auto _ : state ) {
+            JsonReader& reader = json_parser_read(parser, text);
+            size_t bytes = 0;
+            while ( true ) {
+                const JsonTokenType token = json_reader_next(reader);
+                if ( token == JsonTokenType::END_OF_DOCUMENT || token == JsonTokenType::ERROR ) {
+                    break;
+                }
+                if ( token == JsonTokenType::STRING || token == JsonTokenType::KEY ) {
+                    bytes += json_reader_get_view(reader).size();
+                }
+            }
+            benchmark::DoNotOptimize(bytes);
+        }
+    }
+    bench_finish(state, text);
+}
+
+template<typename T>
+static void bench_bind(benchmark::State& state, std::string const & text)
+{
+    {
+        AllocationCounters counters(state);
+        for ( auto _ : state ) {
+            T out = T {};
+            JsonBindResult result = json_bind_from_string(text, out);
+            benchmark::DoNotOptimize(result);
+            benchmark::DoNotOptimize(out);
+        }
+    }
+    bench_finish(state, text);
+}
+
+// the steady state of a client: warm parser, reused struct
+template<typename T>
+static void bench_reusable_bind(benchmark::State& state, std::string const & text)
+{
+    JsonParser parser = json_parser_create();
+    T out = T {};
+    json_parser_bind(parser, text, out);
+    {
+        AllocationCounters counters(state);
+        for ( auto _ : state ) {
+            JsonBindResult result = json_parser_bind(parser, text, out);
+            benchmark::DoNotOptimize(result);
+            benchmark::DoNotOptimize(out);
+        }
+    }
+    bench_finish(state, text);
+}
+
+int main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+
+    static std::vector<BenchDocument> corpus = bench_corpus();
+    if ( const char* directory = std::getenv("OAUTH2_JSON_CORPUS") ) {
+        bench_load_directory(directory, corpus);
+    }
+    for ( int ii = 1; ii < argc; ii++ ) {
+        bench_load_directory(argv[ii], corpus);
+    }
+
+    for ( BenchDocument const & document : corpus ) {
+        std::string const & text = document.text;
+        benchmark::RegisterBenchmark(("dom/" + document.name).c_str(), bench_dom, text);
+        benchmark::RegisterBenchmark(("reusable_dom/" + document.name).c_str(), bench_reusable_dom, text);
+        benchmark::RegisterBenchmark(("reader/" + document.name).c_str(), bench_reader, text);
+        if ( document.name == "token_response" ) {
+            benchmark::RegisterBenchmark("bind/token_response", bench_bind<TokenResponse>, text);
+            benchmark::RegisterBenchmark("reusable_bind/token_response", bench_reusable_bind<TokenResponse>, text);
+        } else if ( document.name == "discovery" ) {
+            benchmark::RegisterBenchmark("bind/discovery", bench_bind<OpenIDConfiguration>, text);
+            benchmark::RegisterBenchmark("reusable_bind/discovery", bench_reusable_bind<OpenIDConfiguration>, text);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,444 @@
+#ifndef OAUTH2_JSON_BIND_H
+#define OAUTH2_JSON_BIND_H
+
+// ----------------------------------------------------------
+// Binding JSON straight into C++ structs
+//
+// Describe a struct once with JSON_BINDING and read it with
+// json_bind_from_string.  The keys of every binding are put
+// into a perfect hash table at compile time, so looking up a
+// key while reading is one hash and one string compare.  No
+// JsonItem tree is built, values go directly into the
+// members.
+//
+//   struct Project { std::string projectId; std::string name; };
+//   JSON_BINDING(Project,
+//       JSON_FIELD(Project, projectId, JSON_REQUIRED),
+//       JSON_FIELD(Project, name, JSON_OPTIONAL));
+// ----------------------------------------------------------
+
+#include <array>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <utility>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "json_reader.h"
+#include "macros.h"
+
+constexpr bool JSON_REQUIRED = true;
+constexpr bool JSON_OPTIONAL = false;
+
+template<typename T, typename M>
+struct JsonField
+{
+    std::string_view name;
+    M T::* member;
+    bool required;
+};
+
+template<typename T, typename M>
+constexpr JsonField<T, M> json_field(std::string_view name, M T::* member, bool required)
+{
+    return JsonField<T, M> { name, member, required };
+}
+
+// Specialised by JSON_BINDING for every bindable type.
+template<typename T>
+struct JsonBinding;
+
+#define JSON_FIELD(Type, member, required) json_field(#member, &Type::member, required)
+
+#define JSON_BINDING(Type, ...)                                               \
+    template<>                                                                \
+    struct JsonBinding<Type>                                                  \
+    {                                                                         \
+        static constexpr auto fields = std::make_tuple(__VA_ARGS__);          \
+    }
+
+template<typename T, typename = void>
+struct json_is_bindable : std::false_type {};
+
+template<typename T>
+struct json_is_bindable<T, std::void_t<decltype(JsonBinding<T>::fields)>> : std::true_type {};
+
+// ----------------------------------------------------------
+// Compile-time perfect hash over the keys of a binding
+// ----------------------------------------------------------
+
+template<size_t N>
+struct JsonPerfectHash
+{
+    // at least twice as many slots as keys, rounded to a power of two
+    static constexpr size_t table_size = [] {
+        size_t size = 2;
+        while ( size < 2 * N ) {
+            size *= 2;
+        }
+        return size;
+    }();
+
+    std::uint32_t seed;
+    // field index + 1, zero marks an empty slot
+    std::array<std::uint8_t, table_size> slots;
+    std::array<std::string_view, N> keys;
+
+    [[nodiscard]] constexpr int find(std::string_view key) const
+    {
+        const std::uint8_t slot = slots[json_key_hash(key, seed) & (table_size - 1)];
+        if ( slot == 0 || keys[slot - 1] != key ) {
+            return -1;
+        }
+        return slot - 1;
+    }
+};
+
+template<size_t N>
+constexpr JsonPerfectHash<N> json_make_perfect_hash(std::array<std::string_view, N> const & keys)
+{
+    static_assert(N < 255, "too many fields for one binding");
+    JsonPerfectHash<N> table = {};
+    table.keys = keys;
+    for ( std::uint32_t seed = 1; seed < 100000; seed++ ) {
+        table.seed = seed;
+        table.slots = {};
+        bool collision = false;
+        for ( size_t ii = 0; ii < N && !collision; ii++ ) {
+            auto& slot = table.slots[json_key_hash(keys[ii], seed) & (JsonPerfectHash<N>::table_size - 1)];
+            collision = slot != 0;
+            slot = static_cast<std::uint8_t>(ii + 1);
+        }
+        if ( !collision ) {
+            return table;
+        }
+    }
+    // not a constant expression, so this is a compile error
+    throw "no perfect hash seed found, are there duplicate keys?";
+}
+
+template<typename T>
+struct JsonBindingInfo
+{
+    static constexpr auto& fields = JsonBinding<T>::fields;
+    static constexpr size_t count = std::tuple_size_v<std::decay_t<decltype(JsonBinding<T>::fields)>>;
+    static_assert(count <= 64, "required fields are tracked in a 64 bit mask");
+
+    static constexpr auto keys = std::apply([](auto const &... field) {
+        return std::array<std::string_view, sizeof...(field)> { field.name... };
+    }, JsonBinding<T>::fields);
+
+    static constexpr std::uint64_t required = std::apply([](auto const &... field) {
+        std::uint64_t mask = 0;
+        size_t index = 0;
+        ((mask |= field.required ? (std::uint64_t(1) << index) : 0, index++), ...);
+        return mask;
+    }, JsonBinding<T>::fields);
+
+    static constexpr JsonPerfectHash<count> table = json_make_perfect_hash<count>(keys);
+};
+
+// ----------------------------------------------------------
+// Reading values
+// ----------------------------------------------------------
+
+struct JsonBindResult
+{
+    bool error;
+    size_t error_pos;
+    std::string error_message;
+};
+
+// the overloads below call each other for nested types so
+// they all have to be declared up front
+template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+bool json_bind_value(JsonReader& reader, T& out);
+template<typename T>
+bool json_bind_value(JsonReader& reader, std::optional<T>& out);
+template<typename T>
+bool json_bind_value(JsonReader& reader, std::vector<T>& out);
+template<typename T, std::enable_if_t<json_is_bindable<T>::value, int> = 0>
+bool json_bind_value(JsonReader& reader, T& out);
+
+INTERNAL inline
+bool json_bind_type_error(JsonReader& reader, const char* expected)
+{
+    json_reader_fail(reader, reader.pos, expected);
+    return false;
+}
+
+INTERNAL inline
+bool json_bind_value(JsonReader& reader, std::string& out)
+{
+    if ( reader.token != JsonTokenType::STRING ) {
+        return json_bind_type_error(reader, "Expected a string.");
+    }
+    // assign rather than construct so out keeps its capacity
+    out.assign(json_reader_get_view(reader));
+    return !reader.error;
+}
+
+INTERNAL inline
+bool json_bind_value(JsonReader& reader, bool& out)
+{
+    if ( reader.token != JsonTokenType::TRUE_VALUE && reader.token != JsonTokenType::FALSE_VALUE ) {
+        return json_bind_type_error(reader, "Expected true or false.");
+    }
+    out = reader.token == JsonTokenType::TRUE_VALUE;
+    return true;
+}
+
+INTERNAL inline
+bool json_bind_value(JsonReader& reader, double& out)
+{
+    if ( reader.token != JsonTokenType::NUMBER ) {
+        return json_bind_type_error(reader, "Expected a number.");
+    }
+    out = reader.number.type == JsonItemType::INTEGER ? static_cast<double>(reader.number.integer)
+                                                      : reader.number.real;
+    return true;
+}
+
+template<typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int>>
+bool json_bind_value(JsonReader& reader, T& out)
+{
+    if ( reader.token != JsonTokenType::NUMBER || reader.number.type != JsonItemType::INTEGER ) {
+        return json_bind_type_error(reader, "Expected an integer.");
+    }
+    // compared as signed or unsigned as each side needs, so neither
+    // a negative value nor a large one wraps into range
+    const std::int64_t value = reader.number.integer;
+    const bool too_small = std::is_signed_v<T> ? value < static_cast<std::int64_t>(std::numeric_limits<T>::min())
+                                               : value < 0;
+    const bool too_large = value > 0
+                        && static_cast<std::uint64_t>(value) > static_cast<std::uint64_t>(std::numeric_limits<T>::max());
+    if ( too_small || too_large ) {
+        return json_bind_type_error(reader, "Integer out of range.");
+    }
+    out = static_cast<T>(value);
+    return true;
+}
+
+template<typename T>
+bool json_bind_value(JsonReader& reader, std::optional<T>& out)
+{
+    if ( reader.token == JsonTokenType::NULL_VALUE ) {
+        out.reset();
+        return true;
+    }
+    if ( !out.has_value() ) {
+        out.emplace();
+    }
+    return json_bind_value(reader, *out);
+}
+
+template<typename T>
+bool json_bind_value(JsonReader& reader, std::vector<T>& out)
+{
+    if ( reader.token != JsonTokenType::BEGIN_ARRAY ) {
+        return json_bind_type_error(reader, "Expected an array.");
+    }
+    // bind over the existing elements first so a vector that is
+    // bound again keeps the memory its elements own
+    size_t count = 0;
+    while ( json_reader_next(reader) != JsonTokenType::END_ARRAY ) {
+        if ( reader.error ) {
+            return false;
+        }
+        if ( count == out.size() ) {
+            out.emplace_back();
+        }
+        if ( !json_bind_value(reader, out[count++]) ) {
+            return false;
+        }
+    }
+    out.resize(count);
+    return true;
+}
+
+template<typename T, size_t... I>
+bool json_bind_field(JsonReader& reader, T& out, size_t index, std::index_sequence<I...>)
+{
+    bool ok = true;
+    ((index == I ? (ok = json_bind_value(reader, out.*(std::get<I>(JsonBindingInfo<T>::fields).member)), true)
+                 : false) || ...);
+    return ok;
+}
+
+// Members whose key was not in the object go back to their
+// default, otherwise binding into a reused struct would leave
+// values behind from the previous document.
+template<typename T, size_t... I>
+void json_bind_reset_unseen(T& out, std::uint64_t seen, std::index_sequence<I...>)
+{
+    ((seen & (std::uint64_t(1) << I) ? void()
+        : void(out.*(std::get<I>(JsonBindingInfo<T>::fields).member) = {})), ...);
+}
+
+template<typename T>
+bool json_bind_object(JsonReader& reader, T& out)
+{
+    using Info = JsonBindingInfo<T>;
+    if ( reader.token != JsonTokenType::BEGIN_OBJECT ) {
+        return json_bind_type_error(reader, "Expected an object.");
+    }
+    const size_t start = reader.pos - 1;
+    std::uint64_t seen = 0;
+    while ( json_reader_next(reader) == JsonTokenType::KEY ) {
+        const int index = Info::table.find(json_reader_get_view(reader));
+        json_reader_next(reader);
+        if ( reader.error ) {
+            if ( index >= 0 ) {
+                reader.error_message = "'" + std::string(Info::keys[index]) + "': " + reader.error_message;
+            }
+            return false;
+        }
+        if ( index < 0 ) {
+            if ( !json_reader_skip(reader) ) {
+                return false;
+            }
+            continue;
+        }
+        if ( !json_bind_field(reader, out, static_cast<size_t>(index), std::make_index_sequence<Info::count>{}) ) {
+            // prefix the key so nested errors read like a path
+            reader.error_message = "'" + std::string(Info::keys[index]) + "': " + reader.error_message;
+            return false;
+        }
+        seen |= std::uint64_t(1) << index;
+    }
+    if ( reader.error ) {
+        return false;
+    }
+    const std::uint64_t missing = Info::required & ~seen;
+    if ( missing != 0 ) {
+        size_t index = 0;
+        while ( !(missing & (std::uint64_t(1) << index)) ) {
+            index++;
+        }
+        reader.error = true;
+        reader.error_pos = start;
+        reader.error_message = "Missing required field '" + std::string(Info::keys[index]) + "'.";
+        return false;
+    }
+    json_bind_reset_unseen(out, seen, std::make_index_sequence<Info::count>{});
+    return true;
+}
+
+template<typename T, std::enable_if_t<json_is_bindable<T>::value, int>>
+bool json_bind_value(JsonReader& reader, T& out)
+{
+    return json_bind_object(reader, out);
+}
+
+// Bind the whole document of a reader that has not been
+// advanced yet, lets the caller reuse a reader's memory.
+template<typename T>
+JsonBindResult json_bind_from_reader(JsonReader& reader, T& out)
+{
+    json_reader_next(reader);
+    if ( !reader.error && json_bind_value(reader, out) ) {
+        json_reader_next(reader);
+    }
+    JsonBindResult result = JsonBindResult {};
+    result.error = reader.error;
+    result.error_pos = reader.error_pos;
+    result.error_message = reader.error_message;
+    return result;
+}
+
+// entry point
+template<typename T>
+JsonBindResult json_bind_from_string(std::string_view buffer, T& out)
+{
+    JsonReader reader = json_reader_create(buffer);
+    return json_bind_from_reader(reader, out);
+}
+
+#ifdef TEST_JSON_BIND
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+struct TestProject
+{
+    std::string projectId;
+    std::string name;
+    std::int64_t projectNumber = 0;
+    std::optional<double> score;
+    std::uint16_t shard = 0;
+};
+
+JSON_BINDING(TestProject,
+    JSON_FIELD(TestProject, projectId, JSON_REQUIRED),
+    JSON_FIELD(TestProject, name, JSON_OPTIONAL),
+    JSON_FIELD(TestProject, projectNumber, JSON_OPTIONAL),
+    JSON_FIELD(TestProject, score, JSON_OPTIONAL),
+    JSON_FIELD(TestProject, shard, JSON_OPTIONAL));
+
+struct TestProjectList
+{
+    std::vector<TestProject> projects;
+};
+
+JSON_BINDING(TestProjectList,
+    JSON_FIELD(TestProjectList, projects, JSON_REQUIRED));
+
+static_assert(JsonBindingInfo<TestProject>::table.find("name") == 1);
+static_assert(JsonBindingInfo<TestProject>::table.find("unknown") == -1);
+
+int main()
+{
+    // each document and what binding it gives: a line per project,
+    // or the error
+    struct { const char* text; const char* expected; } tests[] = {
+        { R"({"skip": [1, {"a": []}], "projects": [{"projectId": "a", "projectNumber": -5, "score": null},
+                                                   {"name": "b", "projectId": "b", "score": 2.5}]})",
+          "a  -5 0 0\nb b 0 2.5 0\n" },
+        { R"({"projects": [{"name": "no id"}]})",
+          "Error at 14: 'projects': Missing required field 'projectId'.\n" },
+        { R"({"projects": [{"project\u0049d": "escaped\tkey", "name": "caf\u00e9 \ud83d\ude00"}]})",
+          "escaped\tkey caf\xc3\xa9 \xf0\x9f\x98\x80 0 0 0\n" },
+        { R"({"projects": [{"projectId": "bad \x escape"}]})",
+          "Error at 33: 'projects': 'projectId': Invalid escape sequence.\n" },
+        { R"({"projects": [{"projectId": 1}]})",
+          "Error at 29: 'projects': 'projectId': Expected a string.\n" },
+        { R"({"projects": []} trailing)",
+          "Error at 17: Unexpected characters after the end of the document.\n" },
+        { R"({"projects": [],})",
+          "Error at 16: Key must be a string.\n" },
+        { R"({"projects": [{"projectId": "c", "shard": 65535, "projectNumber": -9223372036854775808}]})",
+          "c  -9223372036854775808 0 65535\n" },
+        { R"({"projects": [{"projectId": "d", "shard": 65536}]})",
+          "Error at 47: 'projects': 'shard': Integer out of range.\n" },
+        { R"({"projects": [{"projectId": "e", "shard": -1}]})",
+          "Error at 44: 'projects': 'shard': Integer out of range.\n" },
+    };
+    int failures = 0;
+    for ( auto const & test : tests ) {
+        TestProjectList list;
+        const JsonBindResult result = json_bind_from_string(test.text, list);
+        std::ostringstream out;
+        if ( result.error ) {
+            out << "Error at " << result.error_pos << ": " << result.error_message << '\n';
+        } else {
+            for ( TestProject const & project : list.projects ) {
+                out << project.projectId << " " << project.name << " " << project.projectNumber << " "
+                    << (project.score ? *project.score : 0.0) << " " << project.shard << '\n';
+            }
+        }
+        std::cout << out.str();
+        if ( out.str() != test.expected ) {
+            std::cout << "FAIL, expected " << test.expected;
+            failures++;
+        }
+    }
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_JSON_BIND_H */
@@ -0,0 +1,409 @@
+// ----------------------------------------------------------
+// JSON conformance test
+// Runs the parsers over cases from JSONTestSuite
+// (https://github.com/nst/JSONTestSuite) so that work on the
+// fast paths cannot quietly change what is accepted:
+//   y_  must be accepted by the reader and the DOM parser, and
+//       both must produce the same value
+//   n_  must be rejected by the reader, and by the DOM parser
+//       unless it is one of dom_lenient_cases
+//   i_  either answer is fine, but nothing may crash
+// The DOM parser is lenient on purpose (trailing commas, single
+// quotes, bare words, control characters and unknown escapes in
+// strings), the n_ cases it lets through for that are listed by
+// name.  Anything else it accepts is a bug.
+//
+// A subset of the suite is built in.  Pass the suite's
+// test_parsing directory to run every case in it as well.
+// ----------------------------------------------------------
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "json_parser.h"
+#include "json_reader.h"
+
+struct ConformanceCase
+{
+    const char* name;
+    std::string_view text;
+};
+
+#define CASE(name, text) ConformanceCase { name, std::string_view(text, sizeof(text) - 1) }
+
+static const ConformanceCase conformance_cases[] = {
+    CASE("y_array_arraysWithSpaces", "[[]   ]"),
+    CASE("y_array_empty", "[]"),
+    CASE("y_array_empty-string", "[\"\"]"),
+    CASE("y_array_ending_with_newline", "[\"a\"]\n"),
+    CASE("y_array_false", "[false]"),
+    CASE("y_array_heterogeneous", "[null, 1, \"1\", {}]"),
+    CASE("y_array_null", "[null]"),
+    CASE("y_array_with_leading_space", " [1]"),
+    CASE("y_array_with_several_null", "[1,null,null,null,2]"),
+    CASE("y_array_with_trailing_space", "[2] "),
+    CASE("y_number", "[123e65]"),
+    CASE("y_number_0e+1", "[0e+1]"),
+    CASE("y_number_0e1", "[0e1]"),
+    CASE("y_number_after_space", "[ 4]"),
+    CASE("y_number_double_close_to_zero", "[-0.000000000000000000000000000000000000000000000000000000000000000000000000000001]"),
+    CASE("y_number_int_with_exp", "[20e1]"),
+    CASE("y_number_minus_zero", "[-0]"),
+    CASE("y_number_negative_int", "[-123]"),
+    CASE("y_number_negative_one", "[-1]"),
+    CASE("y_number_real_capital_e", "[1E22]"),
+    CASE("y_number_real_capital_e_neg_exp", "[1E-2]"),
+    CASE("y_number_real_capital_e_pos_exp", "[1E+2]"),
+    CASE("y_number_real_exponent", "[123e45]"),
+    CASE("y_number_real_fraction_exponent", "[123.456e78]"),
+    CASE("y_number_real_neg_exp", "[1e-2]"),
+    CASE("y_number_real_pos_exponent", "[1e+2]"),
+    CASE("y_number_simple_int", "[123]"),
+    CASE("y_number_simple_real", "[123.456789]"),
+    CASE("y_object", "{\"asd\":\"sdf\", \"dfg\":\"fgh\"}"),
+    CASE("y_object_basic", "{\"asd\":\"sdf\"}"),
+    CASE("y_object_duplicated_key", "{\"a\":\"b\",\"a\":\"c\"}"),
+    CASE("y_object_duplicated_key_and_value", "{\"a\":\"b\",\"a\":\"b\"}"),
+    CASE("y_object_empty", "{}"),
+    CASE("y_object_empty_key", "{\"\":0}"),
+    CASE("y_object_escaped_null_in_key", "{\"foo\\u0000bar\": 42}"),
+    CASE("y_object_extreme_numbers", "{ \"min\": -1.0e+28, \"max\": 1.0e+28 }"),
+    CASE("y_object_long_strings", "{\"x\":[{\"id\": \"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\"}], \"id\": \"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\"}"),
+    CASE("y_object_simple", "{\"a\":[]}"),
+    CASE("y_object_string_unicode", "{\"title\":\"\\u041f\\u043e\\u043b\\u0442\\u043e\\u0440\\u0430 \\u0417\\u0435\\u043c\\u043b\\u0435\\u043a\\u043e\\u043f\\u0430\" }"),
+    CASE("y_object_with_newlines", "{\n\"a\": \"b\"\n}"),
+    CASE("y_string_1_2_3_bytes_UTF-8_sequences", "[\"\\u0060\\u012a\\u12AB\"]"),
+    CASE("y_string_accepted_surrogate_pair", "[\"\\uD801\\udc37\"]"),
+    CASE("y_string_accepted_surrogate_pairs", "[\"\\ud83d\\ude39\\ud83d\\udc8d\"]"),
+    CASE("y_string_allowed_escapes", "[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"]"),
+    CASE("y_string_backslash_and_u_escaped_zero", "[\"\\\\u0000\"]"),
+    CASE("y_string_backslash_doublequotes", "[\"\\\"\"]"),
+    CASE("y_string_comments", "[\"a/*b*/c/*d//e\"]"),
+    CASE("y_string_double_escape_a", "[\"\\\\a\"]"),
+    CASE("y_string_double_escape_n", "[\"\\\\n\"]"),
+    CASE("y_string_escaped_control_character", "[\"\\u0012\"]"),
+    CASE("y_string_escaped_noncharacter", "[\"\\uFFFF\"]"),
+    CASE("y_string_in_array", "[\"asd\"]"),
+    CASE("y_string_in_array_with_leading_space", "[ \"asd\"]"),
+    CASE("y_string_last_surrogates_1_and_2", "[\"\\uDBFF\\uDFFF\"]"),
+    CASE("y_string_nbsp_uescaped", "[\"new\\u00A0line\"]"),
+    CASE("y_string_nonCharacterInUTF-8_U+FFFF", "[\"\xef\xbf\xbf\"]"),
+    CASE("y_string_null_escape", "[\"\\u0000\"]"),
+    CASE("y_string_one-byte-utf-8", "[\"\\u002c\"]"),
+    CASE("y_string_pi", "[\"\xcf\x80\"]"),
+    CASE("y_string_simple_ascii", "[\"asd \"]"),
+    CASE("y_string_space", "\" \""),
+    CASE("y_string_three-byte-utf-8", "[\"\\u0821\"]"),
+    CASE("y_string_two-byte-utf-8", "[\"\\u0123\"]"),
+    CASE("y_string_u+2028_line_sep", "[\"\xe2\x80\xa8\"]"),
+    CASE("y_string_uEscape", "[\"\\u0061\\u30af\\u30EA\\u30b9\"]"),
+    CASE("y_string_unicode", "[\"\\uA66D\"]"),
+    CASE("y_string_unicode_escaped_double_quote", "[\"\\u0022\"]"),
+    CASE("y_string_utf8", "[\"\xe2\x82\xac\xf0\x9d\x84\x9e\"]"),
+    CASE("y_structure_lonely_false", "false"),
+    CASE("y_structure_lonely_int", "42"),
+    CASE("y_structure_lonely_negative_real", "-0.1"),
+    CASE("y_structure_lonely_null", "null"),
+    CASE("y_structure_lonely_string", "\"asd\""),
+    CASE("y_structure_lonely_true", "true"),
+    CASE("y_structure_string_empty", "\"\""),
+    CASE("y_structure_trailing_newline", "[\"a\"]\n"),
+    CASE("y_structure_true_in_array", "[true]"),
+    CASE("y_structure_whitespace_array", " [] "),
+
+    CASE("n_array_1_true_without_comma", "[1 true]"),
+    CASE("n_array_colon_instead_of_comma", "[\"\": 1]"),
+    CASE("n_array_comma_after_close", "[\"\"],"),
+    CASE("n_array_comma_and_number", "[,1]"),
+    CASE("n_array_double_comma", "[1,,2]"),
+    CASE("n_array_extra_close", "[\"x\"]]"),
+    CASE("n_array_extra_comma", "[\"\",]"),
+    CASE("n_array_incomplete", "[\"x\""),
+    CASE("n_array_incomplete_invalid_value", "[x"),
+    CASE("n_array_items_separated_by_semicolon", "[1:2]"),
+    CASE("n_array_just_comma", "[,]"),
+    CASE("n_array_just_minus", "[-]"),
+    CASE("n_array_missing_value", "[   , \"\"]"),
+    CASE("n_array_number_and_comma", "[1,]"),
+    CASE("n_array_star_inside", "[*]"),
+    CASE("n_array_unclosed", "[\"\""),
+    CASE("n_array_unclosed_with_new_lines", "[1,\n1\n,1"),
+    CASE("n_incomplete_false", "[fals]"),
+    CASE("n_incomplete_null", "[nul]"),
+    CASE("n_incomplete_true", "[tru]"),
+    CASE("n_number_++", "[++1234]"),
+    CASE("n_number_+1", "[+1]"),
+    CASE("n_number_-01", "[-01]"),
+    CASE("n_number_-1.0.", "[-1.0.]"),
+    CASE("n_number_.-1", "[.-1]"),
+    CASE("n_number_.2e-3", "[.2e-3]"),
+    CASE("n_number_0.e1", "[0.e1]"),
+    CASE("n_number_0_capital_E+", "[0E+]"),
+    CASE("n_number_1.0e-", "[1.0e-]"),
+    CASE("n_number_2.e3", "[2.e3]"),
+    CASE("n_number_9.e+", "[9.e+]"),
+    CASE("n_number_Inf", "[Inf]"),
+    CASE("n_number_NaN", "[NaN]"),
+    CASE("n_number_hex_1_digit", "[0x1]"),
+    CASE("n_number_minus_infinity", "[-Infinity]"),
+    CASE("n_number_neg_int_starting_with_zero", "[-012]"),
+    CASE("n_number_real_without_fractional_part", "[1.]"),
+    CASE("n_number_with_leading_zero", "[012]"),
+    CASE("n_object_bad_value", "[\"x\", truth]"),
+    CASE("n_object_comma_instead_of_colon", "{\"x\", null}"),
+    CASE("n_object_double_colon", "{\"x\"::\"b\"}"),
+    CASE("n_object_missing_colon", "{\"a\" b}"),
+    CASE("n_object_missing_key", "{:\"b\"}"),
+    CASE("n_object_missing_value", "{\"a\":"),
+    CASE("n_object_no-colon", "{\"a\""),
+    CASE("n_object_non_string_key", "{1:1}"),
+    CASE("n_object_single_quote", "{'a':0}"),
+    CASE("n_object_trailing_comma", "{\"id\":0,}"),
+    CASE("n_object_unquoted_key", "{a: \"b\"}"),
+    CASE("n_object_with_trailing_garbage", "{\"a\":\"b\"}#"),
+    CASE("n_single_space", " "),
+    CASE("n_string_1_surrogate_then_escape_u", "[\"\\uD800\\u\"]"),
+    CASE("n_string_escape_x", "[\"\\x00\"]"),
+    CASE("n_string_escaped_backslash_bad", "[\"\\\\\\\"]"),
+    CASE("n_string_escaped_ctrl_char_tab", "[\"\\\t\"]"),
+    CASE("n_string_incomplete_escape", "[\"\\\"]"),
+    CASE("n_string_incomplete_escaped_character", "[\"\\u00A\"]"),
+    CASE("n_string_invalid_backslash_esc", "[\"\\a\"]"),
+    CASE("n_string_invalid_unicode_escape", "[\"\\uqqqq\"]"),
+    CASE("n_string_no_quotes_with_bad_escape", "[\\n]"),
+    CASE("n_string_single_quote", "['single quote']"),
+    CASE("n_string_single_string_no_double_quotes", "abc"),
+    CASE("n_string_unescaped_ctrl_char", "[\"a\x01" "a\"]"),
+    CASE("n_string_unescaped_newline", "[\"new\nline\"]"),
+    CASE("n_string_unescaped_tab", "[\"\t\"]"),
+    CASE("n_structure_angle_bracket_.", "<.>"),
+    CASE("n_structure_array_trailing_garbage", "[1]x"),
+    CASE("n_structure_array_with_extra_array_close", "[1]]"),
+    CASE("n_structure_close_unopened_array", "1]"),
+    CASE("n_structure_double_array", "[][]"),
+    CASE("n_structure_end_array", "]"),
+    CASE("n_structure_no_data", ""),
+    CASE("n_structure_null-byte-outside-string", "[\0]"),
+    CASE("n_multidigit_number_then_00", "123\0"),
+    CASE("n_structure_number_with_trailing_garbage", "2@"),
+    CASE("n_structure_object_followed_by_closing_object", "{}}"),
+    CASE("n_structure_object_unclosed_no_value", "{\"\":"),
+    CASE("n_structure_object_with_trailing_garbage", "{\"a\": true} \"x\""),
+    CASE("n_structure_open_array_object", "[{\"\":[{\"\":[{\"\":"),
+    CASE("n_structure_trailing_#", "{\"a\":\"b\"}#{}"),
+    CASE("n_structure_unclosed_array", "[1"),
+    CASE("n_structure_unclosed_object", "{\"asd\":\"asd\""),
+    CASE("n_structure_whitespace_formfeed", "[\f]"),
+
+    CASE("i_number_double_huge_neg_exp", "[123.456e-789]"),
+    CASE("i_number_huge_exp", "[0.4e00669999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999999969999999006]"),
+    CASE("i_number_neg_int_huge_exp", "[-1e+9999]"),
+    CASE("i_number_pos_double_huge_exp", "[1.5e+9999]"),
+    CASE("i_number_too_big_neg_int", "[-123123123123123123123123123123]"),
+    CASE("i_number_too_big_pos_int", "[100000000000000000000]"),
+    CASE("i_number_very_big_negative_int", "[-237462374673276894279832749832423479823246327846]"),
+    CASE("i_object_key_lone_2nd_surrogate", "{\"\\uDFAA\":0}"),
+    CASE("i_string_1st_surrogate_but_2nd_missing", "[\"\\uDADA\"]"),
+    CASE("i_string_1st_valid_surrogate_2nd_invalid", "[\"\\uD888\\u1234\"]"),
+    CASE("i_string_incomplete_surrogate_and_escape_valid", "[\"\\uD800\\n\"]"),
+    CASE("i_string_invalid_lonely_surrogate", "[\"\\ud800\"]"),
+    CASE("i_string_invalid_surrogate", "[\"\\ud800abc\"]"),
+    CASE("i_string_inverted_surrogates_U+1D11E", "[\"\\uDd1e\\uD834\"]"),
+    CASE("i_string_lone_second_surrogate", "[\"\\uDFAA\"]"),
+    CASE("i_string_invalid_utf-8", "[\"\xff\"]"),
+    CASE("i_string_overlong_sequence_2_bytes", "[\"\xc0\xaf\"]"),
+    CASE("i_string_truncated-utf-8", "[\"\xe0\xff\"]"),
+    CASE("i_string_UTF-16LE_with_BOM", "\xff\xfe[\0\"\0\xe9\0\"\0]\0"),
+    CASE("i_structure_UTF-8_BOM_empty_object", "\xef\xbb\xbf{}"),
+    CASE("i_structure_500_nested_arrays",
+         "[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[["
+         "]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]"),
+};
+
+#undef CASE
+
+// Build the value at the reader's current token the way the DOM
+// parser would, so the two can be compared through json_to_string.
+static JsonItem conformance_read_item(JsonReader& reader)
+{
+    JsonItem item = json_create_new();
+    switch ( reader.token ) {
+        case JsonTokenType::BEGIN_OBJECT:
+            item.type = JsonItemType::OBJECT;
+            while ( json_reader_next(reader) == JsonTokenType::KEY ) {
+                JsonKey key(json_reader_get_view(reader));
+                json_reader_next(reader);
+                JsonItem value = conformance_read_item(reader);
+                item.object.emplace(std::move(key), std::move(value));
+            }
+            break;
+        case JsonTokenType::BEGIN_ARRAY:
+            item.type = JsonItemType::ARRAY;
+            while ( json_reader_next(reader) != JsonTokenType::END_ARRAY && !reader.error ) {
+                item.array.push_back(conformance_read_item(reader));
+            }
+            break;
+        case JsonTokenType::STRING:
+            item.type = JsonItemType::TEXT;
+            item.text = json_reader_get_string(reader);
+            break;
+        case JsonTokenType::NUMBER:
+            item.type = reader.number.type;
+            item.integer = reader.number.integer;
+            item.real = reader.number.real;
+            break;
+        case JsonTokenType::TRUE_VALUE:
+            item.type = JsonItemType::TRUE_VALUE;
+            break;
+        case JsonTokenType::FALSE_VALUE:
+            item.type = JsonItemType::FALSE_VALUE;
+            break;
+        case JsonTokenType::NULL_VALUE:
+            item.type = JsonItemType::NULL_VALUE;
+            break;
+        default:
+            item.type = JsonItemType::ERROR;
+            break;
+    }
+    return item;
+}
+
+// n_ cases the DOM parser accepts on purpose, by the leniency
+// that lets each one through.  Names from the full suite are
+// included so that a run over its directory is held to the same.
+static const std::string_view dom_lenient_cases[] = {
+    // trailing commas
+    "n_array_extra_comma",
+    "n_array_number_and_comma",
+    "n_object_trailing_comma",
+    "n_object_lone_continuation_byte_in_key_and_trailing_comma",
+    // single quotes
+    "n_object_single_quote",
+    "n_string_single_quote",
+    // bare words, as values and as keys
+    "n_incomplete_false",
+    "n_incomplete_null",
+    "n_incomplete_true",
+    "n_number_Inf",
+    "n_number_NaN",
+    "n_number_infinity",
+    "n_object_bad_value",
+    "n_object_key_with_single_quotes",
+    "n_object_non_string_key",
+    "n_object_unquoted_key",
+    "n_structure_capitalized_True",
+    // control characters inside strings
+    "n_string_escaped_ctrl_char_tab",
+    "n_string_unescaped_ctrl_char",
+    "n_string_unescaped_newline",
+    "n_string_unescaped_tab",
+    // unknown escapes stand for the character escaped
+    "n_string_backslash_00",
+    "n_string_escape_x",
+    "n_string_escaped_emoji",
+    "n_string_invalid_backslash_esc",
+    "n_string_invalid_utf8_after_escape",
+    "n_string_unicode_CapitalU",
+};
+
+static bool conformance_dom_may_accept(std::string_view name)
+{
+    if ( name.size() > 5 && name.substr(name.size() - 5) == ".json" ) {
+        name.remove_suffix(5);
+    }
+    return std::find(std::begin(dom_lenient_cases), std::end(dom_lenient_cases), name) != std::end(dom_lenient_cases);
+}
+
+// Read the whole document with the strict reader, decoding every
+// string and key.  Returns false when it is rejected.
+static bool conformance_read(std::string_view text, JsonItem& out)
+{
+    JsonReader reader = json_reader_create(text);
+    json_reader_next(reader);
+    out = conformance_read_item(reader);
+    if ( !reader.error ) {
+        json_reader_next(reader);
+    }
+    return !reader.error && reader.token == JsonTokenType::END_OF_DOCUMENT;
+}
+
+// Returns the number of failures for one case, printing each.
+static int conformance_check(std::string const & name, std::string_view text)
+{
+    JsonItem from_reader;
+    const bool accepted = conformance_read(text, from_reader);
+    // the DOM parser runs on every case, i_ and n_ included, so
+    // a crash anywhere shows up here
+    const JsonItem from_dom = json_create_from_string(std::string(text));
+    const bool dom_accepted = from_dom.type != JsonItemType::ERROR &&
+                              from_dom.type != JsonItemType::END_OF_JSON_VALUES;
+
+    int failures = 0;
+    if ( name[0] == 'y' ) {
+        if ( !accepted ) {
+            std::cout << "FAIL " << name << ": rejected by the reader\n";
+            failures++;
+        }
+        if ( !dom_accepted ) {
+            std::cout << "FAIL " << name << ": rejected by the parser: " << from_dom.text << '\n';
+            failures++;
+        }
+        if ( accepted && dom_accepted && json_to_string(from_reader) != json_to_string(from_dom) ) {
+            std::cout << "FAIL " << name << ": reader " << json_to_string(from_reader)
+                      << " but parser " << json_to_string(from_dom) << '\n';
+            failures++;
+        }
+    } else if ( name[0] == 'n' ) {
+        if ( accepted ) {
+            std::cout << "FAIL " << name << ": accepted by the reader\n";
+            failures++;
+        }
+        if ( dom_accepted && !conformance_dom_may_accept(name) ) {
+            std::cout << "FAIL " << name << ": accepted by the parser as " << json_to_string(from_dom) << '\n';
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int conformance_check_directory(std::filesystem::path const & directory, size_t& count)
+{
+    int failures = 0;
+    for ( auto const & entry : std::filesystem::directory_iterator(directory) ) {
+        const std::string name = entry.path().filename().string();
+        if ( entry.path().extension() != ".json" || name.size() < 2 || name[1] != '_' ) {
+            continue;
+        }
+        std::ifstream in(entry.path(), std::ios::binary);
+        const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        failures += conformance_check(name, text);
+        count++;
+    }
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    int failures = 0;
+    size_t count = 0;
+    for ( ConformanceCase const & test : conformance_cases ) {
+        failures += conformance_check(test.name, test.text);
+        count++;
+    }
+    if ( argc > 1 ) {
+        std::error_code error;
+        if ( !std::filesystem::is_directory(argv[1], error) ) {
+            std::cerr << argv[1] << " is not a directory\n";
+            return EXIT_FAILURE;
+        }
+        failures += conformance_check_directory(argv[1], count);
+    }
+    std::cout << count << " cases, " << failures << " failures\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
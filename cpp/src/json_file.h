@@ -0,0 +1,180 @@
+#ifndef OAUTH2_JSON_FILE_H
+#define OAUTH2_JSON_FILE_H
+
+// ----------------------------------------------------------
+// JSON from files
+// Cached discovery documents, JWKS snapshots and token caches
+// are parsed straight out of a read-only memory mapping of the
+// file instead of being read into a std::string first.  The
+// mapping is advised for sequential access since every parse
+// reads the document front to back once.
+// ----------------------------------------------------------
+
+#include <string>
+#include <string_view>
+
+#include "json_parser.h"
+#include "json_reader.h"
+#include "json_bind.h"
+#include "mapped_file.h"
+#include "macros.h"
+
+// A pull reader over a mapped file.  Views from the reader point
+// into the mapping and stay valid while this object lives, moving
+// it does not move the mapping.
+struct JsonFileReader
+{
+    MappedFile file;
+    JsonReader reader;
+};
+
+INTERNAL inline
+JsonItem json_file_error(std::string const & message)
+{
+    JsonItem item = json_create_new();
+    item.type = JsonItemType::ERROR;
+    item.text = message;
+    return item;
+}
+
+// entry point
+// The JsonItem tree owns all of its data, so the mapping is
+// released as soon as the parse is done.  A file with no document
+// in it is an error, as it is for the reader and for binding: it
+// is one that was cut short, not one that is meant to be empty.
+ENTRYPOINT inline
+JsonItem json_parse_file(std::string const & path, JsonParseOptions const & options)
+{
+    const MappedFile file(path, MappedFileAccess::SEQUENTIAL);
+    if ( !file.is_valid() ) {
+        return json_file_error(file.error());
+    }
+    JsonParseContext context = JsonParseContext {};
+    json_context_reset(context, options);
+    JsonItem item = json_parse_with_context(context, file.view());
+    if ( item.type == JsonItemType::END_OF_JSON_VALUES ) {
+        return json_file_error("'" + path + "' holds no JSON document");
+    }
+    return item;
+}
+
+ENTRYPOINT inline
+JsonItem json_parse_file(std::string const & path)
+{
+    return json_parse_file(path, json_default_parse_options());
+}
+
+// Map a file for reading token by token.  On failure the reader
+// is already in the ERROR state with the reason in error_message.
+ENTRYPOINT inline
+JsonFileReader json_open_file_reader(std::string const & path, size_t max_depth = JSON_DEFAULT_MAX_DEPTH)
+{
+    JsonFileReader file_reader = JsonFileReader {};
+    file_reader.file.open(path, MappedFileAccess::SEQUENTIAL);
+    file_reader.reader = json_reader_create(file_reader.file.view(), max_depth);
+    if ( !file_reader.file.is_valid() ) {
+        json_reader_fail(file_reader.reader, 0, "");
+        file_reader.reader.error_message = file_reader.file.error();
+    }
+    return file_reader;
+}
+
+// Bind a file into out, see json_bind_from_string.
+template<typename T>
+JsonBindResult json_bind_from_file(std::string const & path, T& out)
+{
+    const MappedFile file(path, MappedFileAccess::SEQUENTIAL);
+    if ( !file.is_valid() ) {
+        JsonBindResult result = JsonBindResult {};
+        result.error = true;
+        result.error_message = file.error();
+        return result;
+    }
+    return json_bind_from_string(file.view(), out);
+}
+
+#ifdef TEST_JSON_FILE
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+struct TestConfiguration
+{
+    std::string issuer;
+    std::string jwks_uri;
+};
+
+JSON_BINDING(TestConfiguration,
+    JSON_FIELD(TestConfiguration, issuer, JSON_REQUIRED),
+    JSON_FIELD(TestConfiguration, jwks_uri, JSON_OPTIONAL));
+
+int main()
+{
+    int failures = 0;
+    const std::string path = "json_file_test.json";
+    const std::string document =
+        "{ \"issuer\": \"https://accounts.google.com\",\n"
+        "  \"jwks_uri\": \"https://www.googleapis.com/oauth2/v3/certs\",\n"
+        "  \"scopes_supported\": [\"openid\", \"email\", \"profile\"] }\n";
+    {
+        std::ofstream out(path);
+        out << document;
+    }
+
+    JsonItem item = json_parse_file(path);
+    std::cout << json_to_string(item) << '\n';
+    failures += json_to_string(item) != json_to_string(json_create_from_string(document));
+
+    {
+        JsonFileReader file_reader = json_open_file_reader(path);
+        JsonReader& reader = file_reader.reader;
+        size_t strings = 0;
+        size_t in_place = 0;
+        while ( json_reader_next(reader) != JsonTokenType::END_OF_DOCUMENT && !reader.error ) {
+            if ( reader.token == JsonTokenType::STRING || reader.token == JsonTokenType::KEY ) {
+                // the view points into the mapping, not at a copy
+                const std::string_view text = json_reader_get_view(reader);
+                strings++;
+                in_place += text.data() >= file_reader.file.data() &&
+                            text.data() + text.size() <= file_reader.file.data() + file_reader.file.size();
+            }
+        }
+        std::cout << in_place << " of " << strings << " strings read in place\n";
+        // three keys, two values and three scopes
+        failures += reader.error || strings != 8 || in_place != strings;
+    }
+
+    TestConfiguration configuration = TestConfiguration {};
+    const JsonBindResult result = json_bind_from_file(path, configuration);
+    std::cout << result.error << ' ' << configuration.issuer << ' ' << configuration.jwks_uri << '\n';
+    failures += result.error || configuration.issuer != "https://accounts.google.com" ||
+                configuration.jwks_uri != "https://www.googleapis.com/oauth2/v3/certs";
+
+    // a missing file is an error everywhere
+    std::remove(path.c_str());
+    item = json_parse_file(path);
+    std::cout << item.text << '\n';
+    failures += item.type != JsonItemType::ERROR || item.text != "cannot open 'json_file_test.json'";
+    JsonFileReader missing = json_open_file_reader(path);
+    std::cout << missing.reader.error_message << '\n';
+    failures += !missing.reader.error || json_reader_next(missing.reader) != JsonTokenType::ERROR ||
+                missing.reader.error_message != "cannot open 'json_file_test.json'";
+    const JsonBindResult missing_bind = json_bind_from_file(path, configuration);
+    std::cout << missing_bind.error_message << '\n';
+    failures += !missing_bind.error || missing_bind.error_message != "cannot open 'json_file_test.json'";
+
+    // so is an empty one
+    std::ofstream(path).close();
+    item = json_parse_file(path);
+    std::cout << item.text << '\n';
+    failures += item.type != JsonItemType::ERROR;
+    JsonFileReader empty = json_open_file_reader(path);
+    failures += json_reader_next(empty.reader) != JsonTokenType::ERROR;
+    failures += !json_bind_from_file(path, configuration).error;
+    std::remove(path.c_str());
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_JSON_FILE_H */
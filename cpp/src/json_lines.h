@@ -0,0 +1,298 @@
+#ifndef OAUTH2_JSON_LINES_H
+#define OAUTH2_JSON_LINES_H
+
+// ----------------------------------------------------------
+// JSON Lines batch processing
+// The file is memory mapped and cut into chunks that end on
+// a newline, every chunk is parsed on the thread pool and
+// the records are handed to a callback.  The callback is
+// never called from two threads at once, with ordered set it
+// sees the records in file order.  If the callback throws, no
+// more chunks are started and json_lines_process rethrows the
+// first exception once the chunks under way have finished.
+// ----------------------------------------------------------
+
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "json_parser.h"
+#include "json_reusable_parser.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "macros.h"
+
+struct JsonLinesOptions
+{
+    // zero means one per hardware thread
+    size_t threads;
+    // a chunk is extended to the next newline after this many bytes
+    size_t chunk_size;
+    // deliver records in the order they appear in the file
+    bool ordered;
+    JsonParseOptions parse_options;
+};
+
+// A parsed line, item is of type ERROR when the line was not
+// valid.  offset is the byte offset of the line in the file.
+struct JsonLineRecord
+{
+    size_t offset;
+    JsonItem item;
+};
+
+using JsonLinesCallback = std::function<void(JsonLineRecord&)>;
+
+struct JsonLinesResult
+{
+    bool error;
+    std::string error_message;
+    size_t records;
+    size_t invalid_records;
+};
+
+INTERNAL inline
+JsonLinesOptions json_lines_default_options()
+{
+    JsonLinesOptions options = JsonLinesOptions {};
+    options.threads = 0;
+    options.chunk_size = 1024 * 1024;
+    options.ordered = true;
+    options.parse_options = json_default_parse_options();
+    return options;
+}
+
+// Cut the buffer into pieces of roughly chunk_size bytes that
+// only ever end right after a '\n' (or at the end of the data).
+INTERNAL inline
+std::vector<std::string_view> json_lines_split(std::string_view data, size_t chunk_size)
+{
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    while ( start < data.size() ) {
+        size_t end = start + chunk_size;
+        if ( end >= data.size() ) {
+            end = data.size();
+        } else {
+            const size_t newline = data.find('\n', end);
+            end = newline == std::string_view::npos ? data.size() : newline + 1;
+        }
+        chunks.push_back(data.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
+
+INTERNAL inline
+void json_lines_parse_chunk(std::string_view chunk, size_t chunk_offset, JsonParser& parser,
+                            std::vector<JsonLineRecord>& records)
+{
+    size_t start = 0;
+    while ( start < chunk.size() ) {
+        size_t end = chunk.find('\n', start);
+        if ( end == std::string_view::npos ) {
+            end = chunk.size();
+        }
+        std::string_view line = chunk.substr(start, end - start);
+        size_t first = 0;
+        while ( first < line.size() && is_whitespace(line[first]) ) {
+            first++;
+        }
+        // blank lines are allowed and skipped
+        if ( first < line.size() ) {
+            JsonLineRecord record = JsonLineRecord {};
+            record.offset = chunk_offset + start;
+            record.item = json_parser_parse(parser, line);
+            records.push_back(std::move(record));
+        }
+        start = end + 1;
+    }
+}
+
+// entry point
+ENTRYPOINT inline
+JsonLinesResult json_lines_process(std::string_view data, JsonLinesOptions const & options,
+                                   JsonLinesCallback const & callback)
+{
+    JsonLinesResult result = JsonLinesResult {};
+    const std::vector<std::string_view> chunks = json_lines_split(data, options.chunk_size == 0 ? 1 : options.chunk_size);
+
+    std::mutex mutex;
+    std::condition_variable chunk_done;
+    // finished chunks waiting to be delivered, by chunk number;
+    // all the slots exist up front so a task never allocates
+    // under the lock
+    std::vector<std::optional<std::vector<JsonLineRecord>>> finished(options.ordered ? chunks.size() : 0);
+    size_t next_to_deliver = 0;
+    size_t in_flight = 0;
+    // the first exception from a task or the callback
+    std::exception_ptr failure;
+
+    ThreadPool pool(options.threads);
+    // bound the memory held by parsed but undelivered chunks
+    const size_t max_in_flight = pool.size() * 4;
+
+    auto deliver = [&](std::vector<JsonLineRecord>& records) {
+        for ( JsonLineRecord& record : records ) {
+            if ( failure ) {
+                return;
+            }
+            result.records++;
+            if ( record.item.type == JsonItemType::ERROR ) {
+                result.invalid_records++;
+            }
+            try {
+                callback(record);
+            } catch ( ... ) {
+                failure = std::current_exception();
+            }
+        }
+    };
+
+    for ( size_t index = 0; index < chunks.size(); index++ ) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunk_done.wait(lock, [&] { return in_flight < max_in_flight || failure; });
+            if ( failure ) {
+                break;
+            }
+            in_flight++;
+        }
+        const std::string_view chunk = chunks[index];
+        const size_t chunk_offset = static_cast<size_t>(chunk.data() - data.data());
+        pool.submit([&, index, chunk, chunk_offset] {
+            // every worker keeps its own parser for all the chunks it gets
+            static thread_local JsonParser parser = json_parser_create();
+            parser.options = options.parse_options;
+            std::vector<JsonLineRecord> records;
+            std::exception_ptr parse_failure;
+            try {
+                json_lines_parse_chunk(chunk, chunk_offset, parser, records);
+            } catch ( ... ) {
+                // bad_alloc, say; the chunk still has to be counted off
+                parse_failure = std::current_exception();
+                records.clear();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if ( parse_failure && !failure ) {
+                failure = parse_failure;
+            }
+            if ( !options.ordered ) {
+                deliver(records);
+                in_flight--;
+            } else {
+                finished[index] = std::move(records);
+                // hand over every chunk that is now next in line
+                while ( next_to_deliver < finished.size() && finished[next_to_deliver] ) {
+                    deliver(*finished[next_to_deliver]);
+                    finished[next_to_deliver].reset();
+                    next_to_deliver++;
+                    in_flight--;
+                }
+            }
+            chunk_done.notify_all();
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    chunk_done.wait(lock, [&] { return in_flight == 0; });
+    if ( failure ) {
+        std::rethrow_exception(failure);
+    }
+    return result;
+}
+
+ENTRYPOINT inline
+JsonLinesResult json_lines_process_file(std::string const & path, JsonLinesOptions const & options,
+                                        JsonLinesCallback const & callback)
+{
+    const MappedFile file(path, MappedFileAccess::SEQUENTIAL);
+    if ( !file.is_valid() ) {
+        JsonLinesResult result = JsonLinesResult {};
+        result.error = true;
+        result.error_message = file.error();
+        return result;
+    }
+    return json_lines_process(file.view(), options, callback);
+}
+
+#ifdef TEST_JSON_LINES
+#include <fstream>
+#include <stdexcept>
+
+// With no file, checks itself against a fixture it writes.
+static int json_lines_self_test()
+{
+    const std::string path = "json_lines_test.jsonl";
+    size_t expected = 0;
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for ( int ii = 0; ii < 5000; ii++ ) {
+            out << "{\"id\": " << ii << ", \"name\": \"record " << ii << "\"}\n";
+            expected++;
+            if ( ii % 1000 == 0 ) {
+                out << "\n{not json}\n";
+                expected++;
+            }
+        }
+    }
+    JsonLinesOptions options = json_lines_default_options();
+    options.chunk_size = 4096;
+    int failures = 0;
+    for ( bool ordered : {true, false} ) {
+        options.ordered = ordered;
+        size_t last_offset = 0;
+        bool in_order = true;
+        const JsonLinesResult result = json_lines_process_file(path, options, [&](JsonLineRecord& record) {
+            in_order = in_order && record.offset >= last_offset;
+            last_offset = record.offset;
+        });
+        std::cout << (ordered ? "ordered: " : "unordered: ") << result.records << " records, "
+                  << result.invalid_records << " invalid\n";
+        failures += result.error || result.records != expected || result.invalid_records != 5;
+        failures += ordered && !in_order;
+    }
+
+    // a throwing callback comes back out of json_lines_process
+    size_t seen = 0;
+    try {
+        json_lines_process_file(path, options, [&](JsonLineRecord&) {
+            if ( ++seen == 100 ) {
+                throw std::runtime_error("callback failed");
+            }
+        });
+        failures++;
+    } catch ( std::runtime_error const& e ) {
+        std::cout << "rethrown: " << e.what() << " after " << seen << " records\n";
+        failures += seen != 100;
+    }
+    std::remove(path.c_str());
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char** argv)
+{
+    if ( argc < 2 ) {
+        return json_lines_self_test();
+    }
+    JsonLinesOptions options = json_lines_default_options();
+    options.ordered = argc < 3;
+    const JsonLinesResult result = json_lines_process_file(argv[1], options, [](JsonLineRecord& record) {
+        std::cout << record.offset << ": " << json_to_string(record.item).substr(0, 80) << '\n';
+    });
+    if ( result.error ) {
+        std::cerr << result.error_message << '\n';
+        return EXIT_FAILURE;
+    }
+    std::cout << result.records << " records, " << result.invalid_records << " invalid\n";
+}
+#endif
+
+#endif /* OAUTH2_JSON_LINES_H */
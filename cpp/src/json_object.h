@@ -0,0 +1,425 @@
+#ifndef OAUTH2_JSON_OBJECT_H
+#define OAUTH2_JSON_OBJECT_H
+
+// ----------------------------------------------------------
+// JSON object storage
+// Members are kept in one flat array in document order and
+// every key carries its hash, computed once when the member is
+// stored.  A lookup compares hashes and only compares strings
+// when they match.  Objects with more than
+// JSON_OBJECT_INDEX_THRESHOLD members also get a small open
+// addressing index so lookups in large documents, such as
+// discovery metadata, do not scan.  The keys come from whoever
+// sent the document, so the hash is seeded once per process:
+// keys chosen to collide cannot be worked out in advance.
+//
+// Keys that appear in nearly every OAuth2/OpenID Connect
+// document are interned: all documents point at a single
+// process-wide copy rather than holding their own.  More keys
+// can be added with json_intern_key.
+// ----------------------------------------------------------
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "json_string.h"
+#include "macros.h"
+
+constexpr size_t JSON_INTERN_CAPACITY = 512;
+constexpr size_t JSON_OBJECT_INDEX_THRESHOLD = 16;
+
+struct JsonInternTable
+{
+    std::array<std::string, JSON_INTERN_CAPACITY> keys;
+    std::array<std::uint32_t, JSON_INTERN_CAPACITY> hashes;
+    // open addressing on the hash, entry number + 1, zero is empty.
+    // Slots are published with release so lookups need no lock.
+    std::array<std::atomic<std::uint16_t>, JSON_INTERN_CAPACITY * 2> slots;
+    // guarded by mutex, only writers touch it
+    size_t count;
+    std::mutex mutex;
+};
+
+// Keys seen in token responses, JWTs, JWKS and discovery documents.
+constexpr std::string_view json_known_keys[] = {
+    "access_token", "token_type", "expires_in", "refresh_token", "refresh_token_expires_in", "id_token",
+    "scope", "state", "code", "error", "error_description", "error_uri",
+    "keys", "kid", "kty", "alg", "use", "key_ops", "n", "e", "x", "y", "crv", "x5c", "x5t", "typ",
+    "iss", "sub", "aud", "exp", "iat", "nbf", "jti", "azp", "nonce", "auth_time", "at_hash", "c_hash",
+    "email", "email_verified", "name", "given_name", "family_name", "picture", "locale", "hd",
+    "client_id", "active", "username",
+    "issuer", "authorization_endpoint", "token_endpoint", "userinfo_endpoint", "jwks_uri",
+    "revocation_endpoint", "introspection_endpoint", "device_authorization_endpoint",
+    "end_session_endpoint", "registration_endpoint", "scopes_supported", "response_types_supported",
+    "response_modes_supported", "grant_types_supported", "subject_types_supported",
+    "id_token_signing_alg_values_supported", "token_endpoint_auth_methods_supported",
+    "claims_supported", "code_challenge_methods_supported",
+    "projects", "projectId", "projectNumber", "lifecycleState", "createTime", "parent", "labels",
+    "nextPageToken",
+};
+
+// Not INTERNAL, every translation unit has to hash alike.
+inline
+std::uint32_t json_runtime_seed()
+{
+    static const std::uint32_t seed = [] {
+        std::random_device device;
+        return static_cast<std::uint32_t>(device());
+    }();
+    return seed;
+}
+
+// The hash of object keys, interned keys and json_path steps.
+// json_bind's tables are built at compile time with seeds of
+// their own and do not use it.
+inline
+std::uint32_t json_runtime_key_hash(std::string_view key)
+{
+    return json_key_hash(key, json_runtime_seed());
+}
+
+inline
+const std::string* json_intern_lookup(JsonInternTable const & table, std::string_view key, std::uint32_t hash)
+{
+    constexpr size_t mask = JSON_INTERN_CAPACITY * 2 - 1;
+    for ( size_t slot = hash & mask; ; slot = (slot + 1) & mask ) {
+        const std::uint16_t entry = table.slots[slot].load(std::memory_order_acquire);
+        if ( entry == 0 ) {
+            return nullptr;
+        }
+        if ( table.hashes[entry - 1] == hash && table.keys[entry - 1] == key ) {
+            return &table.keys[entry - 1];
+        }
+    }
+}
+
+// Caller holds table.mutex.  The table is never more than half
+// full so a free slot always exists.
+inline
+bool json_intern_add(JsonInternTable& table, std::string_view key, std::uint32_t hash)
+{
+    if ( json_intern_lookup(table, key, hash) != nullptr ) {
+        return true;
+    }
+    if ( table.count == JSON_INTERN_CAPACITY ) {
+        return false;
+    }
+    const size_t entry = table.count++;
+    table.keys[entry] = key;
+    table.hashes[entry] = hash;
+    constexpr size_t mask = JSON_INTERN_CAPACITY * 2 - 1;
+    size_t slot = hash & mask;
+    while ( table.slots[slot].load(std::memory_order_relaxed) != 0 ) {
+        slot = (slot + 1) & mask;
+    }
+    table.slots[slot].store(static_cast<std::uint16_t>(entry + 1), std::memory_order_release);
+    return true;
+}
+
+// Not INTERNAL, every translation unit has to share one table.
+// It is never freed so keys stay valid during static destruction.
+inline
+JsonInternTable& json_intern_table()
+{
+    static JsonInternTable* table = [] {
+        auto* created = new JsonInternTable();
+        std::lock_guard<std::mutex> lock(created->mutex);
+        for ( std::string_view key : json_known_keys ) {
+            json_intern_add(*created, key, json_runtime_key_hash(key));
+        }
+        return created;
+    }();
+    return *table;
+}
+
+// Make key shared by every document that contains it from now on.
+// Returns false when the table is full.
+ENTRYPOINT inline
+bool json_intern_key(std::string_view key)
+{
+    JsonInternTable& table = json_intern_table();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    return json_intern_add(table, key, json_runtime_key_hash(key));
+}
+
+// An object key with its hash, pointing at the interned copy
+// when there is one and owning the text otherwise.
+class JsonKey
+{
+public:
+    JsonKey() : interned_(nullptr), hash_(json_runtime_key_hash(std::string_view()))
+    {
+    }
+
+    explicit JsonKey(std::string_view text) : hash_(json_runtime_key_hash(text))
+    {
+        interned_ = json_intern_lookup(json_intern_table(), text, hash_);
+        if (interned_ == nullptr)
+        {
+            owned_.assign(text.data(), text.size());
+        }
+    }
+
+    explicit JsonKey(std::string &&text) : hash_(json_runtime_key_hash(text))
+    {
+        interned_ = json_intern_lookup(json_intern_table(), text, hash_);
+        if (interned_ == nullptr)
+        {
+            owned_ = std::move(text);
+        }
+    }
+
+    [[nodiscard]] std::string_view view() const
+    {
+        return interned_ != nullptr ? std::string_view(*interned_) : std::string_view(owned_);
+    }
+
+    [[nodiscard]] std::string str() const
+    {
+        return std::string(view());
+    }
+
+    [[nodiscard]] std::uint32_t hash() const
+    {
+        return hash_;
+    }
+
+    [[nodiscard]] bool is_interned() const
+    {
+        return interned_ != nullptr;
+    }
+
+    operator std::string_view() const
+    {
+        return view();
+    }
+
+private:
+    const std::string *interned_;
+    std::string owned_;
+    std::uint32_t hash_;
+};
+
+inline bool operator==(JsonKey const &key, std::string_view text)
+{
+    return key.view() == text;
+}
+
+inline bool operator!=(JsonKey const &key, std::string_view text)
+{
+    return key.view() != text;
+}
+
+inline std::ostream &operator<<(std::ostream &out, JsonKey const &key)
+{
+    return out << key.view();
+}
+
+// Flat key/value storage with the lookups of a std::map.  Unlike
+// std::map iteration follows insertion order, and inserting may
+// invalidate iterators.  When a key is inserted twice the first
+// value is kept, as std::map::insert does.
+template<typename V>
+class JsonObjectMap
+{
+public:
+    using key_type = JsonKey;
+    using mapped_type = V;
+    using value_type = std::pair<JsonKey, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    iterator begin()
+    {
+        return entries_.begin();
+    }
+
+    iterator end()
+    {
+        return entries_.end();
+    }
+
+    [[nodiscard]] const_iterator begin() const
+    {
+        return entries_.begin();
+    }
+
+    [[nodiscard]] const_iterator end() const
+    {
+        return entries_.end();
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return entries_.size();
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return entries_.empty();
+    }
+
+    void reserve(size_t count)
+    {
+        entries_.reserve(count);
+    }
+
+    void clear()
+    {
+        entries_.clear();
+        index_.clear();
+    }
+
+    iterator find(std::string_view key)
+    {
+        return entries_.begin() + find_(key, json_runtime_key_hash(key));
+    }
+
+    [[nodiscard]] const_iterator find(std::string_view key) const
+    {
+        return entries_.begin() + find_(key, json_runtime_key_hash(key));
+    }
+
+    // for callers that hash the key once and look it up often
+    [[nodiscard]] const_iterator find(std::string_view key, std::uint32_t hash) const
+    {
+        return entries_.begin() + find_(key, hash);
+    }
+
+    [[nodiscard]] size_t count(std::string_view key) const
+    {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    std::pair<iterator, bool> insert(value_type &&entry)
+    {
+        const size_t found = find_(entry.first.view(), entry.first.hash());
+        if (found != entries_.size())
+        {
+            return {entries_.begin() + found, false};
+        }
+        entries_.push_back(std::move(entry));
+        index_add_();
+        return {entries_.end() - 1, true};
+    }
+
+    std::pair<iterator, bool> emplace(JsonKey key, V value)
+    {
+        return insert(value_type(std::move(key), std::move(value)));
+    }
+
+    V &operator[](std::string_view key)
+    {
+        return emplace(JsonKey(key), V{}).first->second;
+    }
+
+    V &at(std::string_view key)
+    {
+        const iterator found = find(key);
+        if (found == end())
+        {
+            throw std::out_of_range("JSON object has no key '" + std::string(key) + "'");
+        }
+        return found->second;
+    }
+
+    [[nodiscard]] const V &at(std::string_view key) const
+    {
+        const const_iterator found = find(key);
+        if (found == end())
+        {
+            throw std::out_of_range("JSON object has no key '" + std::string(key) + "'");
+        }
+        return found->second;
+    }
+
+    iterator erase(const_iterator position)
+    {
+        const iterator next = entries_.erase(position);
+        // positions after the erased entry have moved
+        if (!index_.empty())
+        {
+            rebuild_index_(index_.size());
+        }
+        return next;
+    }
+
+private:
+    std::vector<value_type> entries_;
+    // entry number + 1 per slot, zero is empty, only used once
+    // there are more than JSON_OBJECT_INDEX_THRESHOLD entries
+    std::vector<std::uint32_t> index_;
+
+    [[nodiscard]] size_t find_(std::string_view key, std::uint32_t hash) const
+    {
+        if (index_.empty())
+        {
+            for (size_t ii = 0; ii < entries_.size(); ii++)
+            {
+                if (entries_[ii].first.hash() == hash && entries_[ii].first.view() == key)
+                {
+                    return ii;
+                }
+            }
+            return entries_.size();
+        }
+        const size_t mask = index_.size() - 1;
+        for (size_t slot = hash & mask; index_[slot] != 0; slot = (slot + 1) & mask)
+        {
+            const value_type &entry = entries_[index_[slot] - 1];
+            if (entry.first.hash() == hash && entry.first.view() == key)
+            {
+                return index_[slot] - 1;
+            }
+        }
+        return entries_.size();
+    }
+
+    void rebuild_index_(size_t slots)
+    {
+        index_.assign(slots, 0);
+        for (size_t ii = 0; ii < entries_.size(); ii++)
+        {
+            place_(ii);
+        }
+    }
+
+    void place_(size_t entry)
+    {
+        const size_t mask = index_.size() - 1;
+        size_t slot = entries_[entry].first.hash() & mask;
+        while (index_[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        index_[slot] = static_cast<std::uint32_t>(entry + 1);
+    }
+
+    // called after an entry was appended
+    void index_add_()
+    {
+        if (entries_.size() <= JSON_OBJECT_INDEX_THRESHOLD)
+        {
+            return;
+        }
+        // keep the index at most half full
+        if (entries_.size() * 2 > index_.size())
+        {
+            size_t slots = index_.empty() ? JSON_OBJECT_INDEX_THRESHOLD * 4 : index_.size() * 2;
+            rebuild_index_(slots);
+            return;
+        }
+        place_(entries_.size() - 1);
+    }
+};
+
+#endif /* OAUTH2_JSON_OBJECT_H */
@@ -8,23 +8,26 @@
 // I use a macro ENTRYPOINT that indicates that this is the main entry to use the API
 // ----------------------------------------------------------
 
-#include <map>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
-
-#ifdef TEST_JSON
-#include "char_tests.cpp"
-#endif
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+#include "char_utils.h"
+#include "json_object.h"
+#include "json_string.h"
+#include "json_writer.h"
 #include "macros.h"
 
 
 struct JsonItem;
 struct JsonParseContext;
 using JsonArray = std::vector<JsonItem>;            
-using JsonObject = std::map<std::string, JsonItem>; 
+using JsonObject = JsonObjectMap<JsonItem>;
 
 #undef ERROR
 
@@ -45,17 +48,52 @@ enum class JsonItemType {
 struct JsonItem {
     JsonItemType type;
     std::string text;
-    long integer;
+    std::int64_t integer;
     double real;
     JsonArray array;
     JsonObject object;
 };
 
 
+// Default limit on how deeply arrays and objects may nest,
+// documents from an identity provider never get near this.
+constexpr size_t JSON_DEFAULT_MAX_DEPTH = 128;
+
+struct JsonParseOptions
+{
+    // deepest nesting of arrays and objects we accept
+    size_t max_depth;
+    // refuse inputs longer than this, zero for no limit
+    size_t max_length;
+};
+
+INTERNAL inline
+JsonParseOptions json_default_parse_options() {
+    JsonParseOptions options = JsonParseOptions {};
+    options.max_depth = JSON_DEFAULT_MAX_DEPTH;
+    options.max_length = 0;
+    return options;
+}
+
+// One entry per array or object we are currently inside of,
+// this replaces the C++ call stack of a recursive parser.
+struct JsonParseFrame
+{
+    JsonItem item;
+    // the key waiting for its value when item is an object
+    JsonKey key;
+};
+
 struct JsonParseContext 
 {
-    std::string buffer;
+    // the document being parsed, not owned: the caller's string
+    // or a memory mapped file must outlive the parse
+    std::string_view buffer;
     size_t pos;
+    JsonParseOptions options;
+    std::vector<JsonParseFrame> stack;
+    // deepest nesting seen, for statistics
+    size_t deepest;
     size_t selection_start_pos;
     size_t selection_end_pos;
     bool error;
@@ -64,10 +102,6 @@ struct JsonParseContext
     std::string error_message;
 };
 
-// forward declare functions due to C/C++ ordering requirements
-INTERNAL JsonItem json_create_from_string_buffer(JsonParseContext& context);
-JsonItem json_create_from_string(std::string const & buffer);
-
 INTERNAL
 JsonItem json_create_new() {
     JsonItem item = JsonItem {};
@@ -77,36 +111,84 @@ JsonItem json_create_new() {
 
 INTERNAL
 std::string json_get_selected_text(JsonParseContext& context) {
-    return context.buffer.substr(context.selection_start_pos, context.selection_end_pos - context.selection_start_pos+1);
+    return std::string(context.buffer.substr(context.selection_start_pos, context.selection_end_pos - context.selection_start_pos+1));
 }
 
+// Finds the end of the string whose opening quote is at pos and
+// selects the raw text between the quotes.  Leaves pos after the
+// closing quote.
 INTERNAL
-void json_parse_text_value(JsonParseContext& context, JsonItem& item) 
+bool json_scan_text(JsonParseContext& context, bool& has_escapes)
 {
-    // assume index it currently pointing to the first quote indicating a string
     context.selection_start_pos = context.pos + 1;
-    size_t index = context.pos+1;
-    char open_quote = context.buffer[context.pos];
-    while( true ) {
-        index++;
-        if ( index >= context.buffer.size() ) {
+    const char open_quote = context.buffer[context.pos];
+    const char* first = context.buffer.data() + context.selection_start_pos;
+    const char* last = context.buffer.data() + context.buffer.size();
+    const char* p = first;
+    has_escapes = false;
+    while ( true ) {
+        p = json_find_string_special(p, last, open_quote);
+        if ( p >= last ) {
             context.error = true;
             context.error_pos_start = context.selection_start_pos;
-            context.error_pos_end = index-1;
+            context.error_pos_end = context.buffer.size() - 1;
             context.error_message = "String without final quotes was detected.";
-            return;
+            return false;
         }
-        if ( context.buffer[index] == '\\') {
-            // escape character
-            index++;
-        } else if ( context.buffer[index] == open_quote) {
+        if ( *p == open_quote ) {
             break;
         }
+        if ( *p == '\\' ) {
+            // escape character, skip whatever it escapes
+            has_escapes = true;
+            p++;
+        }
+        // control characters are tolerated here
+        p++;
     }
+    const size_t index = p - context.buffer.data();
     context.selection_end_pos = index - 1;
-    context.pos = index+1; // move on passed the last quote
+    context.pos = index + 1; // move on passed the last quote
+    return true;
+}
+
+INTERNAL inline
+std::string_view json_selected_view(JsonParseContext const & context) {
+    return context.buffer.substr(context.selection_start_pos, context.selection_end_pos + 1 - context.selection_start_pos);
+}
+
+// Decodes the escapes of the selected string into out.
+INTERNAL
+bool json_decode_selected_text(JsonParseContext& context, std::string& out)
+{
+    const std::string_view raw = json_selected_view(context);
+    out.resize(raw.size());
+    const JsonDecodeResult decoded = json_decode_string(raw.data(), raw.data() + raw.size(), out.data(), false);
+    if ( decoded.error_message != nullptr ) {
+        context.error = true;
+        context.error_pos_start = decoded.error_at - context.buffer.data();
+        context.error_pos_end = context.error_pos_start;
+        context.error_message = decoded.error_message;
+        return false;
+    }
+    out.resize(decoded.end - out.data());
+    return true;
+}
+
+INTERNAL
+void json_parse_text_value(JsonParseContext& context, JsonItem& item) 
+{
+    // assume index it currently pointing to the first quote indicating a string
+    bool has_escapes = false;
+    if ( !json_scan_text(context, has_escapes) ) {
+        return;
+    }
     item.type = JsonItemType::TEXT;
-    item.text = json_get_selected_text(context);
+    if ( !has_escapes ) {
+        item.text.assign(json_selected_view(context));
+        return;
+    }
+    json_decode_selected_text(context, item.text);
 }
 
 
@@ -135,27 +217,134 @@ void json_parse_key(JsonParseContext& context, JsonItem& item)
 }
 
 
+// Result of scanning a number, shared by the DOM parser and
+// the pull reader so both accept exactly the same grammar.
+struct JsonNumber
+{
+    JsonItemType type;
+    std::int64_t integer;
+    double real;
+    // on failure points at the offending character
+    const char* end;
+    const char* error_message;
+};
+
+// Parses the RFC 8259 number grammar in place:
+//   number = [ minus ] int [ frac ] [ exp ]
+//   int    = zero / ( digit1-9 *DIGIT )
+//   frac   = decimal-point 1*DIGIT
+//   exp    = e [ minus / plus ] 1*DIGIT
+// Integers that fit in 64 bits are kept exact, everything
+// else is converted with std::from_chars straight from the
+// buffer so that we never allocate a temporary string.
+INTERNAL inline
+JsonNumber json_scan_number(const char* first, const char* last)
+{
+    JsonNumber number = JsonNumber {};
+    number.type = JsonItemType::ERROR;
+    const char* p = first;
+
+    const bool negative = p < last && *p == '-';
+    if ( negative ) {
+        p++;
+    }
+    if ( p >= last || !is_digit(*p) ) {
+        number.end = p;
+        number.error_message = "Number must contain at least one digit.";
+        return number;
+    }
+    const char* digits_start = p;
+    if ( *p == '0' ) {
+        p++;
+    } else {
+        while ( p < last && is_digit(*p) ) {
+            p++;
+        }
+    }
+    const char* digits_end = p;
+
+    bool is_integer = true;
+    if ( p < last && is_decimal_point(*p) ) {
+        is_integer = false;
+        p++;
+        if ( p >= last || !is_digit(*p) ) {
+            number.end = p;
+            number.error_message = "Expected digit after decimal point.";
+            return number;
+        }
+        while ( p < last && is_digit(*p) ) {
+            p++;
+        }
+    }
+    if ( p < last && is_exponent(*p) ) {
+        is_integer = false;
+        p++;
+        if ( p < last && is_sign(*p) ) {
+            p++;
+        }
+        if ( p >= last || !is_digit(*p) ) {
+            number.end = p;
+            number.error_message = "Expected digit in exponent.";
+            return number;
+        }
+        while ( p < last && is_digit(*p) ) {
+            p++;
+        }
+    }
+    number.end = p;
+
+    if ( is_integer ) {
+        // fast path: 18 decimal digits always fit in an int64_t so
+        // we can accumulate without any overflow checks.
+        if ( digits_end - digits_start <= 18 ) {
+            std::int64_t value = 0;
+            for ( const char* digit = digits_start; digit < digits_end; digit++ ) {
+                value = value * 10 + (*digit - '0');
+            }
+            number.type = JsonItemType::INTEGER;
+            number.integer = negative ? -value : value;
+            return number;
+        }
+        std::int64_t value = 0;
+        auto [ptr, ec] = std::from_chars(first, p, value);
+        if ( ec == std::errc() && ptr == p ) {
+            number.type = JsonItemType::INTEGER;
+            number.integer = value;
+            return number;
+        }
+        // too large for an int64_t, keep it as a double instead
+    }
+    double real = 0.0;
+    auto [ptr, ec] = std::from_chars(first, p, real);
+    if ( ec != std::errc() || ptr != p ) {
+        number.end = p - 1;
+        number.error_message = "Number is out of range.";
+        return number;
+    }
+    number.type = JsonItemType::FLOAT;
+    number.real = real;
+    return number;
+}
+
 INTERNAL
 void json_parse_number_value(JsonParseContext& context, JsonItem& item) 
 {
-    size_t index = context.pos;
     context.selection_start_pos = context.pos;
-    for( ;index < context.buffer.size() || is_digit(context.buffer[index]); ++index) {}
-    if ( index < context.buffer.size() && is_decimal_point(context.buffer[index]) ) {
-        // float
-        for(;index < context.buffer.size() || is_digit(context.buffer[index]) ; ++index) {}
-        context.selection_end_pos = index-1;
-        context.pos = index;
-        item.type = JsonItemType::FLOAT;
-        std::string val = json_get_selected_text(context);
-        item.real = std::stof(val);
-    } else {
-        context.selection_end_pos = index-1;
-        context.pos = index;
-        item.type = JsonItemType::INTEGER;
-        std::string val = json_get_selected_text(context);
-        item.integer = std::stol(val);
+    const char* first = context.buffer.data() + context.pos;
+    const JsonNumber number = json_scan_number(first, context.buffer.data() + context.buffer.size());
+    const size_t index = context.pos + (number.end - first);
+    if ( number.type == JsonItemType::ERROR ) {
+        context.error = true;
+        context.error_pos_start = context.selection_start_pos;
+        context.error_pos_end = index;
+        context.error_message = number.error_message;
+        return;
     }
+    context.selection_end_pos = index - 1;
+    context.pos = index;
+    item.type = number.type;
+    item.integer = number.integer;
+    item.real = number.real;
 }
 
 
@@ -172,178 +361,220 @@ void json_eat_whitespace(JsonParseContext& context) {
 }
 
 INTERNAL inline
-void json_eat_commas(JsonParseContext& context) {
-    while ( is_comma(context.buffer[context.pos]) ) {
-        json_increment_context(context);
-    }
+void json_set_error(JsonParseContext& context, const char* message) {
+    context.error = true;
+    context.error_pos_start = context.pos;
+    context.error_pos_end = context.pos;
+    context.error_message = message;
 }
 
 INTERNAL inline
-void json_eat_colons(JsonParseContext& context) {
-    while ( is_colon(context.buffer[context.pos]) ) {
-        json_increment_context(context);
-    }
+bool json_match_literal(JsonParseContext& context, const char* literal, size_t length) {
+    return context.buffer.compare(context.pos, length, literal) == 0;
 }
 
-void json_parse_object_value(JsonParseContext& context, JsonItem& objectItem ) {
-    // comma separated list of items
-    json_eat_whitespace(context);
-    objectItem.type = JsonItemType::OBJECT;
+// Reads a single non-container value.  Besides plain JSON we
+// accept single quoted strings and bare words, e.g. { key: value }
+INTERNAL
+void json_parse_scalar_value(JsonParseContext& context, JsonItem& item) {
+    const char ch = context.buffer[context.pos];
     context.selection_start_pos = context.pos;
-    context.pos++;
-    while(true) {
-        JsonItem new_key = json_create_from_string_buffer(context);
-        if ( new_key.type != JsonItemType::TEXT && new_key.type != JsonItemType::INTEGER ) {
-            context.error_message = "Key must be a string.";
-            return;
-        }
-        if ( new_key.type == JsonItemType::INTEGER ) {
-            new_key.text = std::to_string(new_key.integer);
+    if ( json_match_literal(context, "null", 4) ) {
+        item.type = JsonItemType::NULL_VALUE;
+        context.pos += 4;
+    } else if ( json_match_literal(context, "true", 4) ) {
+        item.type = JsonItemType::TRUE_VALUE;
+        context.pos += 4;
+    } else if ( json_match_literal(context, "false", 5) ) {
+        item.type = JsonItemType::FALSE_VALUE;
+        context.pos += 5;
+    } else if ( is_quote(ch) ) {
+        json_parse_text_value(context, item);
+    } else if ( is_alpha(ch) ) {
+        json_parse_key(context, item);
+    } else if ( is_digit(ch) || ch == '-' ) {
+        json_parse_number_value(context, item);
+    } else {
+        json_set_error(context, "invalid character found");
+    }
+}
+
+// Reads an object key followed by its ':' into the frame.
+// Plain quoted keys go straight from the buffer to a JsonKey so
+// interned keys are never copied.
+INTERNAL
+bool json_parse_object_key(JsonParseContext& context, JsonParseFrame& frame) {
+    if ( is_quote(context.buffer[context.pos]) ) {
+        bool has_escapes = false;
+        if ( !json_scan_text(context, has_escapes) ) {
+            return false;
         }
-        json_eat_whitespace(context);
-        if ( is_colon(context.buffer[context.pos]) ) {
-            json_eat_colons(context);
+        if ( !has_escapes ) {
+            frame.key = JsonKey(json_selected_view(context));
+        } else {
+            std::string text;
+            if ( !json_decode_selected_text(context, text) ) {
+                return false;
+            }
+            frame.key = JsonKey(std::move(text));
         }
-        json_eat_whitespace(context);
-        JsonItem new_value = json_create_from_string_buffer(context);
-        if ( new_value.type == JsonItemType::END_OF_JSON_VALUES ) {
-            context.error = true;
-            context.error_pos_start = context.selection_start_pos;
-            context.error_pos_end = context.pos;
-            context.error_message = "No value found for object key-value pair.";
-            return;
+    } else {
+        JsonItem key = json_create_new();
+        json_parse_scalar_value(context, key);
+        if ( context.error ) {
+            return false;
         }
-        objectItem.object.insert(std::make_pair(new_key.text, new_value));
-        json_eat_whitespace(context);
-        if ( is_comma(context.buffer[context.pos]) ) {
-            json_eat_commas(context);
+        if ( key.type == JsonItemType::INTEGER ) {
+            frame.key = JsonKey(std::to_string(key.integer));
+        } else if ( key.type == JsonItemType::TEXT ) {
+            frame.key = JsonKey(std::move(key.text));
         } else {
-            if ( context.buffer[context.pos] == '}' ) {
-                return;
-            } else {
-                context.error_message = "Expected '}' for end of object";
-                return;
-            }
+            json_set_error(context, "Key must be a string.");
+            return false;
         }
-        json_eat_whitespace(context);
     }
+    json_eat_whitespace(context);
+    if ( context.pos >= context.buffer.size() || !is_colon(context.buffer[context.pos]) ) {
+        json_set_error(context, "No value found for object key-value pair.");
+        return false;
+    }
+    json_increment_context(context);
+    return true;
 }
 
+// Non-recursive parser.  Open containers live on context.stack
+// which is reserved up front to options.max_depth entries, so a
+// hostile document can neither overflow the C++ stack nor make
+// the parse state grow beyond that bound.
 INTERNAL
-void json_parse_array_value(JsonParseContext& context, JsonItem& arrayItem ) {
-    // comma separated list of items
+JsonItem json_create_from_string_buffer(JsonParseContext& context) {
+    context.stack.clear();
+    context.stack.reserve(context.options.max_depth);
     json_eat_whitespace(context);
-    arrayItem.type = JsonItemType::ARRAY;
-    while(true) {
-        context.pos++;
-        JsonItem new_item = json_create_from_string_buffer(context);
-        if ( new_item.type == JsonItemType::END_OF_JSON_VALUES ) {
-            return;
-        }
-        arrayItem.array.push_back(new_item);
+    if ( context.pos >= context.buffer.size() ) {
+        return json_create_new();
     }
-}
 
-/*
-INTERNAL
-void parse_json_text(JsonItem& textItem, std::string const & buffer, size_t& index )
-{
-    auto start = index;
-    while( index < buffer.size() ) {
-        index++;
-        if ( buffer[index] == '\\') {
-            // escape character so we will ignore the next
-            // character
+    JsonItem value = json_create_new();
+    while ( true ) {
+        // a value is expected here
+        json_eat_whitespace(context);
+        if ( context.pos >= context.buffer.size() ) {
+            json_set_error(context, "Unexpected end of input.");
+            return value;
+        }
+        const char ch = context.buffer[context.pos];
+        if ( ch == '{' || ch == '[' ) {
+            if ( context.stack.size() >= context.options.max_depth ) {
+                json_set_error(context, "Maximum nesting depth exceeded.");
+                return value;
+            }
+            context.stack.emplace_back();
+            context.deepest = std::max(context.deepest, context.stack.size());
+            JsonParseFrame& frame = context.stack.back();
+            frame.item.type = ch == '{' ? JsonItemType::OBJECT : JsonItemType::ARRAY;
+            json_increment_context(context);
+            json_eat_whitespace(context);
+            const char close = ch == '{' ? '}' : ']';
+            if ( context.pos < context.buffer.size() && context.buffer[context.pos] == close ) {
+                json_increment_context(context);
+                value = std::move(frame.item);
+                context.stack.pop_back();
+            } else {
+                if ( ch == '{' && !json_parse_object_key(context, frame) ) {
+                    return value;
+                }
+                continue;
+            }
         } else {
-            if ( buffer[index] == buffer[start] ) {
-                break;
+            value = json_create_new();
+            json_parse_scalar_value(context, value);
+            if ( context.error ) {
+                return value;
             }
         }
-    }
-    textItem.text = buffer.substr(start, index - start);
-}
-*/
 
-INTERNAL
-JsonItem json_create_from_string_buffer(JsonParseContext& context) {
-    std::stringstream in = std::stringstream {};
-    JsonItem item = json_create_new();
-    json_eat_whitespace(context);
-    context.selection_start_pos = context.pos;
-    while( context.pos < context.buffer.size() ) {
-        if ( context.buffer[context.pos] == '{' ) {
-            json_parse_object_value(context, item);
-            return item;
-        } else if ( context.buffer[context.pos] == '[' ) {
-            json_parse_array_value(context, item);
-            return item;
-        } else if ( context.buffer[context.pos] == '}' ||
-                    context.buffer[context.pos] == ']' ||
-                    context.buffer[context.pos] == ',' ) {
-            return item;
-        } else if ( context.pos < context.buffer.size() - 3 && 
-                    context.buffer[context.pos] == 'n' && 
-                    context.buffer[context.pos+1] == 'u' && 
-                    context.buffer[context.pos+2] == 'l' && 
-                    context.buffer[context.pos+3] == 'l') {
-            item.type = JsonItemType::NULL_VALUE;
-            context.pos += 4;
-            return item;} else if ( context.pos < context.buffer.size() - 3 && 
-                    context.buffer[context.pos] == 't' && 
-                    context.buffer[context.pos+1] == 'r' && 
-                    context.buffer[context.pos+2] == 'u' && 
-                    context.buffer[context.pos+3] == 'e') {
-            item.type = JsonItemType::TRUE_VALUE;
-            context.pos += 4;
-            return item;
-         } else if ( context.pos < context.buffer.size() - 4 && 
-                    context.buffer[context.pos] == 'f' && 
-                    context.buffer[context.pos+1] == 'a' && 
-                    context.buffer[context.pos+2] == 'l' && 
-                    context.buffer[context.pos+3] == 's' && 
-                    context.buffer[context.pos+4] == 'e') {
-            item.type = JsonItemType::FALSE_VALUE;
-            context.pos += 5;
-            return item;
-        } else if ( is_quote(context.buffer[context.pos]) ) {
-            json_parse_text_value(context, item);
-            return item;
-        } else if ( is_alpha(context.buffer[context.pos]) ) {
-            // are we in an object? 
-            // if not then error
-            json_parse_key(context, item);
-            return item;
-        } else if ( is_digit(context.buffer[context.pos]) ) {
-            json_parse_number_value(context, item);
-            if ( item.type == JsonItemType::INTEGER || item.type == JsonItemType::FLOAT ) {
-                return item;
+        // we have a complete value, hand it to the enclosing
+        // containers until one of them wants another value
+        while ( true ) {
+            if ( context.stack.empty() ) {
+                // only whitespace may follow the document
+                json_eat_whitespace(context);
+                if ( context.pos < context.buffer.size() ) {
+                    json_set_error(context, "Unexpected characters after the end of the document.");
+                    return json_create_new();
+                }
+                return value;
             }
-        } else if ( is_whitespace(context.buffer[context.pos]) ) {
-            // eat whitespace 
-        } else {
-            context.error = true;
-            context.error_pos_start = context.pos;
-            context.error_pos_end = context.pos;
-            context.error_message = "invalid character found";
-            return item;
+            JsonParseFrame& frame = context.stack.back();
+            const bool is_object = frame.item.type == JsonItemType::OBJECT;
+            if ( is_object ) {
+                frame.item.object.emplace(std::move(frame.key), std::move(value));
+            } else {
+                frame.item.array.push_back(std::move(value));
+            }
+            json_eat_whitespace(context);
+            if ( context.pos >= context.buffer.size() ) {
+                json_set_error(context, is_object ? "Expected '}' for end of object" : "Expected ']' for end of array");
+                return json_create_new();
+            }
+            const char next = context.buffer[context.pos];
+            if ( is_comma(next) ) {
+                json_increment_context(context);
+                json_eat_whitespace(context);
+                // a trailing comma before the close is tolerated
+                if ( context.pos < context.buffer.size() &&
+                     context.buffer[context.pos] == (is_object ? '}' : ']') ) {
+                    json_increment_context(context);
+                    value = std::move(frame.item);
+                    context.stack.pop_back();
+                    continue;
+                }
+                if ( is_object && !json_parse_object_key(context, frame) ) {
+                    return json_create_new();
+                }
+                break;
+            }
+            if ( next == (is_object ? '}' : ']') ) {
+                json_increment_context(context);
+                value = std::move(frame.item);
+                context.stack.pop_back();
+                continue;
+            }
+            json_set_error(context, is_object ? "Expected '}' for end of object" : "Expected ']' for end of array");
+            return json_create_new();
         }
-        context.pos++;
     }
-    return item;
 }
 
-// entry point
-ENTRYPOINT
-JsonItem json_create_from_string(std::string const & buffer) {
-    JsonParseContext context = JsonParseContext {};
-    context.buffer = buffer;
+// Prepare a context for the next document.  The stack keeps its
+// capacity so a context that is used again (see JsonParser) does
+// not allocate for it once warm.
+INTERNAL inline
+void json_context_reset(JsonParseContext& context, JsonParseOptions const & options) {
+    context.pos = 0;
+    context.options = options;
+    context.stack.clear();
+    context.deepest = 0;
     context.error_pos_start = 0;
     context.error_pos_end = 0;
     context.selection_start_pos = 0;
     context.selection_end_pos = 0;
     context.error = false;
-    JsonItem item = json_create_from_string_buffer(context);
+    context.error_message.clear();
+}
+
+INTERNAL inline
+JsonItem json_parse_with_context(JsonParseContext& context, std::string_view buffer) {
+    JsonItem item;
+    if ( context.options.max_length != 0 && buffer.size() > context.options.max_length ) {
+        json_set_error(context, "Document is larger than the maximum allowed length.");
+    } else {
+        context.buffer = buffer;
+        item = json_create_from_string_buffer(context);
+    }
     if ( context.error ) {
+        item = json_create_new();
         item.type = JsonItemType::ERROR;
         item.text = static_cast<const std::ostringstream&>(
                 std::ostringstream() << "Error at " << context.error_pos_start << ","
@@ -352,197 +583,304 @@ JsonItem json_create_from_string(std::string const & buffer) {
     return item;
 }
 
-INTERNAL
-std::string json_json_pretty_print_item(JsonItem const & json, const size_t indent) {
+// entry point
+ENTRYPOINT inline
+JsonItem json_create_from_string(std::string const & buffer, JsonParseOptions const & options) {
+    JsonParseContext context = JsonParseContext {};
+    json_context_reset(context, options);
+    return json_parse_with_context(context, buffer);
+}
+
+ENTRYPOINT inline
+JsonItem json_create_from_string(std::string const & buffer) {
+    return json_create_from_string(buffer, json_default_parse_options());
+}
+
+INTERNAL inline
+void json_write_item(JsonWriter& writer, JsonItem const & json) {
     switch( json.type ) {
-        case JsonItemType::EMPTY:
-            return {};
         case JsonItemType::NULL_VALUE:
-            return "null";
+            json_writer_null(writer);
+            break;
         case JsonItemType::TRUE_VALUE:
-            return "true";
+            json_writer_boolean(writer, true);
+            break;
         case JsonItemType::FALSE_VALUE:
-            return "false";
+            json_writer_boolean(writer, false);
+            break;
         case JsonItemType::TEXT:
-            return static_cast<const std::ostringstream &>(
-                    std::ostringstream() << '"' << json.text << '"').str();
+            json_writer_string(writer, json.text);
+            break;
         case JsonItemType::INTEGER:
-            return std::to_string(json.integer);
+            json_writer_integer(writer, json.integer);
+            break;
         case JsonItemType::FLOAT:
-            return std::to_string(json.real);
-        case JsonItemType::ARRAY: {
-            std::ostringstream in;
-            in << "[";
-            if (json.array.empty()) {
-                in << "]";
-                return in.str();
-            }
-            const std::string indentation = std::string((indent + 1) * 2, ' ');
-            in << '\n';
-            size_t counter = 0;
-            for_each(begin(json.array), end(json.array), [&](JsonItem const &item) {
-                in << indentation << json_json_pretty_print_item(item, indent + 1);
-                if (counter < json.array.size() - 1) {
-                    in << ",\n";
-                } else {
-                    in << '\n';
-                }
-                counter++;
-            });
-            const std::string last_indentation = std::string(indent * 2, ' ');
-            in << last_indentation << "]";
-            return in.str();
-        }
-        case JsonItemType::OBJECT: {
-            std::ostringstream in;
-            in << "{";
-            if (json.object.empty()) {
-                in << "}";
-                return in.str();
+            json_writer_real(writer, json.real);
+            break;
+        case JsonItemType::ARRAY:
+            json_writer_begin_array(writer);
+            for ( JsonItem const & item : json.array ) {
+                json_write_item(writer, item);
             }
-            const std::string indentation = std::string((indent + 1) * 2, ' ');
-            in << '\n' << indentation;
-            {
-                size_t counter = 0;
-                for (auto const &[key, val] : json.object) {
-                    in << key << " : " << json_json_pretty_print_item(val, indent + 1);
-                    if (counter < json.object.size() - 1) {
-                        in << ",\n" << indentation;
-                    } else {
-                        in << "\n";
-                    }
-                    counter++;
-                }
+            json_writer_end_array(writer);
+            break;
+        case JsonItemType::OBJECT:
+            json_writer_begin_object(writer);
+            for ( auto const &[key, val] : json.object ) {
+                json_writer_key(writer, key);
+                json_write_item(writer, val);
             }
-            const std::string last_indentation = std::string(indent * 2, ' ');
-            in << last_indentation << "}";
-            return in.str();
-        }
+            json_writer_end_object(writer);
+            break;
+        default:
+            // EMPTY, ERROR and END_OF_JSON_VALUES have no JSON form
+            json_writer_null(writer);
+            break;
+    }
+}
+
+// Serialise a document in one go, use a JsonWriter directly
+// to reuse its buffer across documents or stream to a sink.
+ENTRYPOINT inline
+std::string json_to_string(JsonItem const & json, JsonWriteMode mode = JsonWriteMode::COMPACT) {
+    JsonWriter writer = json_writer_create(mode);
+    json_write_item(writer, json);
+    return std::move(writer.buffer);
+}
+
+INTERNAL inline
+std::string json_json_pretty_print_item(JsonItem const & json, const size_t indent) {
+    switch( json.type ) {
+        case JsonItemType::EMPTY:
+            return {};
         case JsonItemType::END_OF_JSON_VALUES:
             return "<EMPTY>";
         case JsonItemType::ERROR:
             return json.text;
-        default:
-            return static_cast<const std::ostringstream &>(
-                    std::ostringstream() << "invalid type found '" << (int) json.type).str();
+        default: {
+            JsonWriter writer = json_writer_create(JsonWriteMode::PRETTY);
+            writer.depth = indent;
+            json_write_item(writer, json);
+            return std::move(writer.buffer);
+        }
     }
 }
 
 #ifdef TEST_JSON
+#include <cstdlib>
+
 INTERNAL
 void json_pretty_print(JsonItem const & json ) {
     std::cout << json_json_pretty_print_item(json, 0) << '\n';
 }
 
+// Parses test, prints it, and returns 1 unless the result in
+// compact form (or the error, or <EMPTY> for no document) is
+// expected.
+INTERNAL
+int json_check(std::string const & test, std::string const & expected,
+               JsonParseOptions const & options = json_default_parse_options()) {
+    const JsonItem json = json_create_from_string(test, options);
+    json_pretty_print(json);
+    const std::string result = json.type == JsonItemType::END_OF_JSON_VALUES ? "<EMPTY>"
+                             : json.type == JsonItemType::ERROR ? json.text
+                             : json_to_string(json);
+    if ( result != expected ) {
+        std::cout << "FAIL " << test.substr(0, 64) << ": got " << result << ", expected " << expected << '\n';
+        return 1;
+    }
+    return 0;
+}
+
 int main() {
-#if 1
-    {
-        std::string test = "";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "null";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "true";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "false";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "[]";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "{}";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "1234567890";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "123.4567890";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "\"a string\"";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "\"a multiline\nstring\"";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
+    int failures = 0;
+    failures += json_check("", "<EMPTY>");
+    failures += json_check("null", "null");
+    failures += json_check("true", "true");
+    failures += json_check("false", "false");
+    failures += json_check("[]", "[]");
+    failures += json_check("{}", "{}");
+    failures += json_check("1234567890", "1234567890");
+    failures += json_check("123.4567890", "123.456789");
+
+    // numbers, RFC 8259 section 6
+    failures += json_check("[-0, -12, 0.1, 1e10, -1.5E-3, 2.5e+2]", "[0,-12,0.1,1e+10,-0.0015,250.0]");
+    failures += json_check("{ \"expires_in\": 3600, \"exp\": 1700000000 }", "{\"expires_in\":3600,\"exp\":1700000000}");
+    failures += json_check("1.5e308", "1.5e+308");
     {
-        std::string test = "\"a string with a \\\"quote\\\" in it\"";
+        // int64 limits stay exact, anything bigger becomes a double
+        std::string test = "[9223372036854775807, -9223372036854775808, 9223372036854775808, -9223372036854775809]";
+        failures += json_check(test, "[9223372036854775807,-9223372036854775808,9223372036854775808.0,-9223372036854775808.0]");
         JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
+        failures += json.array[0].type != JsonItemType::INTEGER || json.array[0].integer != INT64_MAX;
+        failures += json.array[1].type != JsonItemType::INTEGER || json.array[1].integer != INT64_MIN;
+        failures += json.array[2].type != JsonItemType::FLOAT || json.array[3].type != JsonItemType::FLOAT;
+    }
+    failures += json_check("1.", "Error at 0,2: Expected digit after decimal point.");
+    failures += json_check("-", "Error at 0,1: Number must contain at least one digit.");
+    failures += json_check("1e", "Error at 0,2: Expected digit in exponent.");
+    failures += json_check("1e400", "Error at 0,4: Number is out of range.");
+    failures += json_check("[.5]", "Error at 1,1: invalid character found");
+    // a leading zero ends the number, what follows it is left over
+    failures += json_check("01", "Error at 1,1: Unexpected characters after the end of the document.");
+    failures += json_check("-01", "Error at 2,2: Unexpected characters after the end of the document.");
+    failures += json_check("[012]", "Error at 2,2: Expected ']' for end of array");
+    failures += json_check("0x1", "Error at 1,1: Unexpected characters after the end of the document.");
+
+    // strings
+    failures += json_check("\"a string\"", "\"a string\"");
+    failures += json_check("\"a multiline\nstring\"", "\"a multiline\\nstring\"");
+    failures += json_check("\"a string with a \\\"quote\\\" in it\"", "\"a string with a \\\"quote\\\" in it\"");
     {
-        std::string test = "[0,1,2,3,4,5,6,7,8,9]";
+        // escapes are decoded, including surrogate pairs
+        std::string test = "\"tab\\t slash\\/ e\\u0301 clef\\ud834\\udd1e lone\\ud800 end\"";
         JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
+        std::cout << json.text << '\n';
+        failures += json.text != "tab\t slash/ e\xcc\x81 clef\xf0\x9d\x84\x9e lone\xef\xbf\xbd end";
+    }
+    failures += json_check("\"bad \\u12G4\"", "Error at 5,5: Invalid \\u escape, four hex digits expected.");
+    failures += json_check("\"unterminated", "Error at 1,12: String without final quotes was detected.");
+
+    failures += json_check("[0,1,2,3,4,5,6,7,8,9]", "[0,1,2,3,4,5,6,7,8,9]");
+    failures += json_check("[0,1,2,3,4,5,6,7,8,[[[5]]]]", "[0,1,2,3,4,5,6,7,8,[[[5]]]]");
+
+    // the leniencies: bare words, single quotes, trailing commas
+    failures += json_check("{ keyonly }", "Error at 10,10: No value found for object key-value pair.");
+    failures += json_check("{ key: value }", "{\"key\":\"value\"}");
+    failures += json_check("{ key: 9 }", "{\"key\":9}");
+    failures += json_check("{ key: 9, 1: 14 }", "{\"key\":9,\"1\":14}");
+    failures += json_check("{ key: 9, 1: [14,2,3] }", "{\"key\":9,\"1\":[14,2,3]}");
+    failures += json_check("{ key: 9, 1: [14,2,3], \"a\":\"b\", g: h }", "{\"key\":9,\"1\":[14,2,3],\"a\":\"b\",\"g\":\"h\"}");
+    failures += json_check("\"''\"", "\"''\"");
+    failures += json_check("'\"'", "\"\\\"\"");
+    failures += json_check("{\"a\": [1, 2,], \"b\": \"\", }", "{\"a\":[1,2],\"b\":\"\"}");
+    failures += json_check("{ \"access_token\": \"a\\\\b\", \"expires_in\": 3600, \"scope\": [\"openid\", 1.0, null] }",
+                           "{\"access_token\":\"a\\\\b\",\"expires_in\":3600,\"scope\":[\"openid\",1.0,null]}");
+
+    // structure
+    failures += json_check("[1 2]", "Error at 3,3: Expected ']' for end of array");
+    failures += json_check("[1", "Error at 2,2: Expected ']' for end of array");
+    failures += json_check("{\"a\" 1}", "Error at 5,5: No value found for object key-value pair.");
+    failures += json_check("{\"a\":1}}", "Error at 7,7: Unexpected characters after the end of the document.");
+    failures += json_check("[1]x", "Error at 3,3: Unexpected characters after the end of the document.");
+    failures += json_check("{\"a\":\"b\"}#", "Error at 9,9: Unexpected characters after the end of the document.");
+    failures += json_check("1 2", "Error at 2,2: Unexpected characters after the end of the document.");
+    failures += json_check("{}  \n", "{}");
+
+    // depth and length limits
     {
-        std::string test = "[0,1,2,3,4,5,6,7,8,[[[5]]]]";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        // would blow the C++ stack with a recursive parser
+        std::string test = std::string(100000, '[') + std::string(100000, ']');
+        failures += json_check(test, "Error at 128,128: Maximum nesting depth exceeded.");
+        failures += json_check(std::string(128, '[') + std::string(128, ']'),
+                               std::string(128, '[') + std::string(128, ']'));
     }
     {
-        std::string test = "{ keyonly }";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
-    {
-        std::string test = "{ key: value }";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        JsonParseOptions options = json_default_parse_options();
+        options.max_depth = 3;
+        failures += json_check("[[[]]]", "[[[]]]", options);
+        failures += json_check("[[[[]]]]", "Error at 3,3: Maximum nesting depth exceeded.", options);
+        options.max_length = 4;
+        failures += json_check("[[]]", "[[]]", options);
+        failures += json_check("[[ ]]", "Error at 0,0: Document is larger than the maximum allowed length.", options);
     }
     {
-        std::string test = "{ key: 9 }";
+        // members keep document order, the first of two equal keys wins
+        std::string test = "{\"b\": 1, \"a\": 2, \"b\": 3, \"k\\u0069d\": \"escaped\"}";
         JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        std::cout << json_to_string(json) << ' ' << json.object.at("b").integer << ' '
+                  << json.object.find("kid")->second.text << ' ' << json.object.count("c") << '\n';
+        failures += json_to_string(json) != "{\"b\":1,\"a\":2,\"kid\":\"escaped\"}" || json.object.at("b").integer != 1 ||
+                    json.object.find("kid")->second.text != "escaped" || json.object.count("c") != 0;
     }
     {
-        std::string test = "{ key: 9, 1: 14 }";
+        // large objects are looked up through their index
+        std::string test = "{";
+        for ( int ii = 0; ii < 100; ii++ ) {
+            test += (ii ? ", \"key" : "\"key") + std::to_string(ii) + "\": " + std::to_string(ii);
+        }
+        test += "}";
         JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        long sum = 0;
+        for ( int ii = 0; ii < 100; ii++ ) {
+            sum += json.object.at("key" + std::to_string(ii)).integer;
+        }
+        json.object.erase(json.object.find("key0"));
+        std::cout << json.object.size() << ' ' << sum << ' ' << json.object.count("key0") << ' '
+                  << json.object.at("key99").integer << '\n';
+        failures += json.object.size() != 99 || sum != 4950 || json.object.count("key0") != 0 ||
+                    json.object.at("key99").integer != 99;
     }
     {
-        std::string test = "{ key: 9, 1: [14,2,3] }";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        // keys picked to share an index slot under a fixed seed are
+        // spread out by the seed of this process
+        std::vector<std::string> colliding;
+        for ( int ii = 0; colliding.size() < 32; ii++ ) {
+            std::string key = "k" + std::to_string(ii);
+            if ( (json_key_hash(key, 0) & 127) == 0 ) {
+                colliding.push_back(std::move(key));
+            }
+        }
+        size_t same_slot = 0;
+        for ( std::string const & key : colliding ) {
+            same_slot += (json_runtime_key_hash(key) & 127) == (json_runtime_key_hash(colliding[0]) & 127);
+        }
+        std::cout << same_slot << " of " << colliding.size() << " in one slot\n";
+        failures += json_runtime_seed() != 0 && same_slot == colliding.size();
     }
-
     {
-        std::string test = "{ key: 9, 1: [14,2,3], \"a\":\"b\", g: h }";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        // well known keys are shared between documents
+        JsonItem first = json_create_from_string("{\"access_token\": \"a\", \"custom_claim\": 1}");
+        JsonItem second = json_create_from_string("{\"access_token\": \"b\"}");
+        const bool shared = first.object.begin()->first.view().data() == second.object.begin()->first.view().data();
+        const bool interned_before = first.object.find("custom_claim")->first.is_interned();
+        const bool interned = json_intern_key("custom_claim");
+        const bool interned_after = json_create_from_string("{\"custom_claim\": 2}").object.begin()->first.is_interned();
+        std::cout << shared << ' ' << interned_before << ' ' << interned << ' ' << interned_after << '\n';
+        failures += !shared || interned_before || !interned || !interned_after;
     }
-#endif
     {
-        std::string test = "\"''\"";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
+        JsonWriter writer = json_writer_create();
+        for ( int ii = 0; ii < 2; ii++ ) {
+            json_writer_begin_object(writer);
+            json_writer_key(writer, "event");
+            json_writer_string(writer, "token\t\"issued\"\n");
+            json_writer_key(writer, "id");
+            json_writer_integer(writer, ii);
+            json_writer_key(writer, "empty");
+            json_writer_begin_array(writer);
+            json_writer_end_array(writer);
+            json_writer_end_object(writer);
+            json_writer_end_document(writer);
+        }
+        std::cout << writer.buffer;
+        failures += writer.buffer != "{\"event\":\"token\\t\\\"issued\\\"\\n\",\"id\":0,\"empty\":[]}\n"
+                                     "{\"event\":\"token\\t\\\"issued\\\"\\n\",\"id\":1,\"empty\":[]}\n";
     }
     {
-        std::string test = "'\"'";
-        JsonItem json = json_create_from_string(test);
-        json_pretty_print(json);
-    }
+        // scalars flush to the sink too, the buffer stays small
+        std::string sunk;
+        JsonWriter writer = json_writer_create(JsonWriteMode::COMPACT, [&](const char* data, size_t size) {
+            sunk.append(data, size);
+        });
+        writer.flush_threshold = 64;
+        size_t largest = 0;
+        json_writer_begin_array(writer);
+        for ( int ii = 0; ii < 1000; ii++ ) {
+            json_writer_integer(writer, ii);
+            json_writer_real(writer, ii / 4.0);
+            json_writer_boolean(writer, ii % 2);
+            json_writer_null(writer);
+            largest = std::max(largest, writer.buffer.size());
+        }
+        json_writer_end_array(writer);
+        json_writer_flush(writer);
+        const size_t values = json_create_from_string(sunk).array.size();
+        std::cout << (largest < 128) << ' ' << sunk.size() << ' ' << values << '\n';
+        failures += largest >= 128 || !writer.buffer.empty() || values != 4000;
+    }
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 #endif
 
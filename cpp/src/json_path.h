@@ -0,0 +1,738 @@
+#ifndef OAUTH2_JSON_PATH_H
+#define OAUTH2_JSON_PATH_H
+
+// ----------------------------------------------------------
+// JSON Pointer and path queries
+// A query is compiled once into a JsonPath and can then be
+// run any number of times, over a JsonItem tree or directly
+// over a JsonReader without building a tree.
+//
+// Two syntaxes are accepted:
+//   RFC 6901 JSON Pointer   ""  "/keys/0/kid"  "/a~1b/c~0d"
+//   path expressions        "projects[*].projectId"
+//                           "$.keys[?(@.kid == 'abc')]"
+//                           "projects[?lifecycleState==\"ACTIVE\"]"
+//                           "labels.*"  "items[2]"  "['odd key']"
+// Anything starting with '/' (or the empty string) is a pointer.
+// Filters compare a member, found by a dotted path relative to
+// each array element, with a JSON literal.
+// ----------------------------------------------------------
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+#include "json_reader.h"
+#include "macros.h"
+
+enum class JsonPathStepType {
+    // object member by name, or array element when the name is an index
+    KEY = 0,
+    // array element, from [n]
+    INDEX,
+    // every array element or object member, from * or [*]
+    WILDCARD,
+    // array elements whose filter member equals the filter value
+    FILTER
+};
+
+constexpr size_t JSON_PATH_NO_INDEX = std::numeric_limits<size_t>::max();
+
+struct JsonPathStep
+{
+    JsonPathStepType type;
+    std::string key;
+    std::uint32_t hash;
+    size_t index;
+    // FILTER only: member names below the element and the value
+    std::vector<std::string> filter_path;
+    JsonItem filter_value;
+};
+
+struct JsonPath
+{
+    std::vector<JsonPathStep> steps;
+    bool error;
+    size_t error_pos;
+    std::string error_message;
+};
+
+// A canonical array index as RFC 6901 defines it, no sign and
+// no leading zeros.
+INTERNAL inline
+size_t json_path_parse_index(std::string_view text)
+{
+    if ( text.empty() || text.size() > 18 || (text.size() > 1 && text[0] == '0') ) {
+        return JSON_PATH_NO_INDEX;
+    }
+    size_t index = 0;
+    for ( char ch : text ) {
+        if ( !is_digit(ch) ) {
+            return JSON_PATH_NO_INDEX;
+        }
+        index = index * 10 + (ch - '0');
+    }
+    return index;
+}
+
+INTERNAL inline
+JsonPathStep json_path_key_step(std::string key)
+{
+    JsonPathStep step = JsonPathStep {};
+    step.type = JsonPathStepType::KEY;
+    step.hash = json_runtime_key_hash(key);
+    step.index = json_path_parse_index(key);
+    step.key = std::move(key);
+    return step;
+}
+
+INTERNAL inline
+bool json_path_fail(JsonPath& path, size_t pos, const char* message)
+{
+    path.error = true;
+    path.error_pos = pos;
+    path.error_message = message;
+    path.steps.clear();
+    return false;
+}
+
+// entry point
+ENTRYPOINT inline
+JsonPath json_pointer_compile(std::string_view pointer)
+{
+    JsonPath path = JsonPath {};
+    if ( pointer.empty() ) {
+        return path;
+    }
+    if ( pointer[0] != '/' ) {
+        json_path_fail(path, 0, "JSON Pointer must start with '/'.");
+        return path;
+    }
+    size_t pos = 1;
+    while ( true ) {
+        size_t end = pointer.find('/', pos);
+        if ( end == std::string_view::npos ) {
+            end = pointer.size();
+        }
+        std::string key;
+        for ( size_t ii = pos; ii < end; ii++ ) {
+            if ( pointer[ii] != '~' ) {
+                key += pointer[ii];
+            } else if ( ii + 1 < end && (pointer[ii + 1] == '0' || pointer[ii + 1] == '1') ) {
+                key += pointer[++ii] == '0' ? '~' : '/';
+            } else {
+                json_path_fail(path, ii, "'~' must be followed by '0' or '1'.");
+                return path;
+            }
+        }
+        path.steps.push_back(json_path_key_step(std::move(key)));
+        if ( end == pointer.size() ) {
+            return path;
+        }
+        pos = end + 1;
+    }
+}
+
+INTERNAL inline
+bool json_path_is_name(char ch)
+{
+    return is_key(ch) || ch == '-' || ch == '$';
+}
+
+INTERNAL inline
+void json_path_eat_whitespace(std::string_view text, size_t& pos)
+{
+    while ( pos < text.size() && (text[pos] == ' ' || text[pos] == '\t') ) {
+        pos++;
+    }
+}
+
+// Reads a quoted name in a bracket or the literal of a filter,
+// which both end at the matching quote.
+INTERNAL inline
+bool json_path_quoted(JsonPath& path, std::string_view text, size_t& pos, std::string_view& raw)
+{
+    const char quote = text[pos];
+    size_t end = pos + 1;
+    while ( end < text.size() && text[end] != quote ) {
+        end += text[end] == '\\' ? 2 : 1;
+    }
+    if ( end >= text.size() ) {
+        return json_path_fail(path, pos, "Unterminated quoted string.");
+    }
+    raw = text.substr(pos, end + 1 - pos);
+    pos = end + 1;
+    return true;
+}
+
+INTERNAL inline
+bool json_path_filter(JsonPath& path, std::string_view text, size_t& pos, JsonPathStep& step)
+{
+    // accept ?(@.a.b == v) as well as the shorter ?a.b == v
+    const bool parenthesis = pos < text.size() && text[pos] == '(';
+    if ( parenthesis ) {
+        pos++;
+    }
+    json_path_eat_whitespace(text, pos);
+    if ( pos < text.size() && text[pos] == '@' ) {
+        pos++;
+        if ( pos < text.size() && text[pos] == '.' ) {
+            pos++;
+        }
+    }
+    while ( true ) {
+        const size_t start = pos;
+        while ( pos < text.size() && json_path_is_name(text[pos]) ) {
+            pos++;
+        }
+        if ( pos == start ) {
+            return json_path_fail(path, pos, "Expected a member name in filter.");
+        }
+        step.filter_path.emplace_back(text.substr(start, pos - start));
+        if ( pos >= text.size() || text[pos] != '.' ) {
+            break;
+        }
+        pos++;
+    }
+    json_path_eat_whitespace(text, pos);
+    if ( text.substr(pos, 2) != "==" ) {
+        return json_path_fail(path, pos, "Expected '==' in filter.");
+    }
+    pos += 2;
+    json_path_eat_whitespace(text, pos);
+    const size_t literal_start = pos;
+    std::string_view literal;
+    if ( pos < text.size() && is_quote(text[pos]) ) {
+        if ( !json_path_quoted(path, text, pos, literal) ) {
+            return false;
+        }
+    } else {
+        while ( pos < text.size() && text[pos] != ']' && text[pos] != ')' && text[pos] != ' ' ) {
+            pos++;
+        }
+        literal = text.substr(literal_start, pos - literal_start);
+    }
+    step.filter_value = json_create_from_string(std::string(literal));
+    if ( step.filter_value.type == JsonItemType::ERROR || step.filter_value.type == JsonItemType::ARRAY ||
+         step.filter_value.type == JsonItemType::OBJECT || literal.empty() ) {
+        return json_path_fail(path, literal_start, "Filter value must be a string, number, true, false or null.");
+    }
+    json_path_eat_whitespace(text, pos);
+    if ( parenthesis ) {
+        if ( pos >= text.size() || text[pos] != ')' ) {
+            return json_path_fail(path, pos, "Expected ')' to close filter.");
+        }
+        pos++;
+    }
+    return true;
+}
+
+// Reads what is inside [ ] with pos just after the '['.
+INTERNAL inline
+bool json_path_bracket(JsonPath& path, std::string_view text, size_t& pos)
+{
+    json_path_eat_whitespace(text, pos);
+    if ( pos >= text.size() ) {
+        return json_path_fail(path, pos, "Expected ']'.");
+    }
+    JsonPathStep step = JsonPathStep {};
+    const char ch = text[pos];
+    if ( ch == '*' ) {
+        step.type = JsonPathStepType::WILDCARD;
+        pos++;
+    } else if ( ch == '?' ) {
+        step.type = JsonPathStepType::FILTER;
+        pos++;
+        if ( !json_path_filter(path, text, pos, step) ) {
+            return false;
+        }
+    } else if ( is_quote(ch) ) {
+        std::string_view raw;
+        if ( !json_path_quoted(path, text, pos, raw) ) {
+            return false;
+        }
+        const JsonItem key = json_create_from_string(std::string(raw));
+        if ( key.type != JsonItemType::TEXT ) {
+            return json_path_fail(path, pos, "Invalid quoted member name.");
+        }
+        step = json_path_key_step(key.text);
+    } else {
+        const size_t start = pos;
+        while ( pos < text.size() && is_digit(text[pos]) ) {
+            pos++;
+        }
+        step.type = JsonPathStepType::INDEX;
+        step.index = json_path_parse_index(text.substr(start, pos - start));
+        if ( step.index == JSON_PATH_NO_INDEX ) {
+            return json_path_fail(path, start, "Expected an array index, '*', '?' or a quoted name.");
+        }
+    }
+    json_path_eat_whitespace(text, pos);
+    if ( pos >= text.size() || text[pos] != ']' ) {
+        return json_path_fail(path, pos, "Expected ']'.");
+    }
+    pos++;
+    path.steps.push_back(std::move(step));
+    return true;
+}
+
+// entry point
+ENTRYPOINT inline
+JsonPath json_path_compile(std::string_view text)
+{
+    if ( text.empty() || text[0] == '/' ) {
+        return json_pointer_compile(text);
+    }
+    JsonPath path = JsonPath {};
+    size_t pos = 0;
+    if ( text[0] == '$' && (text.size() == 1 || text[1] == '.' || text[1] == '[') ) {
+        pos = 1;
+    }
+    bool need_separator = pos == 1;
+    while ( pos < text.size() ) {
+        if ( text[pos] == '[' ) {
+            pos++;
+            if ( !json_path_bracket(path, text, pos) ) {
+                return path;
+            }
+            need_separator = true;
+            continue;
+        }
+        if ( need_separator ) {
+            if ( text[pos] != '.' ) {
+                json_path_fail(path, pos, "Expected '.' or '['.");
+                return path;
+            }
+            pos++;
+        }
+        need_separator = true;
+        if ( pos < text.size() && text[pos] == '*' ) {
+            JsonPathStep step = JsonPathStep {};
+            step.type = JsonPathStepType::WILDCARD;
+            path.steps.push_back(std::move(step));
+            pos++;
+            continue;
+        }
+        const size_t start = pos;
+        while ( pos < text.size() && json_path_is_name(text[pos]) ) {
+            pos++;
+        }
+        if ( pos == start ) {
+            json_path_fail(path, pos, "Expected a member name.");
+            return path;
+        }
+        path.steps.push_back(json_path_key_step(std::string(text.substr(start, pos - start))));
+    }
+    return path;
+}
+
+// ----------------------------------------------------------
+// Evaluation over a JsonItem tree
+// ----------------------------------------------------------
+
+INTERNAL inline
+bool json_path_value_equal(JsonItem const & item, JsonItem const & value)
+{
+    const bool item_is_number = item.type == JsonItemType::INTEGER || item.type == JsonItemType::FLOAT;
+    const bool value_is_number = value.type == JsonItemType::INTEGER || value.type == JsonItemType::FLOAT;
+    if ( item_is_number && value_is_number ) {
+        if ( item.type == JsonItemType::INTEGER && value.type == JsonItemType::INTEGER ) {
+            return item.integer == value.integer;
+        }
+        const double left = item.type == JsonItemType::INTEGER ? static_cast<double>(item.integer) : item.real;
+        const double right = value.type == JsonItemType::INTEGER ? static_cast<double>(value.integer) : value.real;
+        return left == right;
+    }
+    if ( item.type != value.type ) {
+        return false;
+    }
+    return item.type != JsonItemType::TEXT || item.text == value.text;
+}
+
+INTERNAL inline
+bool json_path_filter_matches(JsonPathStep const & step, JsonItem const & element)
+{
+    const JsonItem* item = &element;
+    for ( std::string const & key : step.filter_path ) {
+        if ( item->type != JsonItemType::OBJECT ) {
+            return false;
+        }
+        const auto found = item->object.find(key);
+        if ( found == item->object.end() ) {
+            return false;
+        }
+        item = &found->second;
+    }
+    return json_path_value_equal(*item, step.filter_value);
+}
+
+// Calls on_match for every match in document order until it
+// returns false.  Returns false when it was stopped.
+template<typename Callback>
+bool json_path_visit(JsonPath const & path, size_t step_index, JsonItem const & item, Callback& on_match)
+{
+    if ( step_index == path.steps.size() ) {
+        return on_match(item);
+    }
+    const JsonPathStep& step = path.steps[step_index];
+    switch ( step.type ) {
+        case JsonPathStepType::KEY:
+            if ( item.type == JsonItemType::OBJECT ) {
+                const auto found = item.object.find(step.key, step.hash);
+                return found == item.object.end() || json_path_visit(path, step_index + 1, found->second, on_match);
+            }
+            if ( item.type == JsonItemType::ARRAY && step.index < item.array.size() ) {
+                return json_path_visit(path, step_index + 1, item.array[step.index], on_match);
+            }
+            return true;
+        case JsonPathStepType::INDEX:
+            if ( item.type == JsonItemType::ARRAY && step.index < item.array.size() ) {
+                return json_path_visit(path, step_index + 1, item.array[step.index], on_match);
+            }
+            return true;
+        case JsonPathStepType::WILDCARD:
+            if ( item.type == JsonItemType::ARRAY ) {
+                for ( JsonItem const & element : item.array ) {
+                    if ( !json_path_visit(path, step_index + 1, element, on_match) ) {
+                        return false;
+                    }
+                }
+            } else if ( item.type == JsonItemType::OBJECT ) {
+                for ( auto const & member : item.object ) {
+                    if ( !json_path_visit(path, step_index + 1, member.second, on_match) ) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        case JsonPathStepType::FILTER:
+            if ( item.type == JsonItemType::ARRAY ) {
+                for ( JsonItem const & element : item.array ) {
+                    if ( json_path_filter_matches(step, element) &&
+                         !json_path_visit(path, step_index + 1, element, on_match) ) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+    }
+    return true;
+}
+
+// Every value the path selects, in document order.
+ENTRYPOINT inline
+std::vector<const JsonItem*> json_path_select(JsonPath const & path, JsonItem const & root)
+{
+    std::vector<const JsonItem*> matches;
+    if ( path.error ) {
+        return matches;
+    }
+    auto collect = [&matches](JsonItem const & item) {
+        matches.push_back(&item);
+        return true;
+    };
+    json_path_visit(path, 0, root, collect);
+    return matches;
+}
+
+// The first value the path selects or nullptr, stops looking as
+// soon as there is one.
+ENTRYPOINT inline
+const JsonItem* json_path_first(JsonPath const & path, JsonItem const & root)
+{
+    const JsonItem* first = nullptr;
+    if ( path.error ) {
+        return first;
+    }
+    auto take = [&first](JsonItem const & item) {
+        first = &item;
+        return false;
+    };
+    json_path_visit(path, 0, root, take);
+    return first;
+}
+
+// ----------------------------------------------------------
+// Evaluation over a JsonReader
+// The reader must be on the first token of the value the path
+// is applied to, usually straight after the first
+// json_reader_next.  For every match the callback gets the
+// reader on the first token of the matched value and has to
+// leave it on the last token of that value, which is what
+// json_bind_value and json_reader_skip do.  Returning false
+// from the callback stops the query.  Filters read an element
+// twice, once to test it and again to hand it over.
+// ----------------------------------------------------------
+
+INTERNAL inline
+bool json_path_token_is_value(JsonReader& reader)
+{
+    return reader.token != JsonTokenType::END_OBJECT && reader.token != JsonTokenType::END_ARRAY &&
+           reader.token != JsonTokenType::KEY && reader.token != JsonTokenType::END_OF_DOCUMENT &&
+           reader.token != JsonTokenType::ERROR;
+}
+
+INTERNAL inline
+bool json_path_token_equal(JsonReader& reader, JsonItem const & value)
+{
+    switch ( reader.token ) {
+        case JsonTokenType::STRING:
+            return value.type == JsonItemType::TEXT && json_reader_get_view(reader) == value.text;
+        case JsonTokenType::NUMBER: {
+            JsonItem number = JsonItem {};
+            number.type = reader.number.type;
+            number.integer = reader.number.integer;
+            number.real = reader.number.real;
+            return json_path_value_equal(number, value);
+        }
+        case JsonTokenType::TRUE_VALUE:
+            return value.type == JsonItemType::TRUE_VALUE;
+        case JsonTokenType::FALSE_VALUE:
+            return value.type == JsonItemType::FALSE_VALUE;
+        case JsonTokenType::NULL_VALUE:
+            return value.type == JsonItemType::NULL_VALUE;
+        default:
+            return false;
+    }
+}
+
+// Reads the whole element the reader is on and tells whether
+// its filter member equals the filter value.
+INTERNAL inline
+bool json_path_reader_filter_matches(JsonPathStep const & step, JsonReader& reader, size_t level, bool& matches)
+{
+    if ( level == step.filter_path.size() ) {
+        matches = json_path_token_equal(reader, step.filter_value);
+        return json_reader_skip(reader);
+    }
+    if ( reader.token != JsonTokenType::BEGIN_OBJECT ) {
+        return json_reader_skip(reader);
+    }
+    bool found = false;
+    while ( json_reader_next(reader) == JsonTokenType::KEY ) {
+        const bool is_member = !found && json_reader_get_view(reader) == step.filter_path[level];
+        json_reader_next(reader);
+        if ( reader.error ) {
+            return false;
+        }
+        if ( is_member ) {
+            found = true;
+            if ( !json_path_reader_filter_matches(step, reader, level + 1, matches) ) {
+                return false;
+            }
+        } else if ( !json_reader_skip(reader) ) {
+            return false;
+        }
+    }
+    return !reader.error;
+}
+
+// Returns false on a reader error or when the callback stopped
+// the query, stopped tells which.
+template<typename Callback>
+bool json_path_read_visit(JsonPath const & path, size_t step_index, JsonReader& reader, Callback& on_match,
+                          bool& stopped)
+{
+    if ( step_index == path.steps.size() ) {
+        if ( !on_match(reader) ) {
+            stopped = true;
+            return false;
+        }
+        return !reader.error;
+    }
+    const JsonPathStep& step = path.steps[step_index];
+    const bool is_object = reader.token == JsonTokenType::BEGIN_OBJECT;
+    const bool is_array = reader.token == JsonTokenType::BEGIN_ARRAY;
+    const bool wanted = step.type == JsonPathStepType::KEY ? (is_object || (is_array && step.index != JSON_PATH_NO_INDEX))
+                      : step.type == JsonPathStepType::WILDCARD ? (is_object || is_array)
+                      : is_array;
+    if ( !wanted ) {
+        return json_reader_skip(reader);
+    }
+    if ( is_object ) {
+        bool found = false;
+        while ( json_reader_next(reader) == JsonTokenType::KEY ) {
+            // like the tree, only the first of two equal keys counts
+            const bool is_match = step.type == JsonPathStepType::WILDCARD ||
+                                  (!found && json_reader_get_view(reader) == step.key);
+            json_reader_next(reader);
+            if ( reader.error ) {
+                return false;
+            }
+            found = found || is_match;
+            if ( !(is_match ? json_path_read_visit(path, step_index + 1, reader, on_match, stopped)
+                            : json_reader_skip(reader)) ) {
+                return false;
+            }
+        }
+        return !reader.error;
+    }
+    size_t index = 0;
+    while ( json_reader_next(reader) != JsonTokenType::END_ARRAY ) {
+        if ( reader.error ) {
+            return false;
+        }
+        bool is_match = false;
+        if ( step.type == JsonPathStepType::FILTER ) {
+            const size_t start = reader.pos - (reader.token == JsonTokenType::BEGIN_OBJECT ? 1 : 0);
+            const size_t depth = reader.containers.size() - (reader.token == JsonTokenType::BEGIN_OBJECT ? 1 : 0);
+            if ( !json_path_reader_filter_matches(step, reader, 0, is_match) ) {
+                return false;
+            }
+            if ( is_match ) {
+                // read the element again, this time for real
+                json_reader_rewind(reader, start, depth);
+                json_reader_next(reader);
+            }
+        } else {
+            is_match = step.type == JsonPathStepType::WILDCARD || index == step.index;
+        }
+        index++;
+        if ( is_match ) {
+            if ( !json_path_read_visit(path, step_index + 1, reader, on_match, stopped) ) {
+                return false;
+            }
+        } else if ( step.type != JsonPathStepType::FILTER && !json_reader_skip(reader) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// entry point
+// Returns false on error, including a reader error raised by the
+// callback, true when the query ran to the end or was stopped.
+template<typename Callback>
+bool json_path_read(JsonPath const & path, JsonReader& reader, Callback on_match)
+{
+    if ( path.error ) {
+        return false;
+    }
+    if ( !json_path_token_is_value(reader) ) {
+        return !reader.error;
+    }
+    bool stopped = false;
+    return json_path_read_visit(path, 0, reader, on_match, stopped) || (stopped && !reader.error);
+}
+
+#ifdef TEST_JSON_PATH
+// Runs query over document through the tree and the reader, both
+// have to give expected: the matches as JSON separated by spaces,
+// or the compile error.  Returns the number of failures.
+INTERNAL
+int json_path_check(std::string const & document, std::string_view query, std::string_view expected)
+{
+    const JsonPath path = json_path_compile(query);
+    std::string selected;
+    std::string streamed;
+    bool ok = true;
+    if ( path.error ) {
+        selected = "error at " + std::to_string(path.error_pos) + ": " + path.error_message;
+        streamed = selected;
+    } else {
+        const JsonItem root = json_create_from_string(document);
+        for ( const JsonItem* item : json_path_select(path, root) ) {
+            selected += (selected.empty() ? "" : " ") + json_to_string(*item);
+        }
+        // the reader has to agree with the tree
+        JsonReader reader = json_reader_create(document);
+        json_reader_next(reader);
+        ok = json_path_read(path, reader, [&streamed](JsonReader& match) {
+            // work out where the matched value starts from its token
+            size_t length = 1;
+            switch ( match.token ) {
+                case JsonTokenType::STRING:      length = match.text.size() + 2; break;
+                case JsonTokenType::NUMBER:      length = match.text.size(); break;
+                case JsonTokenType::TRUE_VALUE:  length = 4; break;
+                case JsonTokenType::FALSE_VALUE: length = 5; break;
+                case JsonTokenType::NULL_VALUE:  length = 4; break;
+                default: break;
+            }
+            const size_t first = match.pos - length;
+            json_reader_skip(match);
+            const JsonItem item = json_create_from_string(std::string(match.buffer.substr(first, match.pos - first)));
+            streamed += (streamed.empty() ? "" : " ") + json_to_string(item);
+            return true;
+        });
+    }
+    std::cout << query << " => " << selected << (ok ? " | " : " | reader failed ") << streamed << '\n';
+    if ( !ok || selected != expected || streamed != expected ) {
+        std::cout << "FAIL " << query << ": expected " << expected << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    const std::string projects =
+        "{ \"projects\": ["
+        " { \"projectId\": \"alpha\", \"lifecycleState\": \"ACTIVE\", \"labels\": { \"env\": \"prod\" } },"
+        " { \"projectId\": \"beta\", \"lifecycleState\": \"DELETE_REQUESTED\" },"
+        " { \"projectId\": \"gamma\", \"lifecycleState\": \"ACTIVE\", \"labels\": { \"env\": \"dev\" } } ],"
+        " \"nextPageToken\": \"\" }";
+    const std::string jwks =
+        "{ \"keys\": [ { \"kid\": \"k1\", \"kty\": \"RSA\", \"n\": \"abc\", \"e\": \"AQAB\" },"
+        " { \"kid\": \"k2\", \"kty\": \"EC\", \"crv\": \"P-256\" } ] }";
+    const std::string rfc6901 =
+        "{ \"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1, \"c%d\": 2, \"e^f\": 3, \"g|h\": 4,"
+        " \"i\\\\j\": 5, \"k\\\"l\": 6, \" \": 7, \"m~n\": 8 }";
+    const std::string values = "[{\"v\": 2}, {\"v\": 2.0}, {\"v\": \"2\"}, {\"v\": null}]";
+    int failures = 0;
+
+    // the examples from section 5 of RFC 6901
+    failures += json_path_check(rfc6901, "", "{\"foo\":[\"bar\",\"baz\"],\"\":0,\"a/b\":1,\"c%d\":2,\"e^f\":3,"
+                                             "\"g|h\":4,\"i\\\\j\":5,\"k\\\"l\":6,\" \":7,\"m~n\":8}");
+    failures += json_path_check(rfc6901, "/foo", "[\"bar\",\"baz\"]");
+    failures += json_path_check(rfc6901, "/foo/0", "\"bar\"");
+    failures += json_path_check(rfc6901, "/", "0");
+    failures += json_path_check(rfc6901, "/a~1b", "1");
+    failures += json_path_check(rfc6901, "/c%d", "2");
+    failures += json_path_check(rfc6901, "/e^f", "3");
+    failures += json_path_check(rfc6901, "/g|h", "4");
+    failures += json_path_check(rfc6901, "/i\\j", "5");
+    failures += json_path_check(rfc6901, "/k\"l", "6");
+    failures += json_path_check(rfc6901, "/ ", "7");
+    failures += json_path_check(rfc6901, "/m~0n", "8");
+    failures += json_path_check(rfc6901, "/foo/2", "");
+    failures += json_path_check(rfc6901, "/foo/-", "");
+    failures += json_path_check(rfc6901, "/foo/01", "");
+    failures += json_path_check(rfc6901, "/m~2n", "error at 2: '~' must be followed by '0' or '1'.");
+
+    failures += json_path_check(projects, "projects[*].projectId", "\"alpha\" \"beta\" \"gamma\"");
+    failures += json_path_check(projects, "projects[?lifecycleState==\"ACTIVE\"].projectId", "\"alpha\" \"gamma\"");
+    failures += json_path_check(projects, "$.projects[?(@.labels.env == 'dev')]",
+                                "{\"projectId\":\"gamma\",\"lifecycleState\":\"ACTIVE\",\"labels\":{\"env\":\"dev\"}}");
+    failures += json_path_check(projects, "projects[1]", "{\"projectId\":\"beta\",\"lifecycleState\":\"DELETE_REQUESTED\"}");
+    failures += json_path_check(projects, "projects.0.labels.*", "\"prod\"");
+    failures += json_path_check(projects, "/projects/2/projectId", "\"gamma\"");
+    failures += json_path_check(jwks, "keys[?kid=='k2']", "{\"kid\":\"k2\",\"kty\":\"EC\",\"crv\":\"P-256\"}");
+    failures += json_path_check(jwks, "$['keys'][?(@.kty == \"RSA\")].e", "\"AQAB\"");
+    failures += json_path_check(jwks, "keys[?kid=='missing']", "");
+    failures += json_path_check("[1, 2.0, \"2\", true, null, {\"v\": 2}]", "[*]", "1 2.0 \"2\" true null {\"v\":2}");
+    failures += json_path_check(values, "[?v==2]", "{\"v\":2} {\"v\":2.0}");
+    failures += json_path_check(values, "[?v==null]", "{\"v\":null}");
+
+    failures += json_path_check(projects, "projects[", "error at 9: Expected ']'.");
+    failures += json_path_check(projects, "projects[?lifecycleState]", "error at 24: Expected '==' in filter.");
+    failures += json_path_check(projects, "projects[?a==[1]]",
+                                "error at 13: Filter value must be a string, number, true, false or null.");
+    failures += json_path_check(projects, "projects..x", "error at 9: Expected a member name.");
+
+    {
+        // the first match is enough to find a signing key
+        const JsonItem root = json_create_from_string(jwks);
+        const JsonPath path = json_path_compile("keys[?kid=='k1']");
+        const JsonItem* key = json_path_first(path, root);
+        std::cout << (key != nullptr ? key->object.at("kty").text : "none") << '\n';
+        failures += key == nullptr || key->object.at("kty").text != "RSA";
+    }
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_JSON_PATH_H */
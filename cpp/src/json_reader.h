@@ -0,0 +1,384 @@
+#ifndef OAUTH2_JSON_READER_H
+#define OAUTH2_JSON_READER_H
+
+// ----------------------------------------------------------
+// Tiny JSON pull reader
+// Walks a document one token at a time without building a
+// JsonItem tree.  Tokens refer straight into the input so
+// the buffer has to outlive the reader.  Unlike the DOM
+// parser this only accepts strict RFC 8259 JSON.
+// ----------------------------------------------------------
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+#include "json_string.h"
+#include "macros.h"
+
+enum class JsonTokenType {
+    BEGIN_OBJECT = 0,
+    END_OBJECT,
+    BEGIN_ARRAY,
+    END_ARRAY,
+    KEY,
+    STRING,
+    NUMBER,
+    TRUE_VALUE,
+    FALSE_VALUE,
+    NULL_VALUE,
+    END_OF_DOCUMENT,
+    ERROR
+};
+
+// what the reader expects to see next
+enum class JsonReaderState {
+    VALUE = 0,
+    FIRST_KEY,
+    KEY,
+    FIRST_ARRAY_VALUE,
+    AFTER_VALUE,
+    DONE
+};
+
+struct JsonReader
+{
+    std::string_view buffer;
+    size_t pos;
+    JsonReaderState state;
+    // '{' or '[' for every container we are inside of
+    std::vector<char> containers;
+    size_t max_depth;
+    // deepest nesting seen, for statistics
+    size_t deepest;
+
+    // the current token, for strings and keys text is the raw
+    // content between the quotes
+    JsonTokenType token;
+    std::string_view text;
+    bool has_escapes;
+    JsonNumber number;
+
+    // strings with escapes are decoded into here
+    JsonArena arena;
+
+    bool error;
+    size_t error_pos;
+    std::string error_message;
+};
+
+INTERNAL inline
+JsonReader json_reader_create(std::string_view buffer, size_t max_depth = JSON_DEFAULT_MAX_DEPTH)
+{
+    JsonReader reader = JsonReader {};
+    reader.buffer = buffer;
+    reader.pos = 0;
+    reader.state = JsonReaderState::VALUE;
+    reader.max_depth = max_depth;
+    reader.deepest = 0;
+    reader.token = JsonTokenType::END_OF_DOCUMENT;
+    reader.has_escapes = false;
+    reader.error = false;
+    reader.error_pos = 0;
+    return reader;
+}
+
+// Point the reader at a new document.  The container stack and
+// the arena keep their memory, strings decoded from the previous
+// document are no longer valid afterwards.
+INTERNAL inline
+void json_reader_reset(JsonReader& reader, std::string_view buffer)
+{
+    reader.buffer = buffer;
+    reader.pos = 0;
+    reader.state = JsonReaderState::VALUE;
+    reader.containers.clear();
+    reader.deepest = 0;
+    reader.token = JsonTokenType::END_OF_DOCUMENT;
+    reader.text = std::string_view();
+    reader.has_escapes = false;
+    json_arena_reset(reader.arena);
+    reader.error = false;
+    reader.error_pos = 0;
+    reader.error_message.clear();
+}
+
+INTERNAL inline
+JsonTokenType json_reader_fail(JsonReader& reader, size_t pos, const char* message)
+{
+    reader.error = true;
+    reader.error_pos = pos;
+    reader.error_message = message;
+    reader.state = JsonReaderState::DONE;
+    reader.token = JsonTokenType::ERROR;
+    return reader.token;
+}
+
+INTERNAL inline
+void json_reader_eat_whitespace(JsonReader& reader)
+{
+    // RFC 8259 whitespace only, no NUL
+    while ( reader.pos < reader.buffer.size() ) {
+        const char ch = reader.buffer[reader.pos];
+        if ( ch != ' ' && ch != '\n' && ch != '\r' && ch != '\t' ) {
+            break;
+        }
+        reader.pos++;
+    }
+}
+
+// Assumes pos is on the opening quote, leaves pos after the
+// closing quote with text set to everything in between.
+INTERNAL inline
+bool json_reader_scan_string(JsonReader& reader)
+{
+    const char* first = reader.buffer.data() + reader.pos + 1;
+    const char* last = reader.buffer.data() + reader.buffer.size();
+    const char* p = first;
+    reader.has_escapes = false;
+    while ( true ) {
+        p = json_find_string_special(p, last, '"');
+        if ( p >= last ) {
+            json_reader_fail(reader, reader.pos, "String without final quotes was detected.");
+            return false;
+        }
+        if ( *p == '"' ) {
+            break;
+        }
+        if ( *p != '\\' ) {
+            json_reader_fail(reader, p - reader.buffer.data(), "Control character in string must be escaped.");
+            return false;
+        }
+        // check the escape now, skipping a value must not accept
+        // what json_reader_get_view would refuse to decode
+        reader.has_escapes = true;
+        const char escape = p + 1 < last ? p[1] : '\0';
+        if ( escape == 'u' && json_read_hex4(p + 2, last) >= 0 ) {
+            p += 6;
+        } else if ( escape == '"' || escape == '\\' || escape == '/' || escape == 'b' || escape == 'f' ||
+                    escape == 'n' || escape == 'r' || escape == 't' ) {
+            p += 2;
+        } else {
+            json_reader_fail(reader, p - reader.buffer.data(), p + 1 < last ? "Invalid escape sequence."
+                                                                             : "String without final quotes was detected.");
+            return false;
+        }
+    }
+    reader.text = std::string_view(first, p - first);
+    reader.pos = (p - reader.buffer.data()) + 1;
+    return true;
+}
+
+INTERNAL inline
+bool json_reader_match_literal(JsonReader& reader, std::string_view literal)
+{
+    if ( reader.buffer.substr(reader.pos, literal.size()) != literal ) {
+        json_reader_fail(reader, reader.pos, "invalid character found");
+        return false;
+    }
+    reader.pos += literal.size();
+    return true;
+}
+
+INTERNAL inline
+JsonTokenType json_reader_value(JsonReader& reader)
+{
+    if ( reader.pos >= reader.buffer.size() ) {
+        return json_reader_fail(reader, reader.pos, "Expected a value.");
+    }
+    const char ch = reader.buffer[reader.pos];
+    reader.state = JsonReaderState::AFTER_VALUE;
+    switch ( ch ) {
+        case '{':
+        case '[':
+            if ( reader.containers.size() >= reader.max_depth ) {
+                return json_reader_fail(reader, reader.pos, "Maximum nesting depth exceeded.");
+            }
+            reader.containers.push_back(ch);
+            reader.deepest = std::max(reader.deepest, reader.containers.size());
+            reader.pos++;
+            if ( ch == '{' ) {
+                reader.state = JsonReaderState::FIRST_KEY;
+                reader.token = JsonTokenType::BEGIN_OBJECT;
+            } else {
+                reader.state = JsonReaderState::FIRST_ARRAY_VALUE;
+                reader.token = JsonTokenType::BEGIN_ARRAY;
+            }
+            return reader.token;
+        case '"':
+            if ( !json_reader_scan_string(reader) ) {
+                return reader.token;
+            }
+            reader.token = JsonTokenType::STRING;
+            return reader.token;
+        case 't':
+            reader.token = json_reader_match_literal(reader, "true") ? JsonTokenType::TRUE_VALUE : reader.token;
+            return reader.token;
+        case 'f':
+            reader.token = json_reader_match_literal(reader, "false") ? JsonTokenType::FALSE_VALUE : reader.token;
+            return reader.token;
+        case 'n':
+            reader.token = json_reader_match_literal(reader, "null") ? JsonTokenType::NULL_VALUE : reader.token;
+            return reader.token;
+        default:
+            break;
+    }
+    if ( ch != '-' && !is_digit(ch) ) {
+        return json_reader_fail(reader, reader.pos, "invalid character found");
+    }
+    const char* first = reader.buffer.data() + reader.pos;
+    reader.number = json_scan_number(first, reader.buffer.data() + reader.buffer.size());
+    if ( reader.number.type == JsonItemType::ERROR ) {
+        return json_reader_fail(reader, reader.pos + (reader.number.end - first), reader.number.error_message);
+    }
+    reader.text = std::string_view(first, reader.number.end - first);
+    reader.pos += reader.text.size();
+    reader.token = JsonTokenType::NUMBER;
+    return reader.token;
+}
+
+INTERNAL inline
+JsonTokenType json_reader_key(JsonReader& reader)
+{
+    if ( reader.pos >= reader.buffer.size() || reader.buffer[reader.pos] != '"' ) {
+        return json_reader_fail(reader, reader.pos, "Key must be a string.");
+    }
+    if ( !json_reader_scan_string(reader) ) {
+        return reader.token;
+    }
+    json_reader_eat_whitespace(reader);
+    if ( reader.pos >= reader.buffer.size() || !is_colon(reader.buffer[reader.pos]) ) {
+        return json_reader_fail(reader, reader.pos, "Expected ':' after object key.");
+    }
+    reader.pos++;
+    reader.state = JsonReaderState::VALUE;
+    reader.token = JsonTokenType::KEY;
+    return reader.token;
+}
+
+INTERNAL inline
+JsonTokenType json_reader_close(JsonReader& reader, JsonTokenType token)
+{
+    reader.containers.pop_back();
+    reader.pos++;
+    reader.state = JsonReaderState::AFTER_VALUE;
+    reader.token = token;
+    return reader.token;
+}
+
+// Move on to the next token.  Separators are consumed here
+// so the caller only ever sees keys, values and brackets.
+ENTRYPOINT inline
+JsonTokenType json_reader_next(JsonReader& reader)
+{
+    json_reader_eat_whitespace(reader);
+    const bool at_end = reader.pos >= reader.buffer.size();
+    const char ch = at_end ? '\0' : reader.buffer[reader.pos];
+    switch ( reader.state ) {
+        case JsonReaderState::DONE:
+            return reader.token;
+        case JsonReaderState::VALUE:
+            return json_reader_value(reader);
+        case JsonReaderState::FIRST_KEY:
+            if ( ch == '}' ) {
+                return json_reader_close(reader, JsonTokenType::END_OBJECT);
+            }
+            return json_reader_key(reader);
+        case JsonReaderState::KEY:
+            return json_reader_key(reader);
+        case JsonReaderState::FIRST_ARRAY_VALUE:
+            if ( ch == ']' ) {
+                return json_reader_close(reader, JsonTokenType::END_ARRAY);
+            }
+            return json_reader_value(reader);
+        case JsonReaderState::AFTER_VALUE:
+            break;
+    }
+
+    if ( reader.containers.empty() ) {
+        if ( !at_end ) {
+            return json_reader_fail(reader, reader.pos, "Unexpected characters after the end of the document.");
+        }
+        reader.state = JsonReaderState::DONE;
+        reader.token = JsonTokenType::END_OF_DOCUMENT;
+        return reader.token;
+    }
+    const char container = reader.containers.back();
+    if ( is_comma(ch) ) {
+        reader.pos++;
+        json_reader_eat_whitespace(reader);
+        if ( container == '{' ) {
+            return json_reader_key(reader);
+        }
+        return json_reader_value(reader);
+    }
+    if ( container == '{' && ch == '}' ) {
+        return json_reader_close(reader, JsonTokenType::END_OBJECT);
+    }
+    if ( container == '[' && ch == ']' ) {
+        return json_reader_close(reader, JsonTokenType::END_ARRAY);
+    }
+    return json_reader_fail(reader, reader.pos, container == '{' ? "Expected ',' or '}' in object"
+                                                                 : "Expected ',' or ']' in array");
+}
+
+// Skip over the value that starts at the current token, for
+// containers this runs to the matching close bracket.
+ENTRYPOINT inline
+bool json_reader_skip(JsonReader& reader)
+{
+    if ( reader.token != JsonTokenType::BEGIN_OBJECT && reader.token != JsonTokenType::BEGIN_ARRAY ) {
+        return !reader.error;
+    }
+    const size_t depth = reader.containers.size() - 1;
+    while ( reader.containers.size() > depth ) {
+        if ( json_reader_next(reader) == JsonTokenType::ERROR ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Go back to a value that was already read so it can be read
+// again.  pos is where the value starts and depth the number of
+// containers around it, both as they were before reading it.
+INTERNAL inline
+void json_reader_rewind(JsonReader& reader, size_t pos, size_t depth)
+{
+    reader.pos = pos;
+    reader.containers.resize(depth);
+    reader.state = JsonReaderState::VALUE;
+}
+
+// The current string or key with its escapes decoded.  When
+// there are none this is a view straight into the input,
+// otherwise it points into the reader's arena.  Either way it
+// stays valid until the reader is reset.
+ENTRYPOINT inline
+std::string_view json_reader_get_view(JsonReader& reader)
+{
+    if ( !reader.has_escapes ) {
+        return reader.text;
+    }
+    char* out = json_arena_allocate(reader.arena, reader.text.size());
+    const char* first = reader.text.data();
+    const JsonDecodeResult decoded = json_decode_string(first, first + reader.text.size(), out, true);
+    if ( decoded.error_message != nullptr ) {
+        json_reader_fail(reader, decoded.error_at - reader.buffer.data(), decoded.error_message);
+        return {};
+    }
+    reader.text = std::string_view(out, decoded.end - out);
+    reader.has_escapes = false;
+    return reader.text;
+}
+
+// Copy out the current string or key.
+INTERNAL inline
+std::string json_reader_get_string(JsonReader& reader)
+{
+    return std::string(json_reader_get_view(reader));
+}
+
+#endif /* OAUTH2_JSON_READER_H */
@@ -0,0 +1,230 @@
+#ifndef OAUTH2_JSON_REUSABLE_PARSER_H
+#define OAUTH2_JSON_REUSABLE_PARSER_H
+
+// ----------------------------------------------------------
+// Reusable JSON parser
+// json_create_from_string and json_bind_from_string build new
+// parse state for every document and drop it afterwards.  A
+// JsonParser keeps that state between documents: the frame
+// stack, the reader's container stack and its string arena.
+// Once it has seen a document of a given size, parsing another
+// one like it allocates nothing for the parse itself.  The
+// JsonItem tree returned by json_parser_parse is still new
+// memory every time; binding into a struct that is reused
+// (json_parser_bind) needs none at all.
+// A JsonParser is not thread safe, keep one per thread.
+// ----------------------------------------------------------
+
+#include <algorithm>
+#include <string_view>
+
+#include "json_parser.h"
+#include "json_reader.h"
+#include "json_bind.h"
+#include "macros.h"
+
+// High-water marks over all documents seen by a parser, use
+// them to pick max_depth/max_length or pre-size a parser.
+struct JsonParserStats
+{
+    size_t documents;
+    size_t largest_document;
+    size_t deepest_nesting;
+    // most bytes of decoded (escaped) strings in one document
+    size_t largest_decoded_strings;
+    // memory currently retained by the parser
+    size_t stack_capacity;
+    size_t arena_capacity;
+};
+
+struct JsonParser
+{
+    JsonParseOptions options;
+    JsonParseContext context;
+    JsonReader reader;
+    // true while reader holds a document not yet in stats
+    bool reader_pending;
+    JsonParserStats stats;
+};
+
+INTERNAL inline
+JsonParser json_parser_create(JsonParseOptions const & options = json_default_parse_options())
+{
+    JsonParser parser = JsonParser {};
+    parser.options = options;
+    json_context_reset(parser.context, options);
+    parser.reader = json_reader_create(std::string_view(), options.max_depth);
+    parser.reader_pending = false;
+    return parser;
+}
+
+INTERNAL inline
+void json_parser_record(JsonParser& parser, size_t size, size_t deepest, size_t decoded)
+{
+    parser.stats.documents++;
+    parser.stats.largest_document = std::max(parser.stats.largest_document, size);
+    parser.stats.deepest_nesting = std::max(parser.stats.deepest_nesting, deepest);
+    parser.stats.largest_decoded_strings = std::max(parser.stats.largest_decoded_strings, decoded);
+}
+
+// the reader is driven by the caller, so its document is only
+// counted once we know it is finished with
+INTERNAL inline
+void json_parser_record_reader(JsonParser& parser)
+{
+    if ( parser.reader_pending ) {
+        json_parser_record(parser, parser.reader.buffer.size(), parser.reader.deepest,
+                           parser.reader.arena.allocated);
+        parser.reader_pending = false;
+    }
+}
+
+// Parse a document into a JsonItem tree, see json_create_from_string.
+ENTRYPOINT inline
+JsonItem json_parser_parse(JsonParser& parser, std::string_view buffer)
+{
+    json_context_reset(parser.context, parser.options);
+    JsonItem item = json_parse_with_context(parser.context, buffer);
+    json_parser_record(parser, buffer.size(), parser.context.deepest, 0);
+    return item;
+}
+
+// Start pulling tokens from a new document.  The returned reader
+// belongs to the parser and is valid until the next call, views
+// from json_reader_get_view last as long.
+ENTRYPOINT inline
+JsonReader& json_parser_read(JsonParser& parser, std::string_view buffer)
+{
+    json_parser_record_reader(parser);
+    json_reader_reset(parser.reader, buffer);
+    parser.reader.max_depth = parser.options.max_depth;
+    parser.reader_pending = true;
+    return parser.reader;
+}
+
+// Bind a document into out, see json_bind_from_string.  Strings
+// and vectors in out keep their capacity across calls.
+template<typename T>
+JsonBindResult json_parser_bind(JsonParser& parser, std::string_view buffer, T& out)
+{
+    JsonReader& reader = json_parser_read(parser, buffer);
+    if ( parser.options.max_length != 0 && buffer.size() > parser.options.max_length ) {
+        json_reader_fail(reader, 0, "Document is larger than the maximum allowed length.");
+    }
+    JsonBindResult result = json_bind_from_reader(reader, out);
+    json_parser_record_reader(parser);
+    return result;
+}
+
+ENTRYPOINT inline
+JsonParserStats json_parser_stats(JsonParser& parser)
+{
+    json_parser_record_reader(parser);
+    parser.stats.stack_capacity = parser.context.stack.capacity() * sizeof(JsonParseFrame) +
+                                  parser.reader.containers.capacity();
+    parser.stats.arena_capacity = json_arena_capacity(parser.reader.arena);
+    return parser.stats;
+}
+
+#ifdef TEST_JSON_REUSABLE_PARSER
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// count every allocation so the test can show a warm parser makes none
+static std::atomic<size_t> test_allocations(0);
+
+void* operator new(size_t size)
+{
+    test_allocations++;
+    if ( void* memory = std::malloc(size == 0 ? 1 : size) ) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+struct TestToken
+{
+    std::string access_token;
+    std::string token_type;
+    std::int64_t expires_in;
+    std::optional<std::string> refresh_token;
+    std::vector<std::string> scopes;
+};
+
+JSON_BINDING(TestToken,
+    JSON_FIELD(TestToken, access_token, JSON_REQUIRED),
+    JSON_FIELD(TestToken, token_type, JSON_REQUIRED),
+    JSON_FIELD(TestToken, expires_in, JSON_OPTIONAL),
+    JSON_FIELD(TestToken, refresh_token, JSON_OPTIONAL),
+    JSON_FIELD(TestToken, scopes, JSON_OPTIONAL));
+
+int main()
+{
+    const std::string response =
+        "{ \"access_token\": \"ya29.a0AfH6SMBx\\u002Fq7ZlongerthanSSOlongerthanSSO\", \"token_type\": \"Bearer\","
+        " \"expires_in\": 3599, \"refresh_token\": \"1//0gLongRefreshTokenValueThatIsNotSmall\","
+        " \"scopes\": [\"openid\", \"https://www.googleapis.com/auth/cloud-platform\"], \"extra\": {\"a\": [1, 2]} }";
+
+    int failures = 0;
+    JsonParser parser = json_parser_create();
+    TestToken token = TestToken {};
+    // the first document warms the parser and the struct up
+    json_parser_bind(parser, response, token);
+    const size_t before = test_allocations;
+    for ( int ii = 0; ii < 1000; ii++ ) {
+        const JsonBindResult result = json_parser_bind(parser, response, token);
+        if ( result.error ) {
+            std::cout << result.error_message << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+    const size_t warm_allocations = test_allocations - before;
+    std::cout << "allocations while warm: " << warm_allocations << '\n';
+    failures += warm_allocations != 0;
+    std::cout << token.access_token << ' ' << token.expires_in << ' ' << *token.refresh_token << ' '
+              << token.scopes.size() << '\n';
+    failures += token.access_token != "ya29.a0AfH6SMBx/q7ZlongerthanSSOlongerthanSSO" || token.token_type != "Bearer";
+    failures += token.expires_in != 3599 || token.refresh_token != "1//0gLongRefreshTokenValueThatIsNotSmall";
+    failures += token.scopes.size() != 2 || token.scopes[1] != "https://www.googleapis.com/auth/cloud-platform";
+
+    // fields missing from the next document do not keep old values
+    json_parser_bind(parser, "{\"access_token\": \"a\", \"token_type\": \"Bearer\"}", token);
+    std::cout << token.refresh_token.has_value() << ' ' << token.scopes.size() << ' ' << token.expires_in << '\n';
+    failures += token.access_token != "a" || token.refresh_token.has_value() || !token.scopes.empty() ||
+                token.expires_in != 0;
+
+    // the DOM parser reuses its stack
+    for ( int ii = 0; ii < 10; ii++ ) {
+        failures += json_parser_parse(parser, response).object.size() != 6;
+    }
+    JsonItem item = json_parser_parse(parser, "[[[1]]]");
+    std::cout << json_to_string(item) << '\n';
+    failures += json_to_string(item) != "[[[1]]]";
+    item = json_parser_parse(parser, "[1 2]");
+    std::cout << item.text << '\n';
+    failures += item.type != JsonItemType::ERROR || item.text != "Error at 3,3: Expected ']' for end of array";
+
+    const JsonParserStats stats = json_parser_stats(parser);
+    std::cout << "documents " << stats.documents << ", largest " << stats.largest_document
+              << ", deepest " << stats.deepest_nesting << ", decoded " << stats.largest_decoded_strings
+              << ", arena " << stats.arena_capacity << '\n';
+    // 1001 binds of response, one short one, 10 + 2 parses
+    failures += stats.documents != 1014 || stats.largest_document != response.size() || stats.deepest_nesting != 3;
+    failures += stats.largest_decoded_strings == 0 || stats.arena_capacity == 0 || stats.stack_capacity == 0;
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_JSON_REUSABLE_PARSER_H */
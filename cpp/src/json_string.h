@@ -0,0 +1,325 @@
+#ifndef OAUTH2_JSON_STRING_H
+#define OAUTH2_JSON_STRING_H
+
+// ----------------------------------------------------------
+// JSON string kernels
+// Finding the end of a string is where a parser spends most
+// of its time on token responses (JWTs are long strings), so
+// the scan looks at 32 (AVX2) or 16 (SSE2/NEON) bytes per
+// step and only falls back to a byte loop for the tail.
+// Escapes are decoded in a single pass into memory that the
+// caller provides, the decoded text is never longer than the
+// raw text so the raw length is always enough room.
+// ----------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define JSON_STRING_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSON_STRING_NEON 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "macros.h"
+
+INTERNAL inline
+unsigned json_count_trailing_zeros(std::uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Returns the first byte in [p, end) that is the closing quote,
+// a backslash or a control character (< 0x20), or end if there
+// is none.
+INTERNAL inline
+const char* json_find_string_special(const char* p, const char* end, char quote)
+{
+#if defined(__AVX2__)
+    {
+        const __m256i quotes = _mm256_set1_epi8(quote);
+        const __m256i backslashes = _mm256_set1_epi8('\\');
+        const __m256i control = _mm256_set1_epi8(0x1F);
+        while ( end - p >= 32 ) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            // unsigned chunk <= 0x1F is the same as min(chunk, 0x1F) == chunk
+            const __m256i special = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quotes), _mm256_cmpeq_epi8(chunk, backslashes)),
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+            const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(special));
+            if ( mask != 0 ) {
+                return p + json_count_trailing_zeros(mask);
+            }
+            p += 32;
+        }
+    }
+#endif
+#if defined(JSON_STRING_SSE2)
+    {
+        const __m128i quotes = _mm_set1_epi8(quote);
+        const __m128i backslashes = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1F);
+        while ( end - p >= 16 ) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const __m128i special = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, quotes), _mm_cmpeq_epi8(chunk, backslashes)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+            const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(special));
+            if ( mask != 0 ) {
+                return p + json_count_trailing_zeros(mask);
+            }
+            p += 16;
+        }
+    }
+#elif defined(JSON_STRING_NEON)
+    {
+        const uint8x16_t quotes = vdupq_n_u8(static_cast<std::uint8_t>(quote));
+        const uint8x16_t backslashes = vdupq_n_u8('\\');
+        const uint8x16_t control = vdupq_n_u8(0x20);
+        while ( end - p >= 16 ) {
+            const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+            const uint8x16_t special = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quotes), vceqq_u8(chunk, backslashes)),
+                                                vcltq_u8(chunk, control));
+            // NEON has no movemask, find the byte with the scalar loop
+            if ( vmaxvq_u8(special) != 0 ) {
+                break;
+            }
+            p += 16;
+        }
+    }
+#endif
+    for ( ; p < end; p++ ) {
+        const auto ch = static_cast<unsigned char>(*p);
+        if ( ch == static_cast<unsigned char>(quote) || ch == '\\' || ch < 0x20 ) {
+            return p;
+        }
+    }
+    return end;
+}
+
+// FNV-1a mixed with a seed.  Used for object keys, with a seed
+// chosen at run time (json_runtime_key_hash), and for the compile
+// time tables of json_bind, where it is good enough to find a
+// collision free seed quickly for a handful of keys.
+constexpr std::uint32_t json_key_hash(std::string_view key, std::uint32_t seed)
+{
+    std::uint32_t hash = 2166136261u ^ seed;
+    for ( char ch : key ) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+INTERNAL inline
+int json_hex_value(char ch)
+{
+    if ( ch >= '0' && ch <= '9' ) {
+        return ch - '0';
+    }
+    if ( ch >= 'a' && ch <= 'f' ) {
+        return ch - 'a' + 10;
+    }
+    if ( ch >= 'A' && ch <= 'F' ) {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+// reads the four hex digits of a \uXXXX escape, -1 if invalid
+INTERNAL inline
+long json_read_hex4(const char* p, const char* end)
+{
+    if ( end - p < 4 ) {
+        return -1;
+    }
+    long value = 0;
+    for ( int ii = 0; ii < 4; ii++ ) {
+        const int digit = json_hex_value(p[ii]);
+        if ( digit < 0 ) {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+INTERNAL inline
+char* json_append_utf8(char* out, std::uint32_t code_point)
+{
+    if ( code_point < 0x80 ) {
+        *out++ = static_cast<char>(code_point);
+    } else if ( code_point < 0x800 ) {
+        *out++ = static_cast<char>(0xC0 | (code_point >> 6));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if ( code_point < 0x10000 ) {
+        *out++ = static_cast<char>(0xE0 | (code_point >> 12));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (code_point >> 18));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    return out;
+}
+
+struct JsonDecodeResult
+{
+    // one past the last decoded byte written
+    char* end;
+    // null on success, otherwise what went wrong and where
+    const char* error_message;
+    const char* error_at;
+};
+
+// Decode the raw text between the quotes of a string into out,
+// which must have room for last - first bytes.  In lenient mode
+// an unknown escape such as \q just produces the q.  A lone
+// UTF-16 surrogate is replaced by U+FFFD.
+INTERNAL inline
+JsonDecodeResult json_decode_string(const char* first, const char* last, char* out, bool strict)
+{
+    JsonDecodeResult result = JsonDecodeResult {};
+    const char* p = first;
+    while ( p < last ) {
+        // copy everything up to the next backslash in one go
+        const char* backslash = static_cast<const char*>(std::memchr(p, '\\', last - p));
+        if ( backslash == nullptr ) {
+            backslash = last;
+        }
+        std::memcpy(out, p, backslash - p);
+        out += backslash - p;
+        p = backslash;
+        if ( p >= last ) {
+            break;
+        }
+        if ( p + 1 >= last ) {
+            result.error_message = "Incomplete escape sequence.";
+            result.error_at = p;
+            return result;
+        }
+        const char escape = p[1];
+        p += 2;
+        switch ( escape ) {
+            case '"':  *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/'; break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            case 'u': {
+                long code_point = json_read_hex4(p, last);
+                if ( code_point < 0 ) {
+                    result.error_message = "Invalid \\u escape, four hex digits expected.";
+                    result.error_at = p - 2;
+                    return result;
+                }
+                p += 4;
+                if ( code_point >= 0xD800 && code_point <= 0xDBFF ) {
+                    // high surrogate, must be followed by \u and a low one
+                    const long low = (last - p >= 6 && p[0] == '\\' && p[1] == 'u') ? json_read_hex4(p + 2, last) : -1;
+                    if ( low >= 0xDC00 && low <= 0xDFFF ) {
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    } else {
+                        code_point = 0xFFFD;
+                    }
+                } else if ( code_point >= 0xDC00 && code_point <= 0xDFFF ) {
+                    code_point = 0xFFFD;
+                }
+                out = json_append_utf8(out, static_cast<std::uint32_t>(code_point));
+                break;
+            }
+            default:
+                if ( strict ) {
+                    result.error_message = "Invalid escape sequence.";
+                    result.error_at = p - 2;
+                    return result;
+                }
+                *out++ = escape;
+                break;
+        }
+    }
+    result.end = out;
+    return result;
+}
+
+// ----------------------------------------------------------
+// Arena for decoded strings
+// Memory is handed out from large blocks and only given back
+// all at once by json_arena_reset, which keeps the blocks so a
+// reused arena stops allocating once it is warm.
+// ----------------------------------------------------------
+
+struct JsonArena
+{
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> block_sizes;
+    size_t block;
+    size_t used;
+    // total handed out since the last reset, for statistics
+    size_t allocated;
+};
+
+constexpr size_t JSON_ARENA_BLOCK_SIZE = 16 * 1024;
+
+INTERNAL inline
+char* json_arena_allocate(JsonArena& arena, size_t size)
+{
+    while ( arena.block < arena.blocks.size() ) {
+        if ( arena.block_sizes[arena.block] - arena.used >= size ) {
+            char* memory = arena.blocks[arena.block].get() + arena.used;
+            arena.used += size;
+            arena.allocated += size;
+            return memory;
+        }
+        arena.block++;
+        arena.used = 0;
+    }
+    const size_t block_size = size > JSON_ARENA_BLOCK_SIZE ? size : JSON_ARENA_BLOCK_SIZE;
+    arena.blocks.push_back(std::unique_ptr<char[]>(new char[block_size]));
+    arena.block_sizes.push_back(block_size);
+    arena.block = arena.blocks.size() - 1;
+    arena.used = size;
+    arena.allocated += size;
+    return arena.blocks.back().get();
+}
+
+INTERNAL inline
+void json_arena_reset(JsonArena& arena)
+{
+    arena.block = 0;
+    arena.used = 0;
+    arena.allocated = 0;
+}
+
+INTERNAL inline
+size_t json_arena_capacity(JsonArena const & arena)
+{
+    size_t capacity = 0;
+    for ( size_t size : arena.block_sizes ) {
+        capacity += size;
+    }
+    return capacity;
+}
+
+#endif /* OAUTH2_JSON_STRING_H */
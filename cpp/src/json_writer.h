@@ -0,0 +1,285 @@
+#ifndef OAUTH2_JSON_WRITER_H
+#define OAUTH2_JSON_WRITER_H
+
+// ----------------------------------------------------------
+// Tiny JSON Writer
+// Same C-style as the parser: a plain struct holding the
+// state and a set of json_writer_* functions acting on it.
+//
+// Everything is appended into a single std::string buffer
+// which keeps its capacity between documents.  When a sink
+// is given the buffer is handed over to it every time it
+// grows past flush_threshold, so large outputs (structured
+// logs, token caches) never have to be held in memory.
+// ----------------------------------------------------------
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <charconv>
+#include <cstdint>
+#include <cmath>
+
+#include "macros.h"
+
+enum class JsonWriteMode {
+    COMPACT = 0,
+    PRETTY
+};
+
+using JsonSink = std::function<void(const char*, size_t)>;
+
+struct JsonWriter
+{
+    std::string buffer;
+    JsonWriteMode mode;
+    size_t indent_width;
+    size_t depth;
+    // true until the first value has been written into the
+    // container we are currently in, tells us whether we need
+    // a comma (and in pretty mode a newline before the close)
+    bool first;
+    // a key has just been written so the next value follows
+    // the ':' rather than a comma
+    bool after_key;
+    JsonSink sink;
+    size_t flush_threshold;
+};
+
+INTERNAL inline
+JsonWriter json_writer_create(JsonWriteMode mode = JsonWriteMode::COMPACT, JsonSink sink = nullptr)
+{
+    JsonWriter writer = JsonWriter {};
+    writer.mode = mode;
+    writer.indent_width = 2;
+    writer.depth = 0;
+    writer.first = true;
+    writer.after_key = false;
+    writer.sink = std::move(sink);
+    writer.flush_threshold = 64 * 1024;
+    return writer;
+}
+
+// Clear the state so the writer can be used for the next
+// document, the buffer keeps its capacity.
+INTERNAL inline
+void json_writer_reset(JsonWriter& writer)
+{
+    writer.buffer.clear();
+    writer.depth = 0;
+    writer.first = true;
+    writer.after_key = false;
+}
+
+INTERNAL inline
+void json_writer_flush(JsonWriter& writer)
+{
+    if ( writer.sink && !writer.buffer.empty() ) {
+        writer.sink(writer.buffer.data(), writer.buffer.size());
+        writer.buffer.clear();
+    }
+}
+
+INTERNAL inline
+void json_writer_maybe_flush(JsonWriter& writer)
+{
+    if ( writer.sink && writer.buffer.size() >= writer.flush_threshold ) {
+        json_writer_flush(writer);
+    }
+}
+
+INTERNAL inline
+void json_writer_newline(JsonWriter& writer)
+{
+    writer.buffer += '\n';
+    writer.buffer.append(writer.depth * writer.indent_width, ' ');
+}
+
+// Called before every key or value to emit the separator
+// that goes in front of it.
+INTERNAL inline
+void json_writer_prefix(JsonWriter& writer)
+{
+    if ( writer.after_key ) {
+        writer.after_key = false;
+        return;
+    }
+    if ( !writer.first ) {
+        writer.buffer += ',';
+    }
+    if ( writer.mode == JsonWriteMode::PRETTY && writer.depth > 0 ) {
+        json_writer_newline(writer);
+    }
+    writer.first = false;
+}
+
+// Characters that must be escaped inside a JSON string, see
+// RFC 8259 section 7.  Zero means the byte is copied as is,
+// otherwise it is the character following the backslash
+// ('u' meaning a \u00XX sequence).
+constexpr char json_escape_table[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+INTERNAL inline
+void json_writer_append_escaped(JsonWriter& writer, std::string_view text)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    writer.buffer += '"';
+    size_t run_start = 0;
+    for ( size_t ii = 0; ii < text.size(); ii++ ) {
+        const char escape = json_escape_table[static_cast<unsigned char>(text[ii])];
+        if ( escape == 0 ) {
+            continue;
+        }
+        // copy the clean run in one go then the escape itself
+        writer.buffer.append(text.data() + run_start, ii - run_start);
+        writer.buffer += '\\';
+        writer.buffer += escape;
+        if ( escape == 'u' ) {
+            const auto ch = static_cast<unsigned char>(text[ii]);
+            writer.buffer += "00";
+            writer.buffer += hex[ch >> 4];
+            writer.buffer += hex[ch & 0x0F];
+        }
+        run_start = ii + 1;
+    }
+    writer.buffer.append(text.data() + run_start, text.size() - run_start);
+    writer.buffer += '"';
+}
+
+INTERNAL inline
+void json_writer_begin_object(JsonWriter& writer)
+{
+    json_writer_prefix(writer);
+    writer.buffer += '{';
+    writer.depth++;
+    writer.first = true;
+}
+
+INTERNAL inline
+void json_writer_end_object(JsonWriter& writer)
+{
+    writer.depth--;
+    if ( writer.mode == JsonWriteMode::PRETTY && !writer.first ) {
+        json_writer_newline(writer);
+    }
+    writer.buffer += '}';
+    writer.first = false;
+    json_writer_maybe_flush(writer);
+}
+
+INTERNAL inline
+void json_writer_begin_array(JsonWriter& writer)
+{
+    json_writer_prefix(writer);
+    writer.buffer += '[';
+    writer.depth++;
+    writer.first = true;
+}
+
+INTERNAL inline
+void json_writer_end_array(JsonWriter& writer)
+{
+    writer.depth--;
+    if ( writer.mode == JsonWriteMode::PRETTY && !writer.first ) {
+        json_writer_newline(writer);
+    }
+    writer.buffer += ']';
+    writer.first = false;
+    json_writer_maybe_flush(writer);
+}
+
+INTERNAL inline
+void json_writer_key(JsonWriter& writer, std::string_view key)
+{
+    json_writer_prefix(writer);
+    json_writer_append_escaped(writer, key);
+    writer.buffer += writer.mode == JsonWriteMode::PRETTY ? ": " : ":";
+    writer.after_key = true;
+}
+
+INTERNAL inline
+void json_writer_string(JsonWriter& writer, std::string_view text)
+{
+    json_writer_prefix(writer);
+    json_writer_append_escaped(writer, text);
+    json_writer_maybe_flush(writer);
+}
+
+INTERNAL inline
+void json_writer_integer(JsonWriter& writer, std::int64_t value)
+{
+    json_writer_prefix(writer);
+    char digits[24];
+    auto [ptr, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    writer.buffer.append(digits, ptr - digits);
+    json_writer_maybe_flush(writer);
+}
+
+INTERNAL inline
+void json_writer_real(JsonWriter& writer, double value)
+{
+    json_writer_prefix(writer);
+    // JSON has no representation for these
+    if ( !std::isfinite(value) ) {
+        writer.buffer += "null";
+        json_writer_maybe_flush(writer);
+        return;
+    }
+    // shortest representation that reads back to the same double
+    char digits[32];
+    auto [ptr, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    const std::string_view text(digits, ptr - digits);
+    writer.buffer += text;
+    // keep it a float when it is read back in
+    if ( text.find_first_of(".e") == std::string_view::npos ) {
+        writer.buffer += ".0";
+    }
+    json_writer_maybe_flush(writer);
+}
+
+INTERNAL inline
+void json_writer_boolean(JsonWriter& writer, bool value)
+{
+    json_writer_prefix(writer);
+    writer.buffer += value ? "true" : "false";
+    json_writer_maybe_flush(writer);
+}
+
+INTERNAL inline
+void json_writer_null(JsonWriter& writer)
+{
+    json_writer_prefix(writer);
+    writer.buffer += "null";
+    json_writer_maybe_flush(writer);
+}
+
+// Insert text that is already valid JSON, e.g. a cached
+// document we do not want to parse again.
+INTERNAL inline
+void json_writer_raw(JsonWriter& writer, std::string_view json)
+{
+    json_writer_prefix(writer);
+    writer.buffer += json;
+    json_writer_maybe_flush(writer);
+}
+
+// Finish a top level value and start the next one on a new
+// line, this is how we produce JSON Lines output.
+INTERNAL inline
+void json_writer_end_document(JsonWriter& writer)
+{
+    writer.buffer += '\n';
+    writer.depth = 0;
+    writer.first = true;
+    writer.after_key = false;
+    json_writer_maybe_flush(writer);
+}
+
+#endif /* OAUTH2_JSON_WRITER_H */
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cctype>
+#include <openssl/bn.h>
+#include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/param_build.h>
+#else
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rsa.h>
+#endif
+#include "base64url.h"
+#include "jwks.h"
+
+static bool jwk_decode(std::string_view text, std::string &out) {
+    out.clear();
+    return !text.empty() && base64url_decode_append(out, text);
+}
+
+static BIGNUM *jwk_bignum(std::string const &bytes) {
+    return BN_bin2bn(reinterpret_cast<const unsigned char *>(bytes.data()), static_cast<int>(bytes.size()), nullptr);
+}
+
+static JwtKey jwk_rsa_key(Jwk const &jwk) {
+    std::string n;
+    std::string e;
+    if (!jwk_decode(jwk.n, n) || !jwk_decode(jwk.e, e)) {
+        return nullptr;
+    }
+    BIGNUM *modulus = jwk_bignum(n);
+    BIGNUM *exponent = jwk_bignum(e);
+    EVP_PKEY *key = nullptr;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM_BLD *build = OSSL_PARAM_BLD_new();
+    OSSL_PARAM *params = nullptr;
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_from_name(nullptr, "RSA", nullptr);
+    if (modulus && exponent && build && context &&
+        OSSL_PARAM_BLD_push_BN(build, OSSL_PKEY_PARAM_RSA_N, modulus) == 1 &&
+        OSSL_PARAM_BLD_push_BN(build, OSSL_PKEY_PARAM_RSA_E, exponent) == 1 &&
+        (params = OSSL_PARAM_BLD_to_param(build)) != nullptr &&
+        EVP_PKEY_fromdata_init(context) == 1) {
+        EVP_PKEY_fromdata(context, &key, EVP_PKEY_PUBLIC_KEY, params);
+    }
+    EVP_PKEY_CTX_free(context);
+    OSSL_PARAM_free(params);
+    OSSL_PARAM_BLD_free(build);
+    BN_free(modulus);
+    BN_free(exponent);
+#else
+    RSA *rsa = RSA_new();
+    if (modulus && exponent && rsa && RSA_set0_key(rsa, modulus, exponent, nullptr) == 1) {
+        modulus = exponent = nullptr; // owned by rsa now
+        key = EVP_PKEY_new();
+        if (key && EVP_PKEY_assign_RSA(key, rsa) == 1) {
+            rsa = nullptr;
+        }
+    }
+    RSA_free(rsa);
+    BN_free(modulus);
+    BN_free(exponent);
+#endif
+    return key ? JwtKey(key, EVP_PKEY_free) : nullptr;
+}
+
+static JwtKey jwk_ec_key(Jwk const &jwk) {
+    std::string x;
+    std::string y;
+    if (jwk.crv != "P-256" || !jwk_decode(jwk.x, x) || !jwk_decode(jwk.y, y) || x.size() != 32 || y.size() != 32) {
+        return nullptr;
+    }
+    EVP_PKEY *key = nullptr;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // uncompressed point, 0x04 x y
+    const std::string point = '\x04' + x + y;
+    OSSL_PARAM_BLD *build = OSSL_PARAM_BLD_new();
+    OSSL_PARAM *params = nullptr;
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_from_name(nullptr, "EC", nullptr);
+    if (build && context &&
+        OSSL_PARAM_BLD_push_utf8_string(build, OSSL_PKEY_PARAM_GROUP_NAME, "P-256", 0) == 1 &&
+        OSSL_PARAM_BLD_push_octet_string(build, OSSL_PKEY_PARAM_PUB_KEY, point.data(), point.size()) == 1 &&
+        (params = OSSL_PARAM_BLD_to_param(build)) != nullptr &&
+        EVP_PKEY_fromdata_init(context) == 1) {
+        EVP_PKEY_fromdata(context, &key, EVP_PKEY_PUBLIC_KEY, params);
+    }
+    EVP_PKEY_CTX_free(context);
+    OSSL_PARAM_free(params);
+    OSSL_PARAM_BLD_free(build);
+#else
+    EC_KEY *ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    BIGNUM *bx = jwk_bignum(x);
+    BIGNUM *by = jwk_bignum(y);
+    // also checks that the point is on the curve
+    if (ec && bx && by && EC_KEY_set_public_key_affine_coordinates(ec, bx, by) == 1) {
+        key = EVP_PKEY_new();
+        if (key && EVP_PKEY_assign_EC_KEY(key, ec) == 1) {
+            ec = nullptr;
+        }
+    }
+    EC_KEY_free(ec);
+    BN_free(bx);
+    BN_free(by);
+#endif
+    return key ? JwtKey(key, EVP_PKEY_free) : nullptr;
+}
+
+static JwtKey jwk_okp_key(Jwk const &jwk) {
+    std::string x;
+    int type = 0;
+    if (jwk.crv == "Ed25519") {
+        type = EVP_PKEY_ED25519;
+    } else if (jwk.crv == "Ed448") {
+        type = EVP_PKEY_ED448;
+    }
+    if (type == 0 || !jwk_decode(jwk.x, x)) {
+        return nullptr;
+    }
+    EVP_PKEY *key = EVP_PKEY_new_raw_public_key(type, nullptr, reinterpret_cast<const unsigned char *>(x.data()),
+                                                x.size());
+    return key ? JwtKey(key, EVP_PKEY_free) : nullptr;
+}
+
+std::pair<JwtKey, JwtAlgorithm> jwk_to_key(Jwk const &jwk) {
+    if (!jwk.use.empty() && jwk.use != "sig") {
+        return {nullptr, JwtAlgorithm::UNSUPPORTED};
+    }
+    JwtKey key;
+    JwtAlgorithm algorithm = JwtAlgorithm::UNSUPPORTED;
+    if (jwk.kty == "RSA") {
+        key = jwk_rsa_key(jwk);
+        algorithm = JwtAlgorithm::RS256;
+    } else if (jwk.kty == "EC") {
+        key = jwk_ec_key(jwk);
+        algorithm = JwtAlgorithm::ES256;
+    } else if (jwk.kty == "OKP") {
+        key = jwk_okp_key(jwk);
+        algorithm = JwtAlgorithm::EDDSA;
+    }
+    // an RSA key for RS512, say, is not one we can check with
+    if (!key || (!jwk.alg.empty() && jwt_algorithm(jwk.alg) != algorithm)) {
+        return {nullptr, JwtAlgorithm::UNSUPPORTED};
+    }
+    return {key, algorithm};
+}
+
+long cache_control_max_age(std::string_view cache_control) {
+    std::string lower(cache_control);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (lower.find("no-store") != std::string::npos || lower.find("no-cache") != std::string::npos) {
+        return 0;
+    }
+    size_t pos = lower.find("max-age=");
+    // not s-maxage, that one is for shared caches
+    if (pos == std::string::npos || (pos > 0 && lower[pos - 1] == '-')) {
+        return -1;
+    }
+    pos += 8;
+    long seconds = 0;
+    size_t digits = 0;
+    for (; pos < lower.size() && std::isdigit(static_cast<unsigned char>(lower[pos])) && digits < 10; pos++, digits++) {
+        seconds = seconds * 10 + (lower[pos] - '0');
+    }
+    return digits == 0 ? -1 : seconds;
+}
+
+JwksCache::JwksCache(std::string jwks_uri, JwksFetcher fetcher, JwksOptions options)
+        : JwksCache(std::move(jwks_uri), std::move(fetcher), JwksDocument(), options) {
+}
+
+JwksCache::JwksCache(std::string jwks_uri, JwksFetcher fetcher, JwksDocument const &known, JwksOptions options)
+        : uri_(std::move(jwks_uri)), fetcher_(std::move(fetcher)), options_(options),
+          keys_(std::make_shared<const KeySet>()), loaded_once_(false), refetch_requested_(false), fetching_(false),
+          last_fetch_ok_(false), stopping_(false), fetches_(0), next_fetch_(Clock::now()), last_fetch_() {
+    // no thread yet, nothing else can see the keys
+    const long max_age = known.body.empty() ? -1 : publish_(known);
+    if (max_age >= 0) {
+        // already past its max-age means fetching straight away
+        next_fetch_ = Clock::now() - known.age + std::clamp(std::chrono::seconds(max_age), options_.min_max_age,
+                                                            options_.max_max_age);
+        loaded_once_ = true;
+    }
+    thread_ = std::thread([this] { run_(); });
+}
+
+JwksCache::~JwksCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+JwtKey JwksCache::find(std::string_view kid, JwtAlgorithm algorithm) {
+    std::shared_ptr<const KeySet> keys;
+    {
+        std::shared_lock<std::shared_mutex> lock(keys_mutex_);
+        keys = keys_;
+    }
+    const auto found = std::lower_bound(keys->begin(), keys->end(), kid,
+                                        [](Entry const &entry, std::string_view key) { return entry.kid < key; });
+    if (found != keys->end() && found->kid == kid) {
+        return found->algorithm == algorithm ? found->key : nullptr;
+    }
+    // probably rotated, ask for the new set but do not wait for it
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!refetch_requested_ && Clock::now() - last_fetch_ >= options_.min_refetch_interval) {
+            refetch_requested_ = true;
+            wake = true;
+        }
+    }
+    if (wake) {
+        wake_.notify_one();
+    }
+    return nullptr;
+}
+
+JwtKeyLookup JwksCache::lookup() {
+    return [this](std::string_view kid, JwtAlgorithm algorithm) { return find(kid, algorithm); };
+}
+
+bool JwksCache::wait_until_loaded(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return loaded_.wait_for(lock, timeout, [this] { return loaded_once_; });
+}
+
+bool JwksCache::refresh_and_wait(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // a set fetched moments ago is as new as another fetch would get
+    if (!fetching_ && !refetch_requested_ && last_fetch_ok_ &&
+        Clock::now() - last_fetch_ < options_.min_refetch_interval) {
+        return true;
+    }
+    // one under way may have started before whatever made us ask
+    const size_t target = fetches_ + (fetching_ ? 2 : 1);
+    refetch_requested_ = true;
+    wake_.notify_one();
+    return loaded_.wait_for(lock, timeout, [&] { return stopping_ || fetches_ >= target; }) && !stopping_ &&
+           last_fetch_ok_;
+}
+
+size_t JwksCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(keys_mutex_);
+    return keys_->size();
+}
+
+size_t JwksCache::fetches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fetches_;
+}
+
+long JwksCache::fetch_() {
+    JwksDocument document;
+    try {
+        if (!fetcher_(uri_, document)) {
+            return -1;
+        }
+    } catch (std::exception const &) {
+        return -1;
+    }
+    return publish_(document);
+}
+
+long JwksCache::publish_(JwksDocument const &document) {
+    JwkSet set;
+    if (json_bind_from_string(document.body, set).error) {
+        return -1;
+    }
+    // all the parsing happens here, once per fetch
+    auto keys = std::make_shared<KeySet>();
+    for (Jwk const &jwk : set.keys) {
+        std::pair<JwtKey, JwtAlgorithm> key = jwk_to_key(jwk);
+        if (key.first) {
+            keys->push_back(Entry{jwk.kid, std::move(key.first), key.second});
+        }
+    }
+    std::sort(keys->begin(), keys->end(), [](Entry const &a, Entry const &b) { return a.kid < b.kid; });
+    {
+        std::unique_lock<std::shared_mutex> lock(keys_mutex_);
+        keys_ = std::move(keys);
+    }
+    const long max_age = cache_control_max_age(document.cache_control);
+    return max_age < 0 ? static_cast<long>(options_.default_max_age.count()) : max_age;
+}
+
+void JwksCache::run_() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait_until(lock, next_fetch_, [this] { return stopping_ || refetch_requested_; });
+        if (stopping_) {
+            return;
+        }
+        if (!refetch_requested_ && Clock::now() < next_fetch_) {
+            continue;
+        }
+        last_fetch_ = Clock::now();
+        // a request made during the fetch gets another one
+        refetch_requested_ = false;
+        fetching_ = true;
+        lock.unlock();
+        const long max_age = fetch_();
+        lock.lock();
+        fetching_ = false;
+        fetches_++;
+        last_fetch_ok_ = max_age >= 0;
+        if (max_age < 0) {
+            next_fetch_ = Clock::now() + options_.retry;
+        } else {
+            const std::chrono::seconds age = std::clamp(std::chrono::seconds(max_age), options_.min_max_age,
+                                                        options_.max_max_age);
+            next_fetch_ = Clock::now() + age;
+            loaded_once_ = true;
+        }
+        loaded_.notify_all();
+    }
+}
+
+#ifdef TEST_JWKS
+#include <atomic>
+#include <iostream>
+
+int main() {
+    // RFC 7517 appendix A.1, plus an Ed25519 key from RFC 8037 and
+    // keys we have to skip
+    const std::string first = R"({"keys": [
+        {"kty":"EC", "crv":"P-256", "x":"MKBCTNIcKUSDii11ySs3526iDZ8AiTo7Tu6KPAqv7D4",
+         "y":"4Etl6SRW2YiLUrN5vfvVHuhp7x8PxltmWWlbbM4IFyM", "use":"enc", "kid":"1"},
+        {"kty":"RSA", "n":"0vx7agoebGcQSuuPiLJXZptN9nndrQmbXEps2aiAFbWhM78LhWx4cbbfAAtVT86zwu1RK7aPFFxuhDR1L6tSoc_BJECPebWKRXjBZCiFV4n3oknjhMstn64tZ_2W-5JsGY4Hc5n9yBXArwl93lqt7_RN5w6Cf0h4QyQ5v-65YGjQR0_FDW2QvzqY368QQMicAtaSqzs8KJZgnYb9c7d0zgdAZHzu6qMQvRL5hajrn1n91CbOpbISD08qNLyrdkt-bFTWhAI4vMQFh6WeZu0fM4lFd2NcRwr3XPksINHaQ-G_xBniIqbw0Ls1jF44-csFCur-kEgU8awapJzKnqDKgw",
+         "e":"AQAB", "alg":"RS256", "kid":"2011-04-29"},
+        {"kty":"OKP", "crv":"Ed25519", "x":"11qYAYKxCrfVS_7TyWQHOg7hcvPapiMlrwIaaPcHURo", "kid":"ed"},
+        {"kty":"RSA", "n":"AQAB", "e":"AQAB", "alg":"RS512", "kid":"rs512"},
+        {"kty":"oct", "k":"c2VjcmV0", "kid":"hmac"}
+    ]})";
+    const std::string second = R"({"keys": [
+        {"kty":"EC", "crv":"P-256", "x":"MKBCTNIcKUSDii11ySs3526iDZ8AiTo7Tu6KPAqv7D4",
+         "y":"4Etl6SRW2YiLUrN5vfvVHuhp7x8PxltmWWlbbM4IFyM", "use":"sig", "kid":"rotated"}
+    ]})";
+    std::atomic<int> calls(0);
+    JwksOptions options;
+    options.min_refetch_interval = std::chrono::seconds(0);
+    JwksCache cache("https://issuer.example.com/jwks", [&](std::string const &, JwksDocument &document) {
+        document.body = calls++ == 0 ? first : second;
+        document.cache_control = "public, max-age=86400";
+        return true;
+    }, options);
+
+    int failures = !cache.wait_until_loaded(std::chrono::seconds(5));
+    std::cout << "keys: " << cache.size() << '\n';
+    failures += cache.size() != 2;
+    failures += cache.find("2011-04-29", JwtAlgorithm::RS256) == nullptr;
+    failures += cache.find("ed", JwtAlgorithm::EDDSA) == nullptr;
+    failures += cache.find("ed", JwtAlgorithm::RS256) != nullptr;
+
+    // many lookups for an unknown kid, one fetch
+    for (int ii = 0; ii < 100; ii++) {
+        cache.find("rotated", JwtAlgorithm::ES256);
+    }
+    for (int ii = 0; ii < 100 && cache.find("rotated", JwtAlgorithm::ES256) == nullptr; ii++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << "fetches: " << cache.fetches() << ", rotated: " << (cache.find("rotated", JwtAlgorithm::ES256) != nullptr)
+              << '\n';
+    failures += cache.fetches() != 2 || cache.find("rotated", JwtAlgorithm::ES256) == nullptr;
+
+    // a known set is there at once and is not fetched again yet
+    std::atomic<int> seeded_calls(0);
+    JwksCache seeded("https://issuer.example.com/jwks", [&](std::string const &, JwksDocument &) {
+        seeded_calls++;
+        return false;
+    }, JwksDocument{first, "max-age=3600"});
+    std::cout << "seeded keys: " << seeded.size() << ", fetches: " << seeded_calls << '\n';
+    failures += !seeded.wait_until_loaded(std::chrono::milliseconds(0)) || seeded.size() != 2;
+    failures += seeded.find("2011-04-29", JwtAlgorithm::RS256) == nullptr || seeded_calls != 0;
+    failures += seeded.refresh_and_wait(std::chrono::seconds(5)) || seeded_calls != 1;
+
+    // a known set older than its max-age is used and fetched again
+    std::atomic<int> stale_calls(0);
+    JwksCache stale("https://issuer.example.com/jwks", [&](std::string const &, JwksDocument &document) {
+        stale_calls++;
+        document.body = first;
+        return true;
+    }, JwksDocument{first, "max-age=3600", std::chrono::hours(2)});
+    failures += stale.find("2011-04-29", JwtAlgorithm::RS256) == nullptr;
+    for (int ii = 0; ii < 100 && stale.fetches() == 0; ii++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << "stale set fetched again: " << stale_calls << '\n';
+    failures += stale_calls != 1;
+
+    // an unknown kid waits for the set it asked for
+    JwksCache rotating("https://issuer.example.com/jwks", [&](std::string const &, JwksDocument &document) {
+        document.body = second;
+        return true;
+    }, JwksDocument{first, "max-age=3600"});
+    failures += rotating.find("rotated", JwtAlgorithm::ES256) != nullptr;
+    failures += !rotating.refresh_and_wait(std::chrono::seconds(5));
+    failures += rotating.find("rotated", JwtAlgorithm::ES256) == nullptr;
+    // fetched just now, nothing to wait for
+    failures += !rotating.refresh_and_wait(std::chrono::milliseconds(0));
+    std::cout << "after refresh: " << rotating.size() << " keys, " << rotating.fetches() << " fetches\n";
+
+    std::cout << cache_control_max_age("max-age=600, must-revalidate") << ' '
+              << cache_control_max_age("s-maxage=60") << ' ' << cache_control_max_age("no-cache") << '\n';
+    failures += cache_control_max_age("max-age=600, must-revalidate") != 600;
+    failures += cache_control_max_age("s-maxage=60") != -1 || cache_control_max_age("no-cache") != 0;
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
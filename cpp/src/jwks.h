@@ -0,0 +1,179 @@
+#ifndef OAUTH2_JWKS_H
+#define OAUTH2_JWKS_H
+
+// The identity provider's signing keys (JWK Set, RFC 7517) from
+// the jwks_uri in its discovery document.  Every key is turned
+// into an EVP_PKEY once, when the set is fetched, and the set is
+// kept sorted by kid; looking a key up for a signature check is
+// a binary search and never parses or fetches anything.
+//
+// A background thread fetches the set again when its
+// Cache-Control max-age runs out.  A token signed with a kid we
+// do not know usually means the provider rotated its keys, so
+// it asks that thread for an early fetch, at most once every
+// min_refetch_interval however many tokens ask.
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "json_bind.h"
+#include "jwt.h"
+
+// https://tools.ietf.org/html/rfc7517#section-4, with the members
+// of RSA (RFC 7518), EC and OKP (RFC 8037) keys
+struct Jwk
+{
+    std::string kty;
+    std::string kid;
+    std::string use;
+    std::string alg;
+    std::string n;
+    std::string e;
+    std::string crv;
+    std::string x;
+    std::string y;
+};
+
+JSON_BINDING(Jwk,
+    JSON_FIELD(Jwk, kty, JSON_REQUIRED),
+    JSON_FIELD(Jwk, kid, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, use, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, alg, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, n, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, e, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, crv, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, x, JSON_OPTIONAL),
+    JSON_FIELD(Jwk, y, JSON_OPTIONAL));
+
+struct JwkSet
+{
+    std::vector<Jwk> keys;
+};
+
+JSON_BINDING(JwkSet,
+    JSON_FIELD(JwkSet, keys, JSON_REQUIRED));
+
+// The public key of jwk and the algorithm it is for, from "alg"
+// or else the key type.  nullptr for encryption keys and keys
+// jwt_verify cannot use.
+std::pair<JwtKey, JwtAlgorithm> jwk_to_key(Jwk const &jwk);
+
+// Seconds from a Cache-Control header, or -1 when it has no
+// max-age; no-store and no-cache count as 0.
+long cache_control_max_age(std::string_view cache_control);
+
+struct JwksDocument
+{
+    std::string body;
+    std::string cache_control;
+    // how long ago it was fetched, for a set kept from an earlier
+    // run; its max-age counts from then
+    std::chrono::seconds age{0};
+};
+
+// Downloads uri, returns false when that failed.
+using JwksFetcher = std::function<bool(std::string const &uri, JwksDocument &document)>;
+
+struct JwksOptions
+{
+    // used when the response has no max-age
+    std::chrono::seconds default_max_age = std::chrono::hours(1);
+    // max-age is kept between these two
+    std::chrono::seconds min_max_age = std::chrono::minutes(1);
+    std::chrono::seconds max_max_age = std::chrono::hours(24);
+    // an unknown kid fetches the set at most this often
+    std::chrono::seconds min_refetch_interval = std::chrono::seconds(30);
+    // after a failed fetch
+    std::chrono::seconds retry = std::chrono::seconds(30);
+};
+
+class JwksCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // starts fetching straight away
+    JwksCache(std::string jwks_uri, JwksFetcher fetcher, JwksOptions options = JwksOptions());
+
+    // Starts with a set we already had, from an earlier run say,
+    // and only fetches once its max-age, less its age, has run
+    // out.  A known set that does not parse is ignored.
+    JwksCache(std::string jwks_uri, JwksFetcher fetcher, JwksDocument const &known,
+              JwksOptions options = JwksOptions());
+
+    ~JwksCache();
+
+    // make this unable to be copied
+    JwksCache(JwksCache const &) = delete;
+    JwksCache &operator=(JwksCache const &) = delete;
+
+    // The key for kid if it may be used with algorithm.  Never
+    // waits for the network, an unknown kid asks for a fetch.
+    JwtKey find(std::string_view kid, JwtAlgorithm algorithm);
+
+    // for jwt_verify
+    JwtKeyLookup lookup();
+
+    // Waits for the first fetch, false if it has not worked by then.
+    bool wait_until_loaded(std::chrono::milliseconds timeout);
+
+    // Fetches the set now and waits for it, false if that did not
+    // work in time.  A set fetched less than min_refetch_interval
+    // ago is not fetched again.  For a kid find() did not know.
+    bool refresh_and_wait(std::chrono::milliseconds timeout);
+
+    [[nodiscard]] size_t size() const;
+
+    // fetches done so far, successful or not
+    [[nodiscard]] size_t fetches() const;
+
+private:
+    struct Entry
+    {
+        std::string kid;
+        JwtKey key;
+        JwtAlgorithm algorithm;
+    };
+    // sorted by kid, never changed once published
+    using KeySet = std::vector<Entry>;
+
+    const std::string uri_;
+    const JwksFetcher fetcher_;
+    const JwksOptions options_;
+
+    std::shared_ptr<const KeySet> keys_;
+    mutable std::shared_mutex keys_mutex_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    // after every fetch, whether it worked or not
+    std::condition_variable loaded_;
+    bool loaded_once_;
+    bool refetch_requested_;
+    bool fetching_;
+    bool last_fetch_ok_;
+    bool stopping_;
+    size_t fetches_;
+    Clock::time_point next_fetch_;
+    Clock::time_point last_fetch_;
+    std::thread thread_;
+
+    // returns how long the new set is good for, or -1 on failure
+    long fetch_();
+
+    // parses document and swaps it in, returns as fetch_ does
+    long publish_(JwksDocument const &document);
+
+    void run_();
+};
+
+#endif /* OAUTH2_JWKS_H */
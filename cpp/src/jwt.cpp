@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/pem.h>
+#include "base64url.h"
+#include "jwt.h"
+
+JwtAlgorithm jwt_algorithm(std::string_view name) {
+    if (name == "RS256") {
+        return JwtAlgorithm::RS256;
+    }
+    if (name == "ES256") {
+        return JwtAlgorithm::ES256;
+    }
+    if (name == "EdDSA") {
+        return JwtAlgorithm::EDDSA;
+    }
+    return JwtAlgorithm::UNSUPPORTED;
+}
+
+const char *jwt_algorithm_name(JwtAlgorithm algorithm) {
+    switch (algorithm) {
+        case JwtAlgorithm::RS256:
+            return "RS256";
+        case JwtAlgorithm::ES256:
+            return "ES256";
+        case JwtAlgorithm::EDDSA:
+            return "EdDSA";
+        case JwtAlgorithm::UNSUPPORTED:
+            break;
+    }
+    return "unsupported";
+}
+
+JwtKey jwt_key_from_pem(std::string_view pem) {
+    BIO *bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+    if (!bio) {
+        return nullptr;
+    }
+    EVP_PKEY *key = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+    if (!key) {
+        return nullptr;
+    }
+    return JwtKey(key, EVP_PKEY_free);
+}
+
+static JwtResult jwt_fail(JwtResult &result, JwtError error, std::string message) {
+    result.error = error;
+    result.error_message = std::move(message);
+    return std::move(result);
+}
+
+// JWS carries an ECDSA signature as r and s, 32 bytes each for
+// P-256, OpenSSL wants them DER encoded
+static bool jwt_es256_to_der(const unsigned char *signature, size_t size, std::string &der) {
+    if (size != 64) {
+        return false;
+    }
+    ECDSA_SIG *sig = ECDSA_SIG_new();
+    BIGNUM *r = BN_bin2bn(signature, 32, nullptr);
+    BIGNUM *s = BN_bin2bn(signature + 32, 32, nullptr);
+    if (!sig || !r || !s || ECDSA_SIG_set0(sig, r, s) != 1) {
+        BN_free(r);
+        BN_free(s);
+        ECDSA_SIG_free(sig);
+        return false;
+    }
+    const int length = i2d_ECDSA_SIG(sig, nullptr);
+    bool ok = length > 0;
+    if (ok) {
+        der.resize(static_cast<size_t>(length));
+        auto *out = reinterpret_cast<unsigned char *>(&der[0]);
+        ok = i2d_ECDSA_SIG(sig, &out) == length;
+    }
+    ECDSA_SIG_free(sig);
+    return ok;
+}
+
+static bool jwt_key_matches(EVP_PKEY *key, JwtAlgorithm algorithm) {
+    switch (algorithm) {
+        case JwtAlgorithm::RS256:
+            return EVP_PKEY_id(key) == EVP_PKEY_RSA && EVP_PKEY_bits(key) >= 2048;
+        case JwtAlgorithm::ES256:
+            return EVP_PKEY_id(key) == EVP_PKEY_EC && EVP_PKEY_bits(key) == 256;
+        case JwtAlgorithm::EDDSA:
+            return EVP_PKEY_id(key) == EVP_PKEY_ED25519 || EVP_PKEY_id(key) == EVP_PKEY_ED448;
+        case JwtAlgorithm::UNSUPPORTED:
+            break;
+    }
+    return false;
+}
+
+static bool jwt_verify_signature(EVP_PKEY *key, JwtAlgorithm algorithm, std::string_view signed_part,
+                                 const unsigned char *signature, size_t size) {
+    if (!jwt_key_matches(key, algorithm)) {
+        return false;
+    }
+    std::string der;
+    if (algorithm == JwtAlgorithm::ES256) {
+        if (!jwt_es256_to_der(signature, size, der)) {
+            return false;
+        }
+        signature = reinterpret_cast<const unsigned char *>(der.data());
+        size = der.size();
+    }
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    if (!context) {
+        return false;
+    }
+    // EdDSA hashes as part of the signature scheme, no digest here
+    const EVP_MD *digest = algorithm == JwtAlgorithm::EDDSA ? nullptr : EVP_sha256();
+    const bool ok = EVP_DigestVerifyInit(context, nullptr, digest, nullptr, key) == 1 &&
+                    EVP_DigestVerify(context, signature, size,
+                                     reinterpret_cast<const unsigned char *>(signed_part.data()),
+                                     signed_part.size()) == 1;
+    EVP_MD_CTX_free(context);
+    return ok;
+}
+
+JwtResult jwt_verify(std::string_view token, JwtOptions const &options, JwtKeyLookup const &keys,
+                     std::chrono::system_clock::time_point now) {
+    JwtResult result = JwtResult{};
+    const size_t first_dot = token.find('.');
+    const size_t second_dot = first_dot == std::string_view::npos ? first_dot : token.find('.', first_dot + 1);
+    if (second_dot == std::string_view::npos || token.find('.', second_dot + 1) != std::string_view::npos) {
+        return jwt_fail(result, JwtError::MALFORMED, "a signed JWT has three parts");
+    }
+    const std::string_view header_text = token.substr(0, first_dot);
+    const std::string_view payload_text = token.substr(first_dot + 1, second_dot - first_dot - 1);
+    const std::string_view signature_text = token.substr(second_dot + 1);
+
+    // All three parts are decoded into one buffer that the thread
+    // keeps, the JSON is then read in place.
+    static thread_local std::string decoded;
+    decoded.clear();
+    if (!base64url_decode_append(decoded, header_text)) {
+        return jwt_fail(result, JwtError::MALFORMED, "header is not base64url");
+    }
+    const size_t header_size = decoded.size();
+    if (!base64url_decode_append(decoded, signature_text)) {
+        return jwt_fail(result, JwtError::MALFORMED, "signature is not base64url");
+    }
+    const size_t signature_size = decoded.size() - header_size;
+    if (!base64url_decode_append(decoded, payload_text)) {
+        return jwt_fail(result, JwtError::MALFORMED, "payload is not base64url");
+    }
+    const std::string_view header_json = std::string_view(decoded).substr(0, header_size);
+    const auto *signature = reinterpret_cast<const unsigned char *>(decoded.data() + header_size);
+    const std::string_view payload_json = std::string_view(decoded).substr(header_size + signature_size);
+
+    const JsonBindResult header_result = json_bind_from_string(header_json, result.header);
+    if (header_result.error) {
+        return jwt_fail(result, JwtError::MALFORMED, "header: " + header_result.error_message);
+    }
+    if (!result.header.crit.empty()) {
+        return jwt_fail(result, JwtError::MALFORMED, "unsupported critical header '" + result.header.crit[0] + "'");
+    }
+    const JwtAlgorithm algorithm = jwt_algorithm(result.header.alg);
+    if (algorithm == JwtAlgorithm::UNSUPPORTED ||
+        std::find(options.algorithms.begin(), options.algorithms.end(), algorithm) == options.algorithms.end()) {
+        return jwt_fail(result, JwtError::UNSUPPORTED_ALGORITHM, "algorithm '" + result.header.alg + "' is not allowed");
+    }
+    const JwtKey key = keys ? keys(result.header.kid, algorithm) : nullptr;
+    if (!key) {
+        return jwt_fail(result, JwtError::UNKNOWN_KEY, "no key for kid '" + result.header.kid + "'");
+    }
+    // what was signed is the encoded header and payload as sent
+    if (!jwt_verify_signature(key.get(), algorithm, token.substr(0, second_dot), signature, signature_size)) {
+        return jwt_fail(result, JwtError::BAD_SIGNATURE, "signature does not match");
+    }
+
+    const JsonBindResult claims_result = json_bind_from_string(payload_json, result.claims);
+    if (claims_result.error) {
+        return jwt_fail(result, JwtError::MALFORMED, "claims: " + claims_result.error_message);
+    }
+    JwtClaims const &claims = result.claims;
+    const double seconds = std::chrono::duration<double>(now.time_since_epoch()).count();
+    const double leeway = static_cast<double>(options.leeway.count());
+    if (!claims.exp.has_value() && options.require_exp) {
+        return jwt_fail(result, JwtError::MALFORMED, "no exp claim");
+    }
+    if (claims.exp.has_value() && !(seconds < *claims.exp + leeway)) {
+        return jwt_fail(result, JwtError::EXPIRED, "token has expired");
+    }
+    if (claims.nbf.has_value() && !(seconds + leeway >= *claims.nbf)) {
+        return jwt_fail(result, JwtError::NOT_YET_VALID, "token is not valid yet");
+    }
+    if (!options.issuer.empty() && claims.iss != options.issuer) {
+        return jwt_fail(result, JwtError::WRONG_ISSUER, "issuer '" + claims.iss + "' is not trusted");
+    }
+    if (!options.audience.empty()) {
+        const std::vector<std::string> &audiences = claims.aud.values;
+        if (std::find(audiences.begin(), audiences.end(), options.audience) == audiences.end()) {
+            return jwt_fail(result, JwtError::WRONG_AUDIENCE, "token is not meant for '" + options.audience + "'");
+        }
+    }
+    return result;
+}
+
+#ifdef TEST_JWT
+#include <iostream>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+
+static JwtKey test_generate(int type) {
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(type, nullptr);
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_keygen_init(context);
+    if (type == EVP_PKEY_RSA) {
+        EVP_PKEY_CTX_set_rsa_keygen_bits(context, 2048);
+    } else if (type == EVP_PKEY_EC) {
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context, NID_X9_62_prime256v1);
+    }
+    EVP_PKEY_keygen(context, &key);
+    EVP_PKEY_CTX_free(context);
+    return JwtKey(key, EVP_PKEY_free);
+}
+
+static std::string test_encode(std::string_view text) {
+    std::string out;
+    base64url_encode_append(out, reinterpret_cast<const unsigned char *>(text.data()), text.size());
+    return out;
+}
+
+static std::string test_sign(EVP_PKEY *key, JwtAlgorithm algorithm, std::string const &header, std::string const &claims) {
+    const std::string signed_part = test_encode(header) + '.' + test_encode(claims);
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    EVP_DigestSignInit(context, nullptr, algorithm == JwtAlgorithm::EDDSA ? nullptr : EVP_sha256(), nullptr, key);
+    size_t size = 0;
+    const auto *data = reinterpret_cast<const unsigned char *>(signed_part.data());
+    EVP_DigestSign(context, nullptr, &size, data, signed_part.size());
+    std::string signature(size, '\0');
+    EVP_DigestSign(context, reinterpret_cast<unsigned char *>(&signature[0]), &size, data, signed_part.size());
+    signature.resize(size);
+    EVP_MD_CTX_free(context);
+    if (algorithm == JwtAlgorithm::ES256) {
+        // DER to r and s
+        const auto *der = reinterpret_cast<const unsigned char *>(signature.data());
+        ECDSA_SIG *sig = d2i_ECDSA_SIG(nullptr, &der, static_cast<long>(signature.size()));
+        unsigned char raw[64];
+        BN_bn2binpad(ECDSA_SIG_get0_r(sig), raw, 32);
+        BN_bn2binpad(ECDSA_SIG_get0_s(sig), raw + 32, 32);
+        ECDSA_SIG_free(sig);
+        signature.assign(reinterpret_cast<char *>(raw), sizeof(raw));
+    }
+    return signed_part + '.' + test_encode(signature);
+}
+
+int main() {
+    const JwtKey rsa = test_generate(EVP_PKEY_RSA);
+    const JwtKey ec = test_generate(EVP_PKEY_EC);
+    const JwtKey ed = test_generate(EVP_PKEY_ED25519);
+    const JwtKeyLookup keys = [&](std::string_view kid, JwtAlgorithm) -> JwtKey {
+        return kid == "rsa" ? rsa : kid == "ec" ? ec : kid == "ed" ? ed : nullptr;
+    };
+    JwtOptions options;
+    options.issuer = "https://issuer.example.com";
+    options.audience = "api";
+    const auto now = std::chrono::system_clock::time_point(std::chrono::seconds(1600000000));
+    const std::string claims = R"({"iss":"https://issuer.example.com","sub":"user","aud":["web","api"],)"
+                               R"("exp":1600000300,"nbf":1599999990.5,"scope":"openid"})";
+
+    struct Test {
+        const char *name;
+        std::string token;
+        JwtError expected;
+    };
+    const std::string rs256 = test_sign(rsa.get(), JwtAlgorithm::RS256, R"({"alg":"RS256","kid":"rsa"})", claims);
+    std::string tampered = rs256;
+    tampered[tampered.find('.') + 5] ^= 1;
+    const Test tests[] = {
+        {"RS256", rs256, JwtError::NONE},
+        {"ES256", test_sign(ec.get(), JwtAlgorithm::ES256, R"({"alg":"ES256","kid":"ec"})", claims), JwtError::NONE},
+        {"EdDSA", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})", claims), JwtError::NONE},
+        {"tampered payload", tampered, JwtError::BAD_SIGNATURE},
+        {"key of another type", test_sign(ec.get(), JwtAlgorithm::ES256, R"({"alg":"ES256","kid":"rsa"})", claims),
+         JwtError::BAD_SIGNATURE},
+        {"none", test_encode(R"({"alg":"none"})") + '.' + test_encode(claims) + '.', JwtError::UNSUPPORTED_ALGORITHM},
+        {"HS256", test_encode(R"({"alg":"HS256","kid":"rsa"})") + '.' + test_encode(claims) + ".AAAA",
+         JwtError::UNSUPPORTED_ALGORITHM},
+        {"unknown kid", test_sign(rsa.get(), JwtAlgorithm::RS256, R"({"alg":"RS256","kid":"old"})", claims),
+         JwtError::UNKNOWN_KEY},
+        {"crit", test_sign(rsa.get(), JwtAlgorithm::RS256, R"({"alg":"RS256","kid":"rsa","crit":["b64"]})", claims),
+         JwtError::MALFORMED},
+        {"expired", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})",
+                              R"({"iss":"https://issuer.example.com","aud":"api","exp":1599999900})"),
+         JwtError::EXPIRED},
+        {"within leeway", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})",
+                                    R"({"iss":"https://issuer.example.com","aud":"api","exp":1599999970})"),
+         JwtError::NONE},
+        {"not yet", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})",
+                              R"({"iss":"https://issuer.example.com","aud":"api","exp":1600009000,"nbf":1600000100})"),
+         JwtError::NOT_YET_VALID},
+        {"issuer", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})",
+                             R"({"iss":"https://evil.example.com","aud":"api","exp":1600009000})"),
+         JwtError::WRONG_ISSUER},
+        {"audience", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})",
+                               R"({"iss":"https://issuer.example.com","aud":"web","exp":1600009000})"),
+         JwtError::WRONG_AUDIENCE},
+        {"no exp", test_sign(ed.get(), JwtAlgorithm::EDDSA, R"({"alg":"EdDSA","kid":"ed"})",
+                             R"({"iss":"https://issuer.example.com","aud":"api"})"),
+         JwtError::MALFORMED},
+        {"two parts", "abc.def", JwtError::MALFORMED},
+        {"padding", rs256 + "==", JwtError::MALFORMED},
+    };
+    int failures = 0;
+    for (Test const &test : tests) {
+        const JwtResult result = jwt_verify(test.token, options, keys, now);
+        const bool ok = result.error == test.expected;
+        std::cout << (ok ? "ok     " : "FAILED ") << test.name << ": "
+                  << (result.error == JwtError::NONE ? result.claims.sub + " " + result.claims.scope
+                                                     : result.error_message) << '\n';
+        failures += !ok;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,146 @@
+#ifndef OAUTH2_JWT_H
+#define OAUTH2_JWT_H
+
+// Verifying JSON Web Tokens (RFC 7519) locally, so a protected
+// call does not have to ask the identity provider whether the
+// access token is good.  Only signed tokens (JWS compact form)
+// with RS256, ES256 or EdDSA are accepted, never "none" and
+// never HMAC, since we only ever hold public keys.
+//
+// The signature is checked before the claims are read; the
+// claims then have to pass exp, nbf, iss and aud.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#include "json_bind.h"
+
+enum class JwtAlgorithm {
+    RS256 = 0,
+    ES256,
+    // Ed25519 or Ed448, RFC 8037
+    EDDSA,
+    UNSUPPORTED
+};
+
+JwtAlgorithm jwt_algorithm(std::string_view name);
+
+const char *jwt_algorithm_name(JwtAlgorithm algorithm);
+
+enum class JwtError {
+    NONE = 0,
+    MALFORMED,
+    UNSUPPORTED_ALGORITHM,
+    UNKNOWN_KEY,
+    BAD_SIGNATURE,
+    EXPIRED,
+    NOT_YET_VALID,
+    WRONG_ISSUER,
+    WRONG_AUDIENCE
+};
+
+struct JwtHeader
+{
+    std::string alg;
+    std::string kid;
+    std::string typ;
+    // extensions the token says we must understand, we do not
+    // understand any
+    std::vector<std::string> crit;
+};
+
+JSON_BINDING(JwtHeader,
+    JSON_FIELD(JwtHeader, alg, JSON_REQUIRED),
+    JSON_FIELD(JwtHeader, kid, JSON_OPTIONAL),
+    JSON_FIELD(JwtHeader, typ, JSON_OPTIONAL),
+    JSON_FIELD(JwtHeader, crit, JSON_OPTIONAL));
+
+// "aud" is either one string or an array of them
+struct JwtAudience
+{
+    std::vector<std::string> values;
+};
+
+INTERNAL inline
+bool json_bind_value(JsonReader& reader, JwtAudience& out)
+{
+    if ( reader.token == JsonTokenType::STRING ) {
+        out.values.resize(1);
+        return json_bind_value(reader, out.values[0]);
+    }
+    return json_bind_value(reader, out.values);
+}
+
+// https://tools.ietf.org/html/rfc7519#section-4.1
+struct JwtClaims
+{
+    std::string iss;
+    std::string sub;
+    JwtAudience aud;
+    // NumericDate, seconds since the epoch and not always whole
+    std::optional<double> exp;
+    std::optional<double> nbf;
+    std::optional<double> iat;
+    std::string jti;
+    std::string scope;
+    std::string client_id;
+    std::string azp;
+};
+
+JSON_BINDING(JwtClaims,
+    JSON_FIELD(JwtClaims, iss, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, sub, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, aud, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, exp, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, nbf, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, iat, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, jti, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, scope, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, client_id, JSON_OPTIONAL),
+    JSON_FIELD(JwtClaims, azp, JSON_OPTIONAL));
+
+using JwtKey = std::shared_ptr<EVP_PKEY>;
+
+// A public key from PEM (SubjectPublicKeyInfo), nullptr if it
+// is not one.
+JwtKey jwt_key_from_pem(std::string_view pem);
+
+// Finds the key for the kid in a token's header.  It is only
+// asked for keys of the algorithm the header names; returning a
+// key of another type fails the signature check.
+using JwtKeyLookup = std::function<JwtKey(std::string_view kid, JwtAlgorithm algorithm)>;
+
+struct JwtOptions
+{
+    // checked when not empty
+    std::string issuer;
+    // must be one of the token's audiences when not empty
+    std::string audience;
+    // allowed difference between our clock and the issuer's
+    std::chrono::seconds leeway = std::chrono::seconds(60);
+    bool require_exp = true;
+    std::vector<JwtAlgorithm> algorithms = {JwtAlgorithm::RS256, JwtAlgorithm::ES256, JwtAlgorithm::EDDSA};
+};
+
+struct JwtResult
+{
+    JwtError error;
+    std::string error_message;
+    JwtHeader header;
+    // only filled when the signature is good
+    JwtClaims claims;
+};
+
+// now is the wall clock, exp and nbf are wall clock times too
+JwtResult jwt_verify(std::string_view token, JwtOptions const &options, JwtKeyLookup const &keys,
+                     std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+#endif /* OAUTH2_JWT_H */
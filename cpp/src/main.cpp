@@ -7,55 +7,313 @@
 #include "url.h"
 #include "tiny_web_client.h"
 #include "random_string.h"
+#include "pkce.h"
+#include "token_cache.h"
+#include "jwks.h"
+#include "jwt.h"
+#include "discovery_snapshot.h"
 #include "json_parser.h"
+#include "oauth2_types.h"
 #include "open_browser.h"
 #include "tiny_web_server.h"
 
+#include <future>
+#include <mutex>
 
-int main()
+// Both endpoints are checked and formatted by the compiler, a bad
+// API_HOST or path from CMake fails the build.
+constexpr UrlConstant api_application_endpoint =
+        URL_CONSTANT("GET", API_HOST, API_APPLICATION_ENDPOINT_PATH);
+constexpr UrlConstant api_access_token_endpoint =
+        URL_CONSTANT("POST", API_HOST, API_GET_ACCESS_TOKEN_PATH);
+
+// Endpoints only known at run time are parsed once and shared.
+static EndpointCache endpoints;
+
+// The refresh_token grant, RFC 6749 section 6.  TokenCache calls
+// this from its own thread before the access token runs out.
+static bool refresh_access_token(TokenKey const &key, std::string const &refresh_token, TokenResponse &token)
 {
-    std::cout << "==============================================\n"
-              << "(Public API call) GetApplicationEndpoint\n"
-              << "==============================================" << std::endl;
-    const URL target(static_cast<const std::ostringstream&>(
-            std::ostringstream() << "https://" << API_HOST
-                                 << API_APPLICATION_ENDPOINT_PATH).str());
-    Request request = make_request(target);
+    const std::map<std::string, std::string> post_fields {
+            std::make_pair("grant_type", "refresh_token"),
+            std::make_pair("refresh_token", refresh_token),
+            std::make_pair("client_id", key.client_id)
+    };
+    Request request = make_request(api_access_token_endpoint);
     Response response;
-    const auto resp = http_send(request, response);
-    if (  resp != 0 ) {
-        std::cerr << "resp: " << resp << std::endl;
-        throw std::runtime_error("request failed");
+    if ( http_send(request, response, post_fields) != 0 || response.status >= 300 ) {
+        return false;
     }
-    std::cout << "Body: " << response.body << '\n';
+    return !json_bind_from_string(response.body, token).error;
+}
 
-    const std::string temporary_secret_state = generate_random_string(5);
-    std::cout << "Generated secret state: " << temporary_secret_state << std::endl;
+// A GET that sends the validators we have for the document, RFC
+// 7232, and keeps the new ones.  False when the request failed;
+// a 304 is a success with an empty body.
+static bool conditional_get(Request request, std::string &etag, std::string &last_modified, Response &response)
+{
+    if ( !etag.empty() ) {
+        request.headers.push_back("If-None-Match: " + etag);
+    }
+    if ( !last_modified.empty() ) {
+        request.headers.push_back("If-Modified-Since: " + last_modified);
+    }
+    if ( http_send(request, response) != 0 ) {
+        return false;
+    }
+    if ( response.status == 304 ) {
+        response.body.clear();
+        return true;
+    }
+    if ( response.status >= 300 ) {
+        return false;
+    }
+    etag = response_header(response, "ETag");
+    last_modified = response_header(response, "Last-Modified");
+    return true;
+}
+
+// The JWK Set as last downloaded, which fetch_jwks revalidates
+// and the snapshot keeps.
+struct KnownJwks
+{
+    std::string uri;
+    JwksDocument document;
+    std::string etag;
+    std::string last_modified;
+    // the last 200 or 304, its max-age counts from here
+    std::chrono::system_clock::time_point fetched_at;
+};
+
+static std::mutex known_jwks_mutex;
+static KnownJwks known_jwks;
+
+// JwksCache calls this from its own thread.
+static bool fetch_jwks(std::string const &uri, JwksDocument &document)
+{
+    KnownJwks known;
+    {
+        std::lock_guard<std::mutex> lock(known_jwks_mutex);
+        if ( known_jwks.uri == uri ) {
+            known = known_jwks;
+        }
+    }
+    if ( known.document.body.empty() ) {
+        known.etag.clear();
+        known.last_modified.clear();
+    }
+    Response response;
+    if ( !conditional_get(make_request(endpoints.get(uri)), known.etag, known.last_modified, response) ) {
+        return false;
+    }
+    if ( response.status != 304 ) {
+        known.document.body = std::move(response.body);
+    }
+    known.uri = uri;
+    known.document.cache_control = response_header(response, "Cache-Control");
+    known.document.age = std::chrono::seconds(0);
+    known.fetched_at = std::chrono::system_clock::now();
+    document = known.document;
+    std::lock_guard<std::mutex> lock(known_jwks_mutex);
+    known_jwks = std::move(known);
+    return true;
+}
 
-    const JsonItem metadata = json_create_from_string(response.body);
+// Fills values from GetApplicationEndpoint and the OpenID
+// discovery document.  Documents that have not changed since
+// values was filled come back as a 304 and are not parsed again.
+// Throws when either request fails.
+static void discover(SnapshotValues &values)
+{
+    Response response;
+    if ( !conditional_get(make_request(api_application_endpoint), values[SnapshotField::APPLICATION_ETAG],
+                          values[SnapshotField::APPLICATION_LAST_MODIFIED], response) ) {
+        throw std::runtime_error("GetApplicationEndpoint request failed");
+    }
+    if ( response.status != 304 ) {
 #ifdef TEST_JSON
-    json_pretty_print(metadata);
+        json_pretty_print(json_create_from_string(response.body));
 #endif
+        ApplicationEndpoint metadata;
+        const JsonBindResult metadata_result = json_bind_from_string(response.body, metadata);
+        if ( metadata_result.error ) {
+            throw std::runtime_error("invalid application endpoint response: " + metadata_result.error_message);
+        }
+        values[SnapshotField::APPLICATION_CLIENT_ID] = metadata.clientId;
+        if ( values[SnapshotField::OPENID_URL] != metadata.openid ) {
+            // validators for another document are no use
+            values[SnapshotField::OPENID_URL] = metadata.openid;
+            values[SnapshotField::OPENID_ETAG].clear();
+            values[SnapshotField::OPENID_LAST_MODIFIED].clear();
+        }
+    }
 
-    const auto openid_json = metadata.object.find("openid");
-    std::cout << "OpenID: " << openid_json->second.text << "\n"
-
-              << "==============================================\n"
-              << "(Public API call) OpenID Metadata Call\n"
-              << "==============================================" << std::endl;
-    Request openid_request = make_request(URL(openid_json->second.text));
     Response openid_response;
-    if ( http_send(openid_request, openid_response) != 0 ) {
-        throw std::runtime_error("request failed");
+    if ( !conditional_get(make_request(endpoints.get(values[SnapshotField::OPENID_URL])),
+                          values[SnapshotField::OPENID_ETAG], values[SnapshotField::OPENID_LAST_MODIFIED],
+                          openid_response) ) {
+        throw std::runtime_error("OpenID metadata request failed");
     }
-
-    const JsonItem openid_metadata = json_create_from_string(openid_response.body);
+    if ( openid_response.status != 304 ) {
 #ifdef TEST_JSON
-    json_pretty_print(openid_metadata);
+        json_pretty_print(json_create_from_string(openid_response.body));
 #endif
+        OpenIDConfiguration openid_metadata;
+        const JsonBindResult openid_result = json_bind_from_string(openid_response.body, openid_metadata);
+        if ( openid_result.error ) {
+            throw std::runtime_error("invalid OpenID metadata: " + openid_result.error_message);
+        }
+        values[SnapshotField::ISSUER] = openid_metadata.issuer;
+        values[SnapshotField::AUTHORIZATION_ENDPOINT] = openid_metadata.authorization_endpoint;
+        values[SnapshotField::TOKEN_ENDPOINT] = openid_metadata.token_endpoint;
+        values[SnapshotField::USERINFO_ENDPOINT] = openid_metadata.userinfo_endpoint;
+        if ( values[SnapshotField::JWKS_URI] != openid_metadata.jwks_uri ) {
+            values[SnapshotField::JWKS_URI] = openid_metadata.jwks_uri;
+            values[SnapshotField::JWKS_BODY].clear();
+            values[SnapshotField::JWKS_CACHE_CONTROL].clear();
+            values[SnapshotField::JWKS_ETAG].clear();
+            values[SnapshotField::JWKS_LAST_MODIFIED].clear();
+        }
+    }
 
-    const auto authorization_endpoint_json = openid_metadata.object.find("authorization_endpoint");
-    const std::string authorization_endpoint = authorization_endpoint_json->second.text;
+    // good for as long as the discovery document is
+    const long max_age = cache_control_max_age(response_header(openid_response, "Cache-Control"));
+    values.max_age = std::chrono::seconds(DISCOVERY_SNAPSHOT_MAX_AGE);
+    if ( max_age >= 0 && max_age < values.max_age.count() ) {
+        values.max_age = std::chrono::seconds(max_age);
+    }
+    values.saved_at = std::chrono::system_clock::now();
+}
+
+// DISCOVERY_SNAPSHOT_PATH, or the user's cache directory
+static std::string snapshot_path()
+{
+    const std::string configured = DISCOVERY_SNAPSHOT_PATH;
+    return configured.empty() ? snapshot_default_path() : configured;
+}
+
+// Writes what this run knows for the next one, in the background
+// while the user logs in.  A snapshot we started from is asked
+// about again first, the JWK Set too; unchanged documents cost a
+// 304 each.
+static void save_snapshot(SnapshotValues values, bool revalidate, JwksCache *jwks)
+{
+    try {
+        if ( revalidate ) {
+            discover(values);
+        }
+    } catch ( std::exception const &e ) {
+        std::cerr << "Discovery snapshot not revalidated: " << e.what() << '\n';
+        return;
+    }
+    // through fetch_jwks, so the keys in use are renewed as well
+    const bool jwks_current = jwks && (revalidate ? jwks->refresh_and_wait(std::chrono::seconds(10))
+                                                  : jwks->wait_until_loaded(std::chrono::seconds(10)));
+    if ( jwks_current ) {
+        std::lock_guard<std::mutex> lock(known_jwks_mutex);
+        if ( known_jwks.uri == values[SnapshotField::JWKS_URI] ) {
+            values[SnapshotField::JWKS_BODY] = known_jwks.document.body;
+            values[SnapshotField::JWKS_CACHE_CONTROL] = known_jwks.document.cache_control;
+            values[SnapshotField::JWKS_ETAG] = known_jwks.etag;
+            values[SnapshotField::JWKS_LAST_MODIFIED] = known_jwks.last_modified;
+            values.jwks_fetched_at = known_jwks.fetched_at;
+        }
+    }
+    const std::string path = snapshot_path();
+    std::string error;
+    if ( path.empty() ) {
+        std::cerr << "Discovery snapshot not saved: no cache directory\n";
+    } else if ( !snapshot_write(path, values, error) ) {
+        std::cerr << "Discovery snapshot not saved: " << error << '\n';
+    }
+}
+
+// Sends request over the connection warm has kept ready for it.
+static int send_warm(Request &request, Response &response, WarmConnection &warm,
+                     const std::map<std::string, std::string> &post_fields = {})
+{
+    const std::unique_ptr<HttpConnection> connection = warm.take();
+    return http_send(request, response, *connection, post_fields);
+}
+
+static std::string bearer_header(TokenCache const &tokens, TokenKey const &key)
+{
+    const TokenHandle token = tokens.get(key);
+    if ( !token ) {
+        throw std::runtime_error("access token expired and could not be refreshed");
+    }
+    return "Authorization: Bearer " + token->response.access_token;
+}
+
+int main()
+{
+    // hashes the PKCE challenges while we talk to the API
+    PkcePool pkce_pool(4);
+
+    // A fresh snapshot from an earlier run needs no network at
+    // all; a stale one still has the validators to ask with.
+    SnapshotValues discovered;
+    bool from_snapshot = false;
+    {
+        // unmapped again before save_snapshot replaces the file
+        DiscoverySnapshot snapshot;
+        const std::string path = snapshot_path();
+        if ( !path.empty() && snapshot.open(path) ) {
+            discovered = snapshot.values();
+            from_snapshot = snapshot.is_fresh();
+        }
+    }
+    if ( from_snapshot ) {
+        std::cout << "==============================================\n"
+                  << "Discovery snapshot " << snapshot_path() << '\n'
+                  << "==============================================" << std::endl;
+    } else {
+        std::cout << "==============================================\n"
+                  << "(Public API call) GetApplicationEndpoint and OpenID Metadata Call\n"
+                  << "==============================================" << std::endl;
+        discover(discovered);
+    }
+    std::cout << "Client ID: " << discovered[SnapshotField::APPLICATION_CLIENT_ID] << "\n"
+              << "OpenID: " << discovered[SnapshotField::OPENID_URL] << std::endl;
+
+    const std::string temporary_secret_state = generate_random_string(22, RandomFormat::BASE64URL);
+    std::cout << "Generated secret state: " << temporary_secret_state << std::endl;
+
+    const std::string authorization_endpoint = discovered[SnapshotField::AUTHORIZATION_ENDPOINT];
+    // the signing keys load in the background while the user logs
+    // in, or come straight from the snapshot
+    std::unique_ptr<JwksCache> jwks;
+    const std::string &jwks_uri = discovered[SnapshotField::JWKS_URI];
+    if ( !jwks_uri.empty() ) {
+        // a fetch time in the future is not trusted, the set is
+        // taken as due
+        const auto fetched_at = discovered.jwks_fetched_at;
+        const auto now = std::chrono::system_clock::now();
+        JwksDocument known{discovered[SnapshotField::JWKS_BODY], discovered[SnapshotField::JWKS_CACHE_CONTROL],
+                           fetched_at <= now ? std::chrono::duration_cast<std::chrono::seconds>(now - fetched_at)
+                                             : std::chrono::seconds(std::chrono::hours(24 * 365))};
+        {
+            std::lock_guard<std::mutex> lock(known_jwks_mutex);
+            known_jwks = KnownJwks{jwks_uri, known, discovered[SnapshotField::JWKS_ETAG],
+                                   discovered[SnapshotField::JWKS_LAST_MODIFIED], fetched_at};
+        }
+        if ( !from_snapshot ) {
+            known = JwksDocument();
+        }
+        jwks = std::make_unique<JwksCache>(jwks_uri, fetch_jwks, known);
+    }
+    // main waits for the write on the way out, before jwks goes
+    std::future<void> saving = std::async(std::launch::async, save_snapshot, discovered, from_snapshot,
+                                          jwks.get());
+
+    // everything after the redirect is on connections opened
+    // while the user is in the browser, so the code exchange is a
+    // single round trip
+    WarmConnection token_connection(make_request(api_access_token_endpoint));
+    Request userinfo_request = make_request(endpoints.get(discovered[SnapshotField::USERINFO_ENDPOINT]));
+    WarmConnection userinfo_connection(userinfo_request);
+    Request private_request = make_request(endpoints.get("https://31f5ff35.eu-gb.apigw.appdomain.cloud/private-authtest/Hello"));
+    WarmConnection private_connection(private_request);
 
     std::cout << "==============================================\n"
               << "Send user to browser\n"
@@ -63,13 +321,16 @@ int main()
     const std::string redirect_uri = static_cast<const std::ostringstream&>(
             std::ostringstream() << "http://" << SERVER_HOST << ':'
                                  << PORT_TO_BIND << EXPECTED_PATH).str();
-    URL authorization_url = URL(authorization_endpoint);
-    authorization_url.add_param("response_type", "code");
-    authorization_url.add_param("client_id", metadata.object.find("clientId")->second.text);
-    authorization_url.add_param("redirect_uri", redirect_uri);
-    authorization_url.add_param("state", temporary_secret_state);
-    authorization_url.add_param("scope", "openid");
-    open_browser(authorization_url);
+    // the parameters that are the same for every login are encoded
+    // once, only the state is encoded per attempt
+    UrlBuilder authorization(URL{authorization_endpoint});
+    authorization.add_param("response_type", "code")
+            .add_param("client_id", discovered[SnapshotField::APPLICATION_CLIENT_ID])
+            .add_param("redirect_uri", redirect_uri)
+            .add_param("scope", "openid")
+            .add_param("code_challenge_method", PKCE_METHOD);
+    const PkcePair pkce = pkce_pool.take();
+    open_browser(authorization.build({{"state", temporary_secret_state}, {"code_challenge", pkce.challenge}}));
 
     // we then need to start our web server and block
     // until we get the appropriate response
@@ -108,39 +369,80 @@ int main()
     std::cout << "==============================================\n"
               << "(Public API+secret) GetAccessToken\n"
               << "==============================================" << std::endl;
-    const URL token_url = URL(
-            static_cast<const std::ostringstream&>(
-                    std::ostringstream() << "https://" << API_HOST << API_GET_ACCESS_TOKEN_PATH).str());
-    const std::map<std::string, std::string> post_fields {
-            std::make_pair("grant_type", "authorization_code"),
-            std::make_pair("code", oauth_response.code),
-            std::make_pair("redirect_uri", redirect_uri),
-            std::make_pair("client_id", metadata.object.find("clientId")->second.text)
-    };
-    Request token_request = make_request(token_url, "POST");
-    Response token_response;
-    if ( http_send(token_request, token_response, post_fields) != 0 ) {
-        throw std::runtime_error("request failed to get token");
-    }
-    std::cout << token_response.raw << std::endl;
+    // kept with its expiry and renewed in the background from here
+    // on; anything else that needs it at the same time shares the
+    // one code exchange
+    TokenCache tokens(refresh_access_token);
+    const TokenKey token_key{discovered[SnapshotField::APPLICATION_CLIENT_ID], "openid", ""};
+    const TokenHandle token = tokens.acquire(token_key, [&](TokenKey const &key, TokenResponse &response) {
+        const std::map<std::string, std::string> post_fields {
+                std::make_pair("grant_type", "authorization_code"),
+                std::make_pair("code", oauth_response.code),
+                std::make_pair("redirect_uri", redirect_uri),
+                std::make_pair("client_id", key.client_id),
+                std::make_pair("code_verifier", pkce.verifier)
+        };
+        Request token_request = make_request(api_access_token_endpoint);
+        Response token_response;
+        if ( send_warm(token_request, token_response, token_connection, post_fields) != 0 ) {
+            throw std::runtime_error("request failed to get token");
+        }
+        std::cout << token_response.raw << std::endl;
 
-    const JsonItem access_json = json_create_from_string(token_response.body);
-    const std::string access_token = access_json.object.find("access_token")->second.text;
-    std::cout << "Access Token: " << access_token << '\n';
+        const JsonBindResult token_result = json_bind_from_string(token_response.body, response);
+        if ( token_result.error ) {
+            throw std::runtime_error("invalid token response: " + token_result.error_message);
+        }
+        return true;
+    });
+    std::cout << "Access Token: " << token->response.access_token
+              << " (expires in " << token->response.expires_in << "s)\n";
+
+    // both only need the access token, so they go out together and
+    // the ID token is checked while they are in flight
+    userinfo_request.headers.emplace_back("Content-type: application/json");
+    userinfo_request.headers.push_back(bearer_header(tokens, token_key));
+    private_request.headers.emplace_back("Content-type: application/json");
+    private_request.headers.push_back(bearer_header(tokens, token_key));
+    Response userinfo_response;
+    Response private_response;
+    std::future<int> userinfo_sent = std::async(std::launch::async, [&] {
+        return send_warm(userinfo_request, userinfo_response, userinfo_connection);
+    });
+    std::future<int> private_sent = std::async(std::launch::async, [&] {
+        return send_warm(private_request, private_response, private_connection);
+    });
+
+    // the ID token is checked here, without asking the provider;
+    // one we cannot check is not trusted
+    if ( !token->response.id_token.empty() ) {
+        if ( !jwks ) {
+            throw std::runtime_error("ID token not verified: the provider publishes no jwks_uri");
+        }
+        if ( !jwks->wait_until_loaded(std::chrono::seconds(10)) ) {
+            throw std::runtime_error("ID token not verified: the signing keys did not load");
+        }
+        JwtOptions options;
+        options.issuer = discovered[SnapshotField::ISSUER];
+        options.audience = discovered[SnapshotField::APPLICATION_CLIENT_ID];
+        JwtResult id_token = jwt_verify(token->response.id_token, options, jwks->lookup());
+        // a kid we do not know is most likely a key rotation, the
+        // lookup has asked for the new set
+        if ( id_token.error == JwtError::UNKNOWN_KEY && jwks->refresh_and_wait(std::chrono::seconds(10)) ) {
+            id_token = jwt_verify(token->response.id_token, options, jwks->lookup());
+        }
+        if ( id_token.error != JwtError::NONE ) {
+            throw std::runtime_error("invalid ID token: " + id_token.error_message);
+        }
+        std::cout << "ID token verified locally, subject: " << id_token.claims.sub << '\n';
+    }
 
     // get user details to prove we are looked and show
     // how to pass bearer token
     std::cout << "==============================================\n"
               << "(Published Private API) UserInfo\n"
               << "==============================================" << std::endl;
-    const auto userinfo_endpoint_json = openid_metadata.object.find("userinfo_endpoint");
-    const std::string userinfo_endpoint = userinfo_endpoint_json->second.text;
-    const URL userinfo_url = URL(userinfo_endpoint);
-    Request userinfo_request = make_request(userinfo_url);
-    userinfo_request.headers.emplace_back("Content-type: application/json");
-    userinfo_request.headers.push_back("Authorization: Bearer " + access_token);
-    Response userinfo_response;
-    if ( http_send(userinfo_request, userinfo_response) ) {
+    if ( userinfo_sent.get() ) {
         throw std::runtime_error("request failed to get userinfo");
     }
     std::cout << userinfo_response.raw << '\n';
@@ -149,11 +451,7 @@ int main()
     std::cout << "==============================================\n"
               << "(Our Private API) Hello\n"
               << "==============================================" << std::endl;
-    Request private_request = make_request(URL("https://31f5ff35.eu-gb.apigw.appdomain.cloud/private-authtest/Hello"));
-    private_request.headers.emplace_back("Content-type: application/json");
-    private_request.headers.push_back("Authorization: Bearer " + access_token);
-    Response private_response;
-    if ( http_send(private_request, private_response) ) {
+    if ( private_sent.get() ) {
         throw std::runtime_error("request failed to get userinfo");
     }
     std::cout << private_response.raw << '\n';
@@ -7,17 +7,41 @@
 #include "url.h"
 #include "tiny_web_client.h"
 #include "random_string.h"
+#include "pkce.h"
 #include "json_parser.h"
+#include "oauth2_types.h"
 #include "open_browser.h"
 #include "tiny_web_server.h"
 
-typedef struct {
+constexpr UrlConstant google_token_endpoint =
+        URL_CONSTANT("POST", "oauth2.googleapis.com", "/token");
+constexpr UrlConstant google_projects_endpoint =
+        URL_CONSTANT("GET", "cloudresourcemanager.googleapis.com", "/v1beta1/projects");
+
+struct GoogleCloudProject {
     std::string projectNumber;
     std::string projectId;
     std::string lifecycleState;
     std::string name;
     std::string createTime; /* could make this a `std::tm`s */
-} GoogleCloudProject;
+};
+
+JSON_BINDING(GoogleCloudProject,
+    JSON_FIELD(GoogleCloudProject, projectNumber, JSON_OPTIONAL),
+    JSON_FIELD(GoogleCloudProject, projectId, JSON_REQUIRED),
+    JSON_FIELD(GoogleCloudProject, lifecycleState, JSON_REQUIRED),
+    JSON_FIELD(GoogleCloudProject, name, JSON_OPTIONAL),
+    JSON_FIELD(GoogleCloudProject, createTime, JSON_OPTIONAL));
+
+// https://cloud.google.com/resource-manager/reference/rest/v1beta1/projects/list
+struct GoogleCloudProjectList {
+    std::vector<GoogleCloudProject> projects;
+    std::string nextPageToken;
+};
+
+JSON_BINDING(GoogleCloudProjectList,
+    JSON_FIELD(GoogleCloudProjectList, projects, JSON_OPTIONAL),
+    JSON_FIELD(GoogleCloudProjectList, nextPageToken, JSON_OPTIONAL));
 
 int main()
 {
@@ -26,15 +50,16 @@ int main()
                                  << PORT_TO_BIND << EXPECTED_PATH).str();
     const char * scope = "https://www.googleapis.com/auth/cloud-platform ";
     // "https://www.googleapis.com/auth/devstorage.read_write"
-    const std::string temporary_secret_state = generate_random_string(10);
-    URL authorization_url = URL("https://accounts.google.com/o/oauth2/v2/auth");
-    authorization_url.add_param("scope", scope);
-    authorization_url.add_param("response_type", "code");
-    authorization_url.add_param("state", temporary_secret_state);
-    authorization_url.add_param("client_id", CLIENT_ID);
-    authorization_url.add_param("redirect_uri", redirect_uri);
-    authorization_url.add_param("scope", "openid");
-    open_browser(authorization_url);
+    const std::string temporary_secret_state = generate_random_string(22, RandomFormat::BASE64URL);
+    UrlBuilder authorization(URL("https://accounts.google.com/o/oauth2/v2/auth"));
+    authorization.add_param("scope", scope)
+            .add_param("response_type", "code")
+            .add_param("client_id", CLIENT_ID)
+            .add_param("redirect_uri", redirect_uri)
+            .add_param("code_challenge_method", PKCE_METHOD);
+    // PKCE is required for installed apps
+    const PkcePair pkce = pkce_generate();
+    open_browser(authorization.build({{"state", temporary_secret_state}, {"code_challenge", pkce.challenge}}));
 
     // we then need to start our web server and block
     // until we get the appropriate response
@@ -46,15 +71,15 @@ int main()
                                                               << oauth_response.secret << ") ,"
                                                               << "expected: (" << temporary_secret_state << ")\n").str());
 
-    const URL token_url = URL( "https://oauth2.googleapis.com/token");
     const std::map<std::string, std::string> post_fields {
             std::make_pair("grant_type", "authorization_code"),
             std::make_pair("code", oauth_response.code),
             std::make_pair("redirect_uri", redirect_uri),
             std::make_pair("client_id", CLIENT_ID),
-            std::make_pair("client_secret", CLIENT_SECRET)
+            std::make_pair("client_secret", CLIENT_SECRET),
+            std::make_pair("code_verifier", pkce.verifier)
     };
-    Request token_request = make_request(token_url, "POST");
+    Request token_request = make_request(google_token_endpoint);
     Response token_response;
     if ( http_send(token_request, token_response, post_fields) != 0 )
         throw std::runtime_error("request failed to get token");
@@ -64,12 +89,14 @@ int main()
         return EXIT_FAILURE;
     }
 
-    const JsonItem access_json = json_create_from_string(token_response.body);
-    const std::string access_token = access_json.object.find("access_token")->second.text;
+    TokenResponse token;
+    const JsonBindResult token_result = json_bind_from_string(token_response.body, token);
+    if (token_result.error)
+        throw std::runtime_error("invalid token response: " + token_result.error_message);
+    const std::string access_token = token.access_token;
     std::cout << "Access Token: " << access_token << '\n';
 
-    Request private_request = make_request(
-            URL("https://cloudresourcemanager.googleapis.com/v1beta1/projects"));
+    Request private_request = make_request(google_projects_endpoint);
     private_request.headers.emplace_back("Content-type: application/json");
     private_request.headers.push_back("Authorization: Bearer " + access_token);
     Response private_response;
@@ -77,8 +104,11 @@ int main()
         throw std::runtime_error("request failed to get projects");
     }
     std::cout << private_response.raw << '\n';
-    const JsonItem projects = json_create_from_string(private_response.body).object.find("projects")->second;
-    if (projects.array.empty()) {
+    GoogleCloudProjectList projects;
+    const JsonBindResult projects_result = json_bind_from_string(private_response.body, projects);
+    if (projects_result.error)
+        throw std::runtime_error("invalid project list: " + projects_result.error_message);
+    if (projects.projects.empty()) {
         std::cerr << "A project must be created. For details on how and why, see: "
                      "https://cloud.google.com/resource-manager/docs/creating-managing-projects"
                   << std::endl;
@@ -87,15 +117,9 @@ int main()
 
     GoogleCloudProject project;
     /* maybe reverse this array / iterate in reverse? */
-    for(JsonItem const &item : projects.array)
-        if (item.object.find("lifecycleState")->second.text == "ACTIVE") {
-            project = GoogleCloudProject{
-                    /*.projectNumber=*/    item.object.find("projectNumber")->second.text,
-                    /*.projectId=*/    item.object.find("projectId")->second.text,
-                    /*.lifecycleState=*/    item.object.find("lifecycleState")->second.text,
-                    /*.name=*/    item.object.find("name")->second.text,
-                    /*.createTime=*/    item.object.find("createTime")->second.text,
-            };
+    for(GoogleCloudProject const &item : projects.projects)
+        if (item.lifecycleState == "ACTIVE") {
+            project = item;
             break;
         }
     std::cout << "Found project: " << project.name << " (" << project.projectId << ')' << std::endl;
@@ -0,0 +1,179 @@
+#ifndef OAUTH2_MAPPED_FILE_H
+#define OAUTH2_MAPPED_FILE_H
+
+// Read-only memory mapping of a whole file.
+// Using the RAII idiom so the mapping is released when the
+// object goes out of scope, anything pointing into view()
+// must not outlive it.
+
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+enum class MappedFileAccess {
+    SEQUENTIAL = 0,
+    RANDOM
+};
+
+class MappedFile
+{
+public:
+    MappedFile() : data_(nullptr), size_(0)
+    {
+    }
+
+    explicit MappedFile(const std::string &path, MappedFileAccess access = MappedFileAccess::SEQUENTIAL)
+        : data_(nullptr), size_(0)
+    {
+        open(path, access);
+    }
+
+    MappedFile(MappedFile &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+          error_(std::move(other.error_))
+    {
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            error_ = std::move(other.error_);
+        }
+        return *this;
+    }
+
+    // make this unable to be copied
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string &path, MappedFileAccess access = MappedFileAccess::SEQUENTIAL)
+    {
+        close();
+        error_.clear();
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+        (void)access;
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            error_ = "cannot open '" + path + "'";
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            CloseHandle(file);
+            error_ = "cannot stat '" + path + "'";
+            return false;
+        }
+        size_ = static_cast<size_t>(file_size.QuadPart);
+        if (size_ > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL)
+            {
+                data_ = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file_descriptor = ::open(path.c_str(), O_RDONLY);
+        if (file_descriptor < 0)
+        {
+            error_ = "cannot open '" + path + "'";
+            return false;
+        }
+        struct stat file_stat{};
+        if (fstat(file_descriptor, &file_stat) != 0)
+        {
+            ::close(file_descriptor);
+            error_ = "cannot stat '" + path + "'";
+            return false;
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ > 0)
+        {
+            void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+            if (mapping != MAP_FAILED)
+            {
+                data_ = static_cast<const char *>(mapping);
+                madvise(mapping, size_, access == MappedFileAccess::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+            }
+        }
+        // the mapping keeps its own reference to the file
+        ::close(file_descriptor);
+#endif
+        if (size_ > 0 && data_ == nullptr)
+        {
+            size_ = 0;
+            error_ = "cannot map '" + path + "'";
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data_ != nullptr)
+        {
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+            UnmapViewOfFile(data_);
+#else
+            munmap(const_cast<char *>(data_), size_);
+#endif
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    [[nodiscard]] bool is_valid() const
+    {
+        return error_.empty();
+    }
+
+    [[nodiscard]] const std::string &error() const
+    {
+        return error_;
+    }
+
+    [[nodiscard]] const char *data() const
+    {
+        return data_;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return size_;
+    }
+
+    [[nodiscard]] std::string_view view() const
+    {
+        return data_ == nullptr ? std::string_view() : std::string_view(data_, size_);
+    }
+
+private:
+    const char *data_;
+    size_t size_;
+    std::string error_;
+};
+
+#endif /* OAUTH2_MAPPED_FILE_H */
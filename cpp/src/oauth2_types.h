@@ -0,0 +1,68 @@
+#ifndef OAUTH2_TYPES_H
+#define OAUTH2_TYPES_H
+
+// The JSON documents we get back from the identity provider,
+// bound with json_bind.h so they are decoded in one pass.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "json_bind.h"
+
+// Returned by our public GetApplicationEndpoint action.
+struct ApplicationEndpoint
+{
+    std::string clientId;
+    std::string endpoint;
+    std::string openid;
+};
+
+JSON_BINDING(ApplicationEndpoint,
+    JSON_FIELD(ApplicationEndpoint, clientId, JSON_REQUIRED),
+    JSON_FIELD(ApplicationEndpoint, endpoint, JSON_OPTIONAL),
+    JSON_FIELD(ApplicationEndpoint, openid, JSON_REQUIRED));
+
+// https://openid.net/specs/openid-connect-discovery-1_0.html#ProviderMetadata
+struct OpenIDConfiguration
+{
+    std::string issuer;
+    std::string authorization_endpoint;
+    std::string token_endpoint;
+    std::string userinfo_endpoint;
+    std::string jwks_uri;
+    std::vector<std::string> scopes_supported;
+    std::vector<std::string> response_types_supported;
+    std::vector<std::string> id_token_signing_alg_values_supported;
+};
+
+JSON_BINDING(OpenIDConfiguration,
+    JSON_FIELD(OpenIDConfiguration, issuer, JSON_REQUIRED),
+    JSON_FIELD(OpenIDConfiguration, authorization_endpoint, JSON_REQUIRED),
+    JSON_FIELD(OpenIDConfiguration, token_endpoint, JSON_OPTIONAL),
+    JSON_FIELD(OpenIDConfiguration, userinfo_endpoint, JSON_OPTIONAL),
+    JSON_FIELD(OpenIDConfiguration, jwks_uri, JSON_OPTIONAL),
+    JSON_FIELD(OpenIDConfiguration, scopes_supported, JSON_OPTIONAL),
+    JSON_FIELD(OpenIDConfiguration, response_types_supported, JSON_OPTIONAL),
+    JSON_FIELD(OpenIDConfiguration, id_token_signing_alg_values_supported, JSON_OPTIONAL));
+
+// https://tools.ietf.org/html/rfc6749#section-5.1
+struct TokenResponse
+{
+    std::string access_token;
+    std::string token_type;
+    std::int64_t expires_in;
+    std::string refresh_token;
+    std::string id_token;
+    std::string scope;
+};
+
+JSON_BINDING(TokenResponse,
+    JSON_FIELD(TokenResponse, access_token, JSON_REQUIRED),
+    JSON_FIELD(TokenResponse, token_type, JSON_REQUIRED),
+    JSON_FIELD(TokenResponse, expires_in, JSON_OPTIONAL),
+    JSON_FIELD(TokenResponse, refresh_token, JSON_OPTIONAL),
+    JSON_FIELD(TokenResponse, id_token, JSON_OPTIONAL),
+    JSON_FIELD(TokenResponse, scope, JSON_OPTIONAL));
+
+#endif /* OAUTH2_TYPES_H */
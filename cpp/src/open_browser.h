@@ -43,7 +43,7 @@ void open_browser(const URL& url)
     std::string browser_cmd_string = static_cast<const std::ostringstream&>(
                                          std::ostringstream()
                                          << "xdg-open \""
-                                         << url
+                                         << to_string(url)
                                          << '"'
                                          ).str();
     std::cout << browser_cmd_string << std::endl;
@@ -0,0 +1,217 @@
+#ifndef OAUTH2_PERCENT_ENCODING_H
+#define OAUTH2_PERCENT_ENCODING_H
+
+// ----------------------------------------------------------
+// Percent-encoding (RFC 3986 section 2.1)
+// One encoder and decoder for URLs, query parameters and form
+// bodies.  What is left alone depends on where the text goes:
+//   COMPONENT  a single query key or value, only unreserved
+//              characters stay as they are
+//   PATH       a path, '/' and the sub-delims also stay
+//   QUERY      a whole querystring or fragment that may already
+//              contain escapes, only characters that are not
+//              allowed there at all are escaped
+//   FORM       application/x-www-form-urlencoded, space is '+'
+// Runs of characters that need no escaping are found with
+// char_find_invalid and copied in one go.
+//
+// The _to functions write into a buffer the caller made big
+// enough, see percent_encoded_size; the _append functions
+// grow a string once and write into it.
+// ----------------------------------------------------------
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "char_utils.h"
+#include "macros.h"
+
+enum class PercentMode {
+    COMPONENT = 0,
+    PATH,
+    QUERY,
+    FORM
+};
+
+INTERNAL inline
+size_t percent_find_unsafe(std::string_view text, PercentMode mode)
+{
+    switch ( mode ) {
+        case PercentMode::COMPONENT:
+            return char_find_invalid<CHAR_UNRESERVED>(text);
+        case PercentMode::PATH:
+            return char_find_invalid<CHAR_PATH_LITERAL>(text);
+        case PercentMode::QUERY:
+            return char_find_invalid<CHAR_FRAGMENT>(text);
+        case PercentMode::FORM:
+            break;
+    }
+    return char_find_invalid<CHAR_FORM_LITERAL>(text);
+}
+
+// Length of text once encoded.
+ENTRYPOINT inline
+size_t percent_encoded_size(std::string_view text, PercentMode mode)
+{
+    size_t size = text.size();
+    for ( size_t pos = percent_find_unsafe(text, mode); pos != std::string_view::npos;
+          pos = percent_find_unsafe(text, mode) ) {
+        // a space in a form is still one character
+        size += mode == PercentMode::FORM && text[pos] == ' ' ? 0 : 2;
+        text.remove_prefix(pos + 1);
+    }
+    return size;
+}
+
+// Writes text encoded to out, which must have room for
+// percent_encoded_size bytes, and returns the end.
+ENTRYPOINT inline
+char* percent_encode_to(char* out, std::string_view text, PercentMode mode)
+{
+    constexpr char hex[] = "0123456789ABCDEF";
+    while ( !text.empty() ) {
+        const size_t pos = percent_find_unsafe(text, mode);
+        const size_t run = pos == std::string_view::npos ? text.size() : pos;
+        std::memcpy(out, text.data(), run);
+        out += run;
+        if ( pos == std::string_view::npos ) {
+            break;
+        }
+        const auto ch = static_cast<unsigned char>(text[pos]);
+        if ( mode == PercentMode::FORM && ch == ' ' ) {
+            *out++ = '+';
+        } else {
+            *out++ = '%';
+            *out++ = hex[ch >> 4];
+            *out++ = hex[ch & 0x0F];
+        }
+        text.remove_prefix(pos + 1);
+    }
+    return out;
+}
+
+ENTRYPOINT inline
+void percent_encode_append(std::string& out, std::string_view text, PercentMode mode)
+{
+    const size_t size = out.size();
+    out.resize(size + percent_encoded_size(text, mode));
+    percent_encode_to(&out[size], text, mode);
+}
+
+ENTRYPOINT inline
+std::string percent_encode(std::string_view text, PercentMode mode = PercentMode::COMPONENT)
+{
+    std::string out;
+    percent_encode_append(out, text, mode);
+    return out;
+}
+
+INTERNAL inline
+int percent_hex_value(char ch)
+{
+    if ( ch >= '0' && ch <= '9' ) {
+        return ch - '0';
+    }
+    if ( ch >= 'a' && ch <= 'f' ) {
+        return ch - 'a' + 10;
+    }
+    if ( ch >= 'A' && ch <= 'F' ) {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+struct PercentDecodeResult
+{
+    char* end;
+    // a '%' not followed by two hex digits, it is copied as it is
+    bool malformed;
+};
+
+// Writes text decoded to out, which needs text.size() bytes at
+// most.  In FORM mode '+' is a space.
+ENTRYPOINT inline
+PercentDecodeResult percent_decode_to(char* out, std::string_view text, PercentMode mode)
+{
+    PercentDecodeResult result = PercentDecodeResult {};
+    const char* specials = mode == PercentMode::FORM ? "%+" : "%";
+    while ( !text.empty() ) {
+        const size_t pos = text.find_first_of(specials);
+        const size_t run = pos == std::string_view::npos ? text.size() : pos;
+        std::memcpy(out, text.data(), run);
+        out += run;
+        if ( pos == std::string_view::npos ) {
+            break;
+        }
+        if ( text[pos] == '+' ) {
+            *out++ = ' ';
+            text.remove_prefix(pos + 1);
+            continue;
+        }
+        const int high = pos + 2 < text.size() ? percent_hex_value(text[pos + 1]) : -1;
+        const int low = high >= 0 ? percent_hex_value(text[pos + 2]) : -1;
+        if ( low < 0 ) {
+            result.malformed = true;
+            *out++ = '%';
+            text.remove_prefix(pos + 1);
+            continue;
+        }
+        *out++ = static_cast<char>((high << 4) | low);
+        text.remove_prefix(pos + 3);
+    }
+    result.end = out;
+    return result;
+}
+
+// Returns false when text had malformed escapes.
+ENTRYPOINT inline
+bool percent_decode_append(std::string& out, std::string_view text, PercentMode mode)
+{
+    const size_t size = out.size();
+    out.resize(size + text.size());
+    const PercentDecodeResult result = percent_decode_to(&out[size], text, mode);
+    out.resize(result.end - out.data());
+    return !result.malformed;
+}
+
+ENTRYPOINT inline
+std::string percent_decode(std::string_view text, PercentMode mode = PercentMode::COMPONENT)
+{
+    std::string out;
+    percent_decode_append(out, text, mode);
+    return out;
+}
+
+#ifdef TEST_PERCENT_ENCODING
+#include <iostream>
+
+int main()
+{
+    const std::string redirect_uri = "http://localhost:3000/ibm/cloud/appid/callback?a=1&b=2";
+    std::cout << percent_encode(redirect_uri) << '\n'
+              << percent_encode("/a b/c;d=e", PercentMode::PATH) << '\n'
+              << percent_encode("q=a b&r=%20<x>+1", PercentMode::QUERY) << '\n'
+              << percent_encode("a b+c&d=\xc3\xa9*", PercentMode::FORM) << '\n';
+
+    // everything survives a round trip, including every byte value
+    std::string all;
+    for ( int ii = 0; ii < 256; ii++ ) {
+        all += static_cast<char>(ii);
+    }
+    int failures = 0;
+    for ( PercentMode mode : {PercentMode::COMPONENT, PercentMode::PATH, PercentMode::FORM} ) {
+        const std::string encoded = percent_encode(all, mode);
+        failures += encoded.size() != percent_encoded_size(all, mode);
+        failures += percent_decode(encoded, mode) != all;
+    }
+    std::cout << "round trip failures: " << failures << '\n';
+
+    std::cout << percent_decode("4%2F0AX4Xf%2b") << ' ' << percent_decode("a+b%20c", PercentMode::FORM) << '\n';
+    std::string out;
+    std::cout << percent_decode_append(out, "100%", PercentMode::COMPONENT) << ' ' << out << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_PERCENT_ENCODING_H */
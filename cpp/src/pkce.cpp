@@ -0,0 +1,119 @@
+#include <stdexcept>
+#include <vector>
+#include <openssl/evp.h>
+#include "base64url.h"
+#include "pkce.h"
+#include "random_string.h"
+
+std::string pkce_challenge(std::string_view verifier) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    if (EVP_Digest(verifier.data(), verifier.size(), digest, &digest_size, EVP_sha256(), nullptr) != 1) {
+        throw std::runtime_error("SHA-256 failed");
+    }
+    std::string challenge;
+    base64url_encode_append(challenge, digest, digest_size);
+    return challenge;
+}
+
+PkcePair pkce_generate(size_t verifier_length) {
+    PkcePair pair;
+    pkce_generate_batch(&pair, 1, verifier_length);
+    return pair;
+}
+
+void pkce_generate_batch(PkcePair *out, size_t count, size_t verifier_length) {
+    if (verifier_length < 43 || verifier_length > 128) {
+        throw std::invalid_argument("a PKCE verifier is 43 to 128 characters");
+    }
+    // base64url characters are all allowed in a verifier
+    std::vector<std::string> verifiers = generate_random_strings(count, verifier_length, RandomFormat::BASE64URL);
+    for (size_t ii = 0; ii < count; ii++) {
+        out[ii].challenge = pkce_challenge(verifiers[ii]);
+        out[ii].verifier = std::move(verifiers[ii]);
+    }
+}
+
+PkcePool::PkcePool(size_t capacity) : capacity_(capacity == 0 ? 1 : capacity), stopping_(false) {
+    refill_ = std::thread([this] { run_(); });
+}
+
+PkcePool::~PkcePool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    refill_.join();
+}
+
+PkcePair PkcePool::take() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pairs_.empty()) {
+            PkcePair pair = std::move(pairs_.front());
+            pairs_.pop_front();
+            if (pairs_.size() < capacity_ / 2) {
+                wake_.notify_one();
+            }
+            return pair;
+        }
+    }
+    wake_.notify_one();
+    return pkce_generate();
+}
+
+size_t PkcePool::ready() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pairs_.size();
+}
+
+void PkcePool::run_() {
+    std::vector<PkcePair> batch;
+    while (true) {
+        size_t missing = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || pairs_.size() < capacity_ / 2 || pairs_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            missing = capacity_ - pairs_.size();
+        }
+        // hash outside the lock, take() keeps working meanwhile
+        batch.resize(missing);
+        pkce_generate_batch(batch.data(), missing);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (PkcePair &pair : batch) {
+            if (pairs_.size() < capacity_) {
+                pairs_.push_back(std::move(pair));
+            }
+        }
+    }
+}
+
+#ifdef TEST_PKCE
+#include <iostream>
+
+int main() {
+    // RFC 7636 appendix B
+    const std::string challenge = pkce_challenge("dBjftJeZ4CVP-mB92K27uhbUJU1p1r_wW1gFWFOEjXk");
+    std::cout << challenge << '\n';
+    int failures = challenge != "E9Melhoa2OwvFrEMTJguCHaoeK1t8URWbuGJSstw-cM";
+
+    const PkcePair pair = pkce_generate(128);
+    std::cout << pair.verifier << ' ' << pair.challenge << '\n';
+    failures += pair.verifier.size() != 128 || pkce_challenge(pair.verifier) != pair.challenge;
+
+    PkcePool pool(8);
+    std::string last;
+    for (int ii = 0; ii < 100; ii++) {
+        const PkcePair taken = pool.take();
+        failures += taken.verifier.size() != PKCE_VERIFIER_LENGTH || taken.verifier == last;
+        failures += pkce_challenge(taken.verifier) != taken.challenge;
+        last = taken.verifier;
+    }
+    std::cout << "pool ready: " << pool.ready() << ", failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,63 @@
+#ifndef OAUTH2_PKCE_H
+#define OAUTH2_PKCE_H
+
+// Proof Key for Code Exchange, RFC 7636, S256 method only.
+// The verifier goes with the token request, its SHA-256 in
+// base64url (the challenge) with the authorization request.
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+constexpr const char *PKCE_METHOD = "S256";
+// 32 bytes of randomness, the shortest verifier allowed is 43
+constexpr size_t PKCE_VERIFIER_LENGTH = 43;
+
+struct PkcePair
+{
+    std::string verifier;
+    std::string challenge;
+};
+
+std::string pkce_challenge(std::string_view verifier);
+
+PkcePair pkce_generate(size_t verifier_length = PKCE_VERIFIER_LENGTH);
+
+// count pairs, the verifiers are drawn in one go
+void pkce_generate_batch(PkcePair *out, size_t count, size_t verifier_length = PKCE_VERIFIER_LENGTH);
+
+// Pairs made ahead of time by a background thread, so starting a
+// login does not hash anything.  The thread tops the pool up in
+// batches when it falls below half.  take() never waits for it, an
+// empty pool makes a pair on the spot.
+class PkcePool
+{
+public:
+    explicit PkcePool(size_t capacity = 64);
+
+    ~PkcePool();
+
+    // make this unable to be copied
+    PkcePool(PkcePool const &) = delete;
+    PkcePool &operator=(PkcePool const &) = delete;
+
+    PkcePair take();
+
+    [[nodiscard]] size_t ready() const;
+
+private:
+    const size_t capacity_;
+    std::deque<PkcePair> pairs_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+    std::thread refill_;
+
+    void run_();
+};
+
+#endif /* OAUTH2_PKCE_H */
@@ -1,17 +1,292 @@
-#include <random>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include "random_string.h"
 
-std::string generate_random_string(const size_t required_length) {
-    constexpr char alphanum[] = "0123456789"
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+#include <random>
+#else
+#include <cerrno>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+#endif
+
+// ----------------------------------------------------------
+// ChaCha20 DRBG (RFC 8439 block function)
+// A buffer of keystream is made sixteen blocks at a time.  The
+// first 32 bytes of every buffer become the next key and each
+// byte is wiped once it is handed out, so what a thread has
+// already produced cannot be recovered from its state (fast
+// key erasure).  The key is replaced from the OS every
+// RESEED_BYTES bytes and in a child after fork().
+// ----------------------------------------------------------
+
+namespace {
+
+constexpr size_t CHACHA_BLOCK = 64;
+constexpr size_t CHACHA_KEY = 32;
+constexpr size_t BUFFER_BLOCKS = 16;
+constexpr size_t RESEED_BYTES = 1u << 20;
+
+inline std::uint32_t rotl(std::uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+inline void quarter_round(std::uint32_t *s, int a, int b, int c, int d) {
+    s[a] += s[b]; s[d] = rotl(s[d] ^ s[a], 16);
+    s[c] += s[d]; s[b] = rotl(s[b] ^ s[c], 12);
+    s[a] += s[b]; s[d] = rotl(s[d] ^ s[a], 8);
+    s[c] += s[d]; s[b] = rotl(s[b] ^ s[c], 7);
+}
+
+inline std::uint32_t load32(const unsigned char *p) {
+    return std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 | std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24;
+}
+
+inline void store32(unsigned char *p, std::uint32_t v) {
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+void chacha20_block(const unsigned char key[CHACHA_KEY], std::uint32_t counter, const unsigned char nonce[12],
+                    unsigned char out[CHACHA_BLOCK]) {
+    std::uint32_t input[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    for (int ii = 0; ii < 8; ii++) {
+        input[4 + ii] = load32(key + 4 * ii);
+    }
+    input[12] = counter;
+    for (int ii = 0; ii < 3; ii++) {
+        input[13 + ii] = load32(nonce + 4 * ii);
+    }
+    std::uint32_t state[16];
+    std::memcpy(state, input, sizeof(state));
+    for (int round = 0; round < 10; round++) {
+        quarter_round(state, 0, 4, 8, 12);
+        quarter_round(state, 1, 5, 9, 13);
+        quarter_round(state, 2, 6, 10, 14);
+        quarter_round(state, 3, 7, 11, 15);
+        quarter_round(state, 0, 5, 10, 15);
+        quarter_round(state, 1, 6, 11, 12);
+        quarter_round(state, 2, 7, 8, 13);
+        quarter_round(state, 3, 4, 9, 14);
+    }
+    for (int ii = 0; ii < 16; ii++) {
+        store32(out + 4 * ii, state[ii] + input[ii]);
+    }
+}
+
+void os_random(unsigned char *out, size_t size) {
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    // MSVC's random_device is rand_s, which is the system CSPRNG
+    std::random_device device;
+    for (size_t ii = 0; ii < size; ii++) {
+        out[ii] = static_cast<unsigned char>(device());
+    }
+#elif defined(__linux__)
+    while (size > 0) {
+        const ssize_t got = getrandom(out, size, 0);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("getrandom failed");
+        }
+        out += got;
+        size -= static_cast<size_t>(got);
+    }
+#else
+    // getentropy gives at most 256 bytes a call
+    for (size_t done = 0; done < size; done += 256) {
+        const size_t chunk = size - done < 256 ? size - done : 256;
+        if (getentropy(out + done, chunk) != 0) {
+            throw std::runtime_error("getentropy failed");
+        }
+    }
+#endif
+}
+
+class ChaChaDrbg {
+public:
+    ChaChaDrbg() : available_(0), produced_(0), pid_(0) {
+        reseed_();
+    }
+
+    ~ChaChaDrbg() {
+        wipe_(key_, sizeof(key_));
+        wipe_(buffer_, sizeof(buffer_));
+    }
+
+    void fill(unsigned char *out, size_t size) {
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(__WINDOWS__)
+        // a forked child must not repeat its parent's output
+        if (pid_ != getpid()) {
+            reseed_();
+        }
+#endif
+        while (size > 0) {
+            if (available_ == 0) {
+                refill_();
+            }
+            const size_t take = size < available_ ? size : available_;
+            unsigned char *from = buffer_ + sizeof(buffer_) - available_;
+            std::memcpy(out, from, take);
+            wipe_(from, take);
+            available_ -= take;
+            out += take;
+            size -= take;
+        }
+    }
+
+private:
+    unsigned char key_[CHACHA_KEY];
+    unsigned char buffer_[CHACHA_BLOCK * BUFFER_BLOCKS];
+    // unread bytes at the end of buffer_
+    size_t available_;
+    size_t produced_;
+    long pid_;
+
+    static void wipe_(void *p, size_t size) {
+        // volatile so the compiler cannot drop the stores
+        volatile unsigned char *bytes = static_cast<volatile unsigned char *>(p);
+        while (size--) {
+            *bytes++ = 0;
+        }
+    }
+
+    void reseed_() {
+        os_random(key_, sizeof(key_));
+        wipe_(buffer_, sizeof(buffer_));
+        available_ = 0;
+        produced_ = 0;
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(__WINDOWS__)
+        pid_ = getpid();
+#endif
+    }
+
+    void refill_() {
+        if (produced_ >= RESEED_BYTES) {
+            reseed_();
+        }
+        // every key is used for one buffer, so the nonce can stay zero
+        const unsigned char nonce[12] = {};
+        for (size_t block = 0; block < BUFFER_BLOCKS; block++) {
+            chacha20_block(key_, static_cast<std::uint32_t>(block), nonce, buffer_ + block * CHACHA_BLOCK);
+        }
+        std::memcpy(key_, buffer_, CHACHA_KEY);
+        wipe_(buffer_, CHACHA_KEY);
+        available_ = sizeof(buffer_) - CHACHA_KEY;
+        produced_ += available_;
+    }
+};
+
+ChaChaDrbg &thread_drbg() {
+    static thread_local ChaChaDrbg drbg;
+    return drbg;
+}
+
+constexpr char alphanumeric[] = "0123456789"
                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                                 "abcdefghijklmnopqrstuvwxyz";
-    std::uniform_int_distribution<int> d(0, 15);
+constexpr char base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                             "abcdefghijklmnopqrstuvwxyz"
+                             "0123456789-_";
 
-    std::random_device rd1;
-    std::string rand_str (required_length, '\0');
-    for (auto& c : rand_str) {
-        c = alphanum[d(rd1)];
+// Fills out with characters from alphabet.  A byte is only used
+// when it is below the largest multiple of the alphabet size, so
+// every character is equally likely.
+void fill_from_alphabet(char *out, size_t length, const char *alphabet, size_t alphabet_size) {
+    const unsigned limit = 256 - 256 % alphabet_size;
+    unsigned char bytes[256];
+    while (length > 0) {
+        // ask for a little more than needed, 62 rejects 8 bytes in 256
+        const size_t want = length + length / 16 + 1;
+        const size_t draw = want < sizeof(bytes) ? want : sizeof(bytes);
+        thread_drbg().fill(bytes, draw);
+        for (size_t ii = 0; ii < draw && length > 0; ii++) {
+            if (bytes[ii] < limit) {
+                *out++ = alphabet[bytes[ii] % alphabet_size];
+                length--;
+            }
+        }
     }
+}
+
+void fill_random(char *out, size_t length, RandomFormat format) {
+    if (format == RandomFormat::BASE64URL) {
+        fill_from_alphabet(out, length, base64url, 64);
+    } else {
+        fill_from_alphabet(out, length, alphanumeric, 62);
+    }
+}
 
+} // namespace
+
+void random_bytes(void *out, size_t size) {
+    thread_drbg().fill(static_cast<unsigned char *>(out), size);
+}
+
+std::string generate_random_string(const size_t required_length, RandomFormat format) {
+    std::string rand_str(required_length, '\0');
+    fill_random(&rand_str[0], required_length, format);
     return rand_str;
 }
+
+std::vector<std::string> generate_random_strings(size_t count, size_t length, RandomFormat format) {
+    // one draw for all of them, then cut into strings
+    std::string all(count * length, '\0');
+    fill_random(&all[0], all.size(), format);
+    std::vector<std::string> strings;
+    strings.reserve(count);
+    for (size_t ii = 0; ii < count; ii++) {
+        strings.emplace_back(all, ii * length, length);
+    }
+    return strings;
+}
+
+#ifdef TEST_RANDOM_STRING
+#include <iostream>
+#include <set>
+
+int main() {
+    // RFC 8439 section 2.3.2
+    unsigned char key[CHACHA_KEY];
+    for (size_t ii = 0; ii < sizeof(key); ii++) {
+        key[ii] = static_cast<unsigned char>(ii);
+    }
+    const unsigned char nonce[12] = {0, 0, 0, 0x09, 0, 0, 0, 0x4a, 0, 0, 0, 0};
+    unsigned char block[CHACHA_BLOCK];
+    chacha20_block(key, 1, nonce, block);
+    const unsigned char expected[8] = {0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15};
+    int failures = std::memcmp(block, expected, sizeof(expected)) != 0;
+    std::cout << "chacha20 test vector: " << (failures == 0 ? "ok" : "FAILED") << '\n';
+
+    std::cout << generate_random_string(10) << ' '
+              << generate_random_string(43, RandomFormat::BASE64URL) << '\n';
+
+    // every character shows up, and about as often as the others
+    const std::vector<std::string> tokens = generate_random_strings(10000, 62);
+    size_t counts[256] = {};
+    std::set<std::string> unique;
+    for (const std::string &token : tokens) {
+        unique.insert(token);
+        for (char ch : token) {
+            counts[static_cast<unsigned char>(ch)]++;
+        }
+    }
+    for (char ch : std::string(alphanumeric)) {
+        // 10000 expected, the deviation is about 100
+        const size_t count = counts[static_cast<unsigned char>(ch)];
+        if (count < 9400 || count > 10600) {
+            std::cout << "character " << ch << " drawn " << count << " times\n";
+            failures++;
+        }
+    }
+    failures += unique.size() != tokens.size();
+    std::cout << unique.size() << " unique tokens, failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
@@ -1,6 +1,26 @@
 #ifndef OAUTH2_RANDOM_STRING_H
 #define OAUTH2_RANDOM_STRING_H
 
-std::string generate_random_string(size_t);
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Every thread has its own ChaCha20 generator seeded from the
+// operating system (getrandom), so these never lock and the
+// output is fit for secrets: state, nonce and PKCE verifiers.
+enum class RandomFormat {
+    // [0-9A-Za-z], each character is one unbiased pick of 62
+    ALPHANUMERIC = 0,
+    // [A-Za-z0-9-_], six bits a character, no padding
+    BASE64URL
+};
+
+void random_bytes(void *out, size_t size);
+
+std::string generate_random_string(size_t length, RandomFormat format = RandomFormat::ALPHANUMERIC);
+
+// count strings of the same length, drawn from the generator in bulk
+std::vector<std::string> generate_random_strings(size_t count, size_t length,
+                                                 RandomFormat format = RandomFormat::ALPHANUMERIC);
 
 #endif /* OAUTH2_RANDOM_STRING_H */
@@ -0,0 +1,183 @@
+#ifndef OAUTH2_SINGLE_FLIGHT_H
+#define OAUTH2_SINGLE_FLIGHT_H
+
+// Single-flight calls.
+// When several threads ask for the same key at once only the
+// first one runs the call, the others wait for it and get the
+// same result, or the same exception.  Nothing is cached: once
+// the call returns the next caller for the key runs it again.
+// Waiters give up after max_wait with SingleFlightTimeout, the
+// call itself carries on for whoever is still waiting.
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+class SingleFlightTimeout : public std::runtime_error
+{
+public:
+    SingleFlightTimeout() : std::runtime_error("timed out waiting for a request already in flight")
+    {
+    }
+};
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class SingleFlight
+{
+public:
+    SingleFlight() = default;
+
+    // make this unable to be copied
+    SingleFlight(SingleFlight const &) = delete;
+    SingleFlight &operator=(SingleFlight const &) = delete;
+
+    template <typename Call>
+    Value run(Key const &key, Call &&call, std::chrono::milliseconds max_wait = std::chrono::seconds(30))
+    {
+        std::promise<Value> promise;
+        std::shared_future<Value> result;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto found = calls_.find(key);
+            if (found != calls_.end())
+            {
+                result = found->second;
+            }
+            else
+            {
+                calls_.emplace(key, promise.get_future().share());
+            }
+        }
+        if (result.valid())
+        {
+            if (result.wait_for(max_wait) != std::future_status::ready)
+            {
+                throw SingleFlightTimeout();
+            }
+            return result.get();
+        }
+
+        // we are the one making the call
+        try
+        {
+            Value value = call();
+            finish_(key);
+            promise.set_value(value);
+            return value;
+        }
+        catch (...)
+        {
+            finish_(key);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    // keys with a call running
+    [[nodiscard]] size_t in_flight() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return calls_.size();
+    }
+
+private:
+    std::unordered_map<Key, std::shared_future<Value>, Hash> calls_;
+    mutable std::mutex mutex_;
+
+    // Removed before the result is published, so a caller that
+    // arrives afterwards starts a new call instead of reusing
+    // a finished one.
+    void finish_(Key const &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.erase(key);
+    }
+};
+
+#ifdef TEST_SINGLE_FLIGHT
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    SingleFlight<std::string, int> flights;
+    std::atomic<int> calls(0);
+    std::atomic<int> failures(0);
+
+    // eight threads, one call
+    std::vector<std::thread> threads;
+    for (int ii = 0; ii < 8; ii++)
+    {
+        threads.emplace_back([&] {
+            const int value = flights.run("token", [&calls] {
+                calls++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                return 42;
+            });
+            failures += value != 42;
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    threads.clear();
+    std::cout << "calls: " << calls << '\n';
+    failures += calls != 1 || flights.in_flight() != 0;
+
+    // everyone sees the error
+    std::atomic<int> errors(0);
+    for (int ii = 0; ii < 4; ii++)
+    {
+        threads.emplace_back([&] {
+            try
+            {
+                flights.run("token", [] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    return std::stoi("not a number");
+                });
+            }
+            catch (std::invalid_argument const &)
+            {
+                errors++;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    threads.clear();
+    std::cout << "errors: " << errors << '\n';
+    failures += errors != 4;
+
+    // a waiter gives up, the caller still gets its answer
+    std::thread slow([&] { failures += flights.run("slow", [] {
+                                           std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                                           return 1;
+                                       }) != 1; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    try
+    {
+        flights.run("slow", [] { return 2; }, std::chrono::milliseconds(10));
+        failures++;
+    }
+    catch (SingleFlightTimeout const &error)
+    {
+        std::cout << error.what() << '\n';
+    }
+    slow.join();
+    std::cout << "failures: " << failures << '\n';
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_SINGLE_FLIGHT_H */
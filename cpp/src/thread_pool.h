@@ -0,0 +1,163 @@
+#ifndef OAUTH2_THREAD_POOL_H
+#define OAUTH2_THREAD_POOL_H
+
+// Small work-stealing thread pool.
+// Every worker owns a queue, it takes work from the back of
+// its own queue and, when that is empty, steals from the
+// front of the others.  Tasks submitted from outside the pool
+// are spread round-robin over the queues.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threads = 0) : pending_(0), next_(0), stopping_(false)
+    {
+        if (threads == 0)
+        {
+            threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        for (size_t ii = 0; ii < threads; ii++)
+        {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (size_t ii = 0; ii < threads; ii++)
+        {
+            threads_.emplace_back([this, ii] { run_(ii); });
+        }
+    }
+
+    // finishes everything already queued before returning
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    // make this unable to be copied
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    void submit(Task task)
+    {
+        // work created by a worker stays local to it
+        size_t index = current_worker_() == this ? current_index_()
+                                                 : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        {
+            std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+            workers_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            pending_++;
+        }
+        wake_.notify_one();
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return workers_.size();
+    }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    size_t pending_;
+    std::atomic<size_t> next_;
+    bool stopping_;
+
+    static ThreadPool *&current_worker_()
+    {
+        static thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    static size_t &current_index_()
+    {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    bool try_pop_(size_t index, Task &task)
+    {
+        Worker &worker = *workers_[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool try_steal_(size_t thief, Task &task)
+    {
+        for (size_t offset = 1; offset < workers_.size(); offset++)
+        {
+            Worker &victim = *workers_[(thief + offset) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run_(size_t index)
+    {
+        current_worker_() = this;
+        current_index_() = index;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex_);
+                wake_.wait(lock, [this] { return pending_ > 0 || stopping_; });
+                if (pending_ == 0)
+                {
+                    return; // stopping and nothing left to do
+                }
+                pending_--;
+            }
+            // pending_ counted one task for us, it is in one of the
+            // queues even if another worker got to ours first
+            Task task;
+            while (!try_pop_(index, task) && !try_steal_(index, task))
+            {
+                std::this_thread::yield();
+            }
+            task();
+        }
+    }
+};
+
+#endif /* OAUTH2_THREAD_POOL_H */
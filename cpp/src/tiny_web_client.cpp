@@ -1,6 +1,7 @@
 // SSL Example Reference: https://stackoverflow.com/questions/41229601/openssl-in-c-socket-connection-https-client
 // Client Reference: https://stackoverflow.com/questions/22077802/simple-c-example-of-doing-an-http-post-and-consuming-the-response
 #include <algorithm>
+#include <cctype>
 #include <string>
 #include <map>
 #include <map>
@@ -11,28 +12,50 @@
 #include <cstring>      /* memcpy, memset */
 #include "config.h"
 #include "tiny_web_client.h"
+#include "percent_encoding.h"
 
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <io.h>
 #include <winsock2.h>
+#include <ws2tcpip.h>
 
 // SSL
 #else
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>     /* read, write, close */
 #include <sys/socket.h> /* socket, connect */
 #include <netinet/in.h> /* struct sockaddr_in, struct sockaddr */
-#include <netdb.h>      /* struct hostent, gethostbyname */
+#include <netdb.h>      /* struct addrinfo, getaddrinfo */
 #endif
 
 #ifdef USE_OPENSSL
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/x509v3.h>
 #endif
 
-#ifdef TEST_TINY_WEB_CLIENT
-#include "json_parser.cpp"
-#endif
+std::string_view response_header(Response const &response, std::string_view name) {
+    // the first line is the status line
+    for (size_t ii = 1; ii < response.headers.size(); ii++) {
+        const std::string_view header = response.headers[ii];
+        if (header.size() <= name.size() || header[name.size()] != ':') {
+            continue;
+        }
+        if (!std::equal(name.begin(), name.end(), header.begin(), [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            })) {
+            continue;
+        }
+        std::string_view value = header.substr(name.size() + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        return value;
+    }
+    return {};
+}
 
 void error(const char *msg)
 {
@@ -55,18 +78,21 @@ std::string create_message(Request const &request)
 {
     //char *message_fmt = "GET / HTTP/1.0\r\n\r\n";
     std::ostringstream oss;
-    oss << request.verb
-        << " "
-        << request.uri.path;
-    if ( !request.uri.querystring.empty() ) {
-        oss << "?" << request.uri.querystring;
-    }
-    oss << " "
-    // @TODO add in support for querystring/parameters
-        << request.uri.protocol
-        << "/"
-        << request.uri.protocol_version
-        << "\r\n";
+    if ( !request.request_line.empty() ) {
+        oss << request.request_line;
+    } else {
+        oss << request.verb
+            << " "
+            << request.uri.path;
+        if ( !request.uri.querystring.empty() ) {
+            oss << "?" << request.uri.querystring;
+        }
+        oss << " "
+            << request.uri.protocol
+            << "/"
+            << request.uri.protocol_version
+            << "\r\n";
+    }
     for( const std::string& header : request.headers )
         oss << header << "\r\n";
 
@@ -74,48 +100,106 @@ std::string create_message(Request const &request)
     return oss.str();
 }
 
+static void set_uri(URI &uri, const URL &u) {
+    uri.protocol = "HTTP";
+    uri.protocol_version = "1.0";
+    if ( u.protocol() == "https" ) {
+        uri.use_ssl = true;
+        uri.port = 443;
+    } else {
+        uri.use_ssl = false;
+        uri.port = 80;
+    }
+    uri.host = u.domain();
+    // the request line needs a path even when the URL has none
+    uri.path = u.path().empty() ? std::string_view("/") : u.path();
+    uri.querystring = u.querystring();
+    uri.fragment = u.fragment();
+}
+
 Request make_request(const URL &u, const std::string &verb) {
     Request req;
     req.verb = verb;
-    req.uri.protocol = "HTTP";
-    req.uri.protocol_version = "1.0";
-    if ( u.protocol ==  "https") {
-        req.uri.use_ssl = true;
-        req.uri.port = 443;
-    } else {
-        req.uri.use_ssl = false;
-        req.uri.port = 80;
-    }
-    req.uri.host = u.domain;
-    req.uri.path = u.path;
-    req.uri.querystring = u.encoded_querystring();
-    req.uri.fragment = u.fragment;
+    set_uri(req.uri, u);
     req.headers.push_back("HOST: "+req.uri.host);
     return req;
 }
 
+// The request line and Host header were formatted at compile time.
+Request make_request(const UrlConstant &u) {
+    Request req;
+    req.verb = u.verb;
+    set_uri(req.uri, URL(u));
+    req.request_line = u.request_line;
+    req.headers.emplace_back(u.host_header);
+    return req;
+}
+
+// Parsed and formatted once by the cache, the request keeps the
+// entry alive for its request line.
+Request make_request(EndpointHandle endpoint) {
+    Request req;
+    req.verb = endpoint->verb;
+    set_uri(req.uri, endpoint->url);
+    req.request_line = endpoint->request_line;
+    req.headers.push_back(endpoint->host_header);
+    req.endpoint = std::move(endpoint);
+    return req;
+}
+
 // Using the RAII idiom to ensure our SSL resource is cleaned up
 [[nodiscard]] bool SSLClient::is_valid() const {
     return valid_;
 }
 
-bool SSLClient::connect_to_socket(int socket_file_descriptor)
+[[nodiscard]] long SSLClient::verify_result() const {
+    return verify_result_;
+}
+
+bool SSLClient::connect_to_socket(int socket_file_descriptor, std::string const &host)
 {
     if (!init_class())
     {
         return false;
     }
+    // an IP address is matched against the certificate's IP
+    // entries and is not sent as SNI, a name is both
+    X509_VERIFY_PARAM *param = SSL_get0_param(session_);
+    if (X509_VERIFY_PARAM_set1_ip_asc(param, host.c_str()) != 1)
+    {
+        SSL_set_hostflags(session_, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+        if (SSL_set1_host(session_, host.c_str()) != 1 || SSL_set_tlsext_host_name(session_, host.c_str()) != 1)
+        {
+            shutdown();
+            return false;
+        }
+    }
     ssl_socket_file_descriptor_ = SSL_get_fd(session_);
     SSL_set_fd(session_, socket_file_descriptor);
     int err = SSL_connect(session_);
+    verify_result_ = SSL_get_verify_result(session_);
     if (err <= 0)
     {
         printf("Error creating SSL connection.  err=%x\n", err);
+        if (verify_result_ != X509_V_OK)
+        {
+            printf("Certificate refused: %s\n", X509_verify_cert_error_string(verify_result_));
+        }
         fflush(stdout);
         display_errors();
         shutdown();
         return false;
     }
+    // SSL_VERIFY_PEER has already failed the handshake otherwise,
+    // this is in case a server sent no certificate at all
+    X509 *certificate = SSL_get_peer_certificate(session_);
+    if (!certificate || verify_result_ != X509_V_OK)
+    {
+        X509_free(certificate);
+        shutdown();
+        return false;
+    }
+    X509_free(certificate);
     printf("SSL connection using %s\n", SSL_get_cipher(session_));
     return true;
 }
@@ -129,39 +213,14 @@ SSL *SSLClient::session() {
     return session_;
 }
 
-int http_send(Request&request, Response &response, const std::map<std::string, std::string> &post_fields)
+HttpConnection::~HttpConnection()
 {
-    std::string content;
-    if ( request.verb == "POST" ) {
-        if ( post_fields.empty() ) {
-            throw std::runtime_error("request was POST, but no post fields given to http_send");
-        }
-        std::ostringstream ss;
-        {
-            size_t counter = 0;
-            for (auto const &[key, value] : post_fields) {
-                // TODO encode value for special characters
-                ss << key << "=" << value;
-                if (counter < post_fields.size() - 1) {
-                    ss << "&";
-                }
-                counter++;
-            }
-        }
-        content = ss.str();
-        request.headers.emplace_back("Content-Type: application/x-www-form-urlencoded");
-        std::cout << "POST Data: " << content << '\n';
-
-        request.headers.push_back(static_cast<const std::ostringstream&>(
-                std::ostringstream() << "Content-Length: " << content.size()).str());
-    }
-    std::string message = create_message(request);
-    if ( !content.empty() ) {
-        message += content + "\r\n";
-    }
-    std::cout << "Target: " << create_host(request) << '\n'
-              << "Sending: " << message;
+    close();
+}
 
+int HttpConnection::open(URI const &uri, ResponseError &error)
+{
+    close();
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
     WSADATA wsaData;
     int iResult = WSAStartup(MAKEWORD(2,2), &wsaData);
@@ -169,84 +228,184 @@ int http_send(Request&request, Response &response, const std::map<std::string, s
         std::cerr << "WSAStartup returned: " << iResult << std::endl;
         return iResult;
     }
+    winsock_started_ = true;
 #endif
 
-    struct hostent *server;
-    struct sockaddr_in serv_addr{};
-    SSLClient ssl_client;
+    /* lookup the ip addresses, IPv4 or IPv6; getaddrinfo is safe
+       to call from several threads, gethostbyname is not */
+    struct addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses = nullptr;
+    if (getaddrinfo(uri.host.c_str(), std::to_string(uri.port).c_str(), &hints, &addresses) != 0 ||
+        addresses == nullptr)
+    {
+        error.message = "ERROR no such host";
+        error.code = 1002;
+        close();
+        return error.code;
+    }
 
-    /* create the socket */
-    int socket_file_descriptor = (int)socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_file_descriptor < 0)
+    /* create the socket and connect it, trying each address in turn */
+    error.code = 1001;
+    for (struct addrinfo *address = addresses; address != nullptr; address = address->ai_next)
+    {
+        socket_file_descriptor_ = (int)socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (socket_file_descriptor_ < 0)
+        {
+            continue;
+        }
+        if (connect(socket_file_descriptor_, address->ai_addr, (int)address->ai_addrlen) == 0)
+        {
+            error.code = 0;
+            break;
+        }
+        error.code = 1003;
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+        closesocket(socket_file_descriptor_);
+#else
+        ::close(socket_file_descriptor_);
+#endif
+        socket_file_descriptor_ = -1;
+    }
+    freeaddrinfo(addresses);
+    if (error.code != 0)
     {
-        response.error.message = "ERROR opening socket";
-        response.error.code = 1001;
+        error.message = error.code == 1001 ? "ERROR opening socket" : "ERROR connecting";
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
         std::cerr << "WSAGetLastError: " << WSAGetLastError() << std::endl;
 #endif
-        return response.error.code;
+        close();
+        return error.code;
     }
 
-    /* lookup the ip address */
-    server = gethostbyname(request.uri.host.c_str());
-    if (server == NULL)
+    if (uri.use_ssl)
     {
-        response.error.message = "ERROR no such host";
-        response.error.code = 1002;
-        return response.error.code;
+        ssl_client_ = std::make_unique<SSLClient>();
+        ssl_client_->connect_to_socket(socket_file_descriptor_, uri.host);
+        if (!ssl_client_->is_valid())
+        {
+            error.message = "ERROR failed to open ssl connection";
+            if (ssl_client_->verify_result() != X509_V_OK)
+            {
+                error.message += std::string(": ") + X509_verify_cert_error_string(ssl_client_->verify_result());
+            }
+            error.code = 1100;
+            close();
+            return error.code;
+        }
     }
+    host_ = uri.host;
+    port_ = uri.port;
+    use_ssl_ = uri.use_ssl;
+    opened_at_ = std::chrono::steady_clock::now();
+    return 0;
+}
+
+bool HttpConnection::is_open() const
+{
+    return socket_file_descriptor_ >= 0;
+}
+
+bool HttpConnection::is_for(URI const &uri) const
+{
+    return is_open() && host_ == uri.host && port_ == uri.port && use_ssl_ == uri.use_ssl;
+}
 
-    /* fill in the structure */
+bool HttpConnection::is_alive()
+{
+    if (!is_open())
+    {
+        return false;
+    }
+    // nothing has been sent yet, so anything to read (or the end of
+    // the stream) means the server gave up on us; the peek must not
+    // block when there is nothing
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-    ZeroMemory(&serv_addr, sizeof(serv_addr));
+    u_long non_blocking = 1;
+    ioctlsocket(socket_file_descriptor_, FIONBIO, &non_blocking);
 #else
-    memset(&serv_addr, 0, sizeof(serv_addr));
+    const int flags = fcntl(socket_file_descriptor_, F_GETFL, 0);
+    fcntl(socket_file_descriptor_, F_SETFL, flags | O_NONBLOCK);
 #endif
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(request.uri.port);
-    memcpy(&serv_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-
-    /* connect the socket */
-    if (connect(socket_file_descriptor, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+    char byte;
+    bool alive;
+    if (ssl_client_)
     {
-        response.error.message = "ERROR connecting";
-        response.error.code = 1003;
-        return response.error.code;
+        // also reads TLS 1.3 session tickets, which are not data
+        const int bytes = SSL_peek(ssl_client_->session(), &byte, 1);
+        alive = bytes <= 0 && SSL_get_error(ssl_client_->session(), bytes) == SSL_ERROR_WANT_READ;
     }
+    else
+    {
+        const int bytes = recv(socket_file_descriptor_, &byte, 1, MSG_PEEK);
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+        alive = bytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        alive = bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+    }
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    non_blocking = 0;
+    ioctlsocket(socket_file_descriptor_, FIONBIO, &non_blocking);
+#else
+    fcntl(socket_file_descriptor_, F_SETFL, flags);
+#endif
+    return alive;
+}
 
-    if (request.uri.use_ssl)
+std::chrono::steady_clock::time_point HttpConnection::opened_at() const
+{
+    return opened_at_;
+}
+
+void HttpConnection::close()
+{
+    // the TLS session goes before the socket it uses
+    ssl_client_.reset();
+    if (socket_file_descriptor_ >= 0)
     {
-        ssl_client.connect_to_socket(socket_file_descriptor);
-        if (!ssl_client.is_valid())
-        {
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-            closesocket(socket_file_descriptor);
+        closesocket(socket_file_descriptor_);
 #else
-            close(socket_file_descriptor);
+        ::close(socket_file_descriptor_);
 #endif
-            response.error.message = "ERROR failed to open ssl connection";
-            response.error.code = 1100;
-            return response.error.code;
-        }
+        socket_file_descriptor_ = -1;
+    }
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    if (winsock_started_)
+    {
+        WSACleanup();
+        winsock_started_ = false;
     }
+#endif
+    host_.clear();
+    port_ = 0;
+    use_ssl_ = false;
+}
+
+int HttpConnection::exchange(std::string const &message, Response &response)
+{
+    if (!is_open())
+    {
+        response.error.message = "ERROR connection is not open";
+        response.error.code = 1003;
+        return response.error.code;
+    }
+    SSL *session = ssl_client_ ? ssl_client_->session() : nullptr;
 
     /* send the request */
 
     int bytes, total = (int)message.size(), sent = 0;
     do
     {
-        if (ssl_client.is_valid())
+        if (session)
         {
-            bytes = SSL_write(ssl_client.session(), message.c_str(), (int)message.size());
+            bytes = SSL_write(session, message.c_str(), (int)message.size());
             response.error.code = 1004;
             if (bytes < 0)
             {
-#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-                closesocket(socket_file_descriptor);
-#else
-                close(socket_file_descriptor);
-#endif
-                int err = SSL_get_error(ssl_client.session(), bytes);
+                int err = SSL_get_error(session, bytes);
                 switch (err)
                 {
                 case SSL_ERROR_WANT_WRITE:
@@ -268,20 +427,22 @@ int http_send(Request&request, Response &response, const std::map<std::string, s
                     response.error.message = "ERROR unknown ssl error when writing to socket";
                     break;
                 }
+                close();
                 return response.error.code;
             }
         }
         else
         {
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-            bytes = send(socket_file_descriptor, message.c_str() + sent, total - sent, 0);
+            bytes = send(socket_file_descriptor_, message.c_str() + sent, total - sent, 0);
 #else
-            bytes = write(socket_file_descriptor, message.c_str() + sent, total - sent);
+            bytes = write(socket_file_descriptor_, message.c_str() + sent, total - sent);
 #endif
             if (bytes < 0)
             {
                 response.error.message = "ERROR writing message to socket";
                 response.error.code = 1004;
+                close();
                 return response.error.code;
             }
             if (bytes == 0)
@@ -304,30 +465,25 @@ int http_send(Request&request, Response &response, const std::map<std::string, s
     int received = 0;
     do
     {
-        if (ssl_client.is_valid())
+        if (session)
         {
-            bytes = SSL_read(ssl_client.session(), buffer + received, total - received);
+            bytes = SSL_read(session, buffer + received, total - received);
         }
         else
         {
 #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-            bytes = recv(socket_file_descriptor, buffer + received, total - received, 0);
+            bytes = recv(socket_file_descriptor_, buffer + received, total - received, 0);
 #else
-            bytes = read(socket_file_descriptor, buffer + received, total - received);
+            bytes = read(socket_file_descriptor_, buffer + received, total - received);
 #endif
         }
         if (bytes < 0)
         {
-#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-            closesocket(socket_file_descriptor);
-#else
-            close(socket_file_descriptor);
-#endif
             // check for ssl errors if we are using ssl
-            if (ssl_client.is_valid())
+            if (session)
             {
                 // https://www.openssl.org/docs/man1.1.1/man3/SSL_get_error.html
-                int err = SSL_get_error(ssl_client.session(), bytes);
+                int err = SSL_get_error(session, bytes);
                 switch (err)
                 {
                 case SSL_ERROR_WANT_READ:
@@ -355,6 +511,7 @@ int http_send(Request&request, Response &response, const std::map<std::string, s
                 response.error.message = "ERROR reading response from socket";
             }
             response.error.code = 1005;
+            close();
             return response.error.code;
         }
         if (bytes == 0)
@@ -374,26 +531,15 @@ int http_send(Request&request, Response &response, const std::map<std::string, s
     } while (true);
     incoming_data << buffer;
 
-    /* close the socket */
-#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
-    closesocket(socket_file_descriptor);
-    WSACleanup();
-#else
-    close(socket_file_descriptor);
-#endif
+    /* close the socket, it has carried its one request */
+    close();
     response.raw = incoming_data.str();
-    for (size_t ii = 0, pos=0; ii < response.raw.size(); ii++)
+    response.status = 0;
+    for (size_t ii = 0, pos=0; ii + 1 < response.raw.size(); ii++)
     {
-        if (response.raw[ii] == '\r' && response.raw[ii + 1] == '\n' &&
-            response.raw[ii + 2] == '\r' && response.raw[ii + 3] == '\n')
-        {
-            response.body = response.raw.substr(ii + 4, response.raw.size() - (ii + 4));
-            break;
-        }
         if (response.raw[ii] == '\r' && response.raw[ii + 1] == '\n')
         {
             std::string header = response.raw.substr(pos, ii - pos);
-            std::cout << "HEADER: " << header << std::endl;
             response.headers.push_back(header);
             if (response.headers.size() == 1)
             {
@@ -417,25 +563,247 @@ int http_send(Request&request, Response &response, const std::map<std::string, s
                 response.content_type = lc_header.substr(start, end - start);
             }
             pos = ii + 2;
+            // the last header is kept before the blank line ends them
+            if (response.raw.compare(pos, 2, "\r\n") == 0)
+            {
+                response.body = response.raw.substr(pos + 2);
+                break;
+            }
         }
     }
 
     return 0;
 }
 
+WarmConnection::WarmConnection(Request const &request, std::chrono::seconds max_idle)
+    : uri_(request.uri), max_idle_(max_idle), stopping_(false)
+{
+    thread_ = std::thread([this] { run_(); });
+}
+
+WarmConnection::~WarmConnection()
+{
+    stop_();
+}
+
+std::unique_ptr<HttpConnection> WarmConnection::take()
+{
+    stop_();
+    std::unique_ptr<HttpConnection> connection = std::move(ready_);
+    if (!connection || !connection->is_alive() ||
+        std::chrono::steady_clock::now() - connection->opened_at() >= max_idle_)
+    {
+        connection = std::make_unique<HttpConnection>();
+    }
+    return connection;
+}
+
+void WarmConnection::run_()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_)
+    {
+        lock.unlock();
+        auto connection = std::make_unique<HttpConnection>();
+        ResponseError error;
+        const bool opened = connection->open(uri_, error) == 0;
+        lock.lock();
+        if (opened)
+        {
+            ready_ = std::move(connection);
+        }
+        // open it again before the server tires of it, or retry
+        const auto wait = opened ? max_idle_ : std::min(max_idle_, std::chrono::seconds(5));
+        wake_.wait_for(lock, wait, [this] { return stopping_; });
+    }
+}
+
+void WarmConnection::stop_()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+int http_send(Request &request, Response &response, const std::map<std::string, std::string> &post_fields)
+{
+    HttpConnection connection;
+    return http_send(request, response, connection, post_fields);
+}
+
+int http_send(Request &request, Response &response, HttpConnection &connection,
+              const std::map<std::string, std::string> &post_fields)
+{
+    std::string content;
+    if ( request.verb == "POST" ) {
+        if ( post_fields.empty() ) {
+            throw std::runtime_error("request was POST, but no post fields given to http_send");
+        }
+        for (auto const &[key, value] : post_fields) {
+            if ( !content.empty() ) {
+                content += '&';
+            }
+            percent_encode_append(content, key, PercentMode::FORM);
+            content += '=';
+            percent_encode_append(content, value, PercentMode::FORM);
+        }
+        request.headers.emplace_back("Content-Type: application/x-www-form-urlencoded");
+        request.headers.push_back(static_cast<const std::ostringstream&>(
+                std::ostringstream() << "Content-Length: " << content.size()).str());
+    }
+    std::string message = create_message(request);
+    if ( !content.empty() ) {
+        message += content + "\r\n";
+    }
+    // the host only: the form, the headers and the query can carry
+    // credentials (refresh_token, code_verifier, client_secret) and
+    // refreshes are sent from a background thread
+    std::cout << "Target: " << create_host(request) << '\n';
+
+    // a warmed connection skips straight to sending
+    if ( !connection.is_for(request.uri) || !connection.is_alive() ) {
+        const int code = connection.open(request.uri, response.error);
+        if ( code != 0 ) {
+            return code;
+        }
+    }
+    return connection.exchange(message, response);
+}
+
 #ifdef TEST_TINY_WEB_CLIENT
-int main()
+// A certificate for dns_name, signed by its own key, so nothing
+// trusts it unless told to.
+static X509 *test_make_certificate(EVP_PKEY *key, const char *dns_name)
+{
+    X509 *certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+    X509_set_pubkey(certificate, key);
+    X509_NAME *name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>(dns_name), -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, certificate, certificate, nullptr, nullptr, 0);
+    const std::string alt_name = std::string("DNS:") + dns_name;
+    X509_EXTENSION *extension = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name, alt_name.c_str());
+    X509_add_ext(certificate, extension, -1);
+    X509_EXTENSION_free(extension);
+    X509_sign(certificate, key, EVP_sha256());
+    return certificate;
+}
+
+// Opens a TLS connection to a server on the loopback interface
+// that presents certificate, returns what HttpConnection::open did.
+static int test_open(EVP_PKEY *key, X509 *certificate, std::string const &host)
+{
+    const int listener = (int)socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, 1) != 0 || getsockname(listener, (struct sockaddr *)&address, &length) != 0)
+    {
+        error("ERROR opening the test server");
+    }
+
+    std::thread server([&]
+    {
+        SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+        SSL_CTX_use_certificate(context, certificate);
+        SSL_CTX_use_PrivateKey(context, key);
+        const int client = (int)accept(listener, nullptr, nullptr);
+        SSL *session = SSL_new(context);
+        SSL_set_fd(session, client);
+        // fails when the client refuses us, either way we are done
+        if (SSL_accept(session) == 1)
+        {
+            SSL_shutdown(session);
+        }
+        SSL_free(session);
+        SSL_CTX_free(context);
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+        closesocket(client);
+#else
+        ::close(client);
+#endif
+    });
+
+    URI uri{};
+    uri.use_ssl = true;
+    uri.host = host;
+    uri.port = ntohs(address.sin_port);
+    HttpConnection connection;
+    ResponseError response_error;
+    const int code = connection.open(uri, response_error);
+    std::cout << host << ": " << code << " " << response_error.message << std::endl;
+    connection.close();
+    server.join();
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    closesocket(listener);
+#else
+    ::close(listener);
+#endif
+    return code;
+}
+
+// The handshake is refused unless the certificate is trusted and
+// names the host we asked for.
+static int test_tls_verification()
 {
-    Request req = Request{};
-    req.verb = "GET";
-    req.uri.use_ssl = true;
-    req.uri.protocol = "HTTP";
-    req.uri.protocol_version = "1.0";
-    // https://31f5ff35.eu-gb.apigw.appdomain.cloud/authtest/GetApplicationEndpoint
-    req.uri.host = STR(API_HOST);
-    req.uri.port = 443;
-    req.uri.path = STR(API_APPLICATION_ENDPOINT_PATH);
-    req.headers.push_back("HOST: " + STR(API_HOST));
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *key_context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY_keygen_init(key_context);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_context, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(key_context, &key);
+    EVP_PKEY_CTX_free(key_context);
+    X509 *certificate = test_make_certificate(key, "localhost");
+
+    int failures = 0;
+    // nobody vouches for it
+    failures += test_open(key, certificate, "localhost") != 1100;
+
+    // trusted, through the variable OpenSSL reads for its roots
+    const std::string trusted = "tiny_web_client_test.pem";
+    {
+        FILE *file = fopen(trusted.c_str(), "w");
+        PEM_write_X509(file, certificate);
+        fclose(file);
+    }
+    setenv("SSL_CERT_FILE", trusted.c_str(), 1);
+    failures += test_open(key, certificate, "localhost") != 0;
+    // trusted, but not for this address
+    failures += test_open(key, certificate, "127.0.0.1") != 1100;
+    unsetenv("SSL_CERT_FILE");
+    std::remove(trusted.c_str());
+
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return failures;
+}
+
+// With "live", also fetches the application endpoint, which needs
+// the network.
+int main(int argc, char **argv)
+{
+    const int failures = test_tls_verification();
+    std::cout << "failures: " << failures << std::endl;
+    if (argc < 2 || std::string(argv[1]) != "live")
+    {
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    constexpr UrlConstant endpoint = URL_CONSTANT("GET", API_HOST, API_APPLICATION_ENDPOINT_PATH);
+    Request req = make_request(endpoint);
     Response resp = Response{};
 
     if (http_send(req, resp))
@@ -448,6 +816,23 @@ int main()
                   << resp.content_type << "\n"
                   << resp.body << std::endl;
     }
+
+    // again, on a connection that was open before we asked
+    WarmConnection warm(req);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const std::unique_ptr<HttpConnection> connection = warm.take();
+    std::cout << "warm connection ready: " << connection->is_open() << std::endl;
+    Request warm_req = make_request(endpoint);
+    Response warm_resp = Response{};
+    if (http_send(warm_req, warm_resp, *connection))
+    {
+        std::cout << warm_resp.error.message << std::endl;
+    }
+    else
+    {
+        std::cout << warm_resp.status << std::endl;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 #endif
 
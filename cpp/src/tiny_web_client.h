@@ -1,11 +1,18 @@
 #ifndef OAUTH2_TINY_WEB_CLIENT_H
 #define OAUTH2_TINY_WEB_CLIENT_H
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <map>
+#include <thread>
 #include <vector>
 #include "url.h"
+#include "url_cache.h"
 #include "config.h"
 #ifdef USE_OPENSSL
 #include <openssl/ssl.h>
@@ -31,6 +38,11 @@ struct Request
 {
     std::string verb;
     URI uri;
+    // preformatted "VERB target HTTP/1.0\r\n" from a UrlConstant,
+    // create_message builds one from uri when this is empty
+    std::string_view request_line;
+    // holds request_line when it comes from an EndpointCache
+    EndpointHandle endpoint;
     std::vector<std::string> headers;
     std::map<std::string, std::string> fields;
 };
@@ -59,17 +71,29 @@ std::string create_message(Request const &);
 
 Request make_request(const URL &, const std::string &verb="GET");
 
+Request make_request(const UrlConstant &);
+
+Request make_request(EndpointHandle);
+
 // Using the RAII idiom to ensure our SSL resource is cleaned up
 class SSLClient
 {
 public:
-    SSLClient() : context_(nullptr), session_(nullptr),  valid_(false), ssl_socket_file_descriptor_(0)
+    SSLClient() : context_(nullptr), session_(nullptr),  valid_(false), ssl_socket_file_descriptor_(0),
+                  verify_result_(X509_V_OK)
     {
     }
 
     [[nodiscard]] bool is_valid() const;
 
-    bool connect_to_socket(int);
+    // The handshake fails unless the server's chain leads to one
+    // of the system's trusted roots (SSL_CERT_FILE and SSL_CERT_DIR
+    // can point elsewhere) and the certificate is for host, a name
+    // or an IP address.  The name also goes out as SNI.
+    bool connect_to_socket(int, std::string const &host);
+
+    // why the server's certificate was refused, X509_V_OK if it was not
+    [[nodiscard]] long verify_result() const;
 
     static void display_errors() {
         for (auto err = ERR_get_error(); err; err = ERR_get_error()) {
@@ -97,18 +121,18 @@ private:
     SSL *session_;
     bool valid_;
     int ssl_socket_file_descriptor_;
+    long verify_result_;
 
     static void ssl_library_init()
     {
-        static bool already_done_this = false;
-        if (already_done_this)
+        // handshakes run on several threads at once
+        static std::once_flag already_done_this;
+        std::call_once(already_done_this, []
         {
-            return;
-        }
-        SSL_library_init();
-        SSLeay_add_ssl_algorithms();
-        SSL_load_error_strings();
-        already_done_this = true;
+            SSL_library_init();
+            SSLeay_add_ssl_algorithms();
+            SSL_load_error_strings();
+        });
     }
 
     // private methods only for our use
@@ -122,6 +146,13 @@ private:
             shutdown();
             return false;
         }
+        // no trusted roots means nothing verifies, so fail early
+        if (SSL_CTX_set_default_verify_paths(context_) != 1)
+        {
+            shutdown();
+            return false;
+        }
+        SSL_CTX_set_verify(context_, SSL_VERIFY_PEER, nullptr);
         session_ = SSL_new(context_);
         valid_ = true;
         if (!session_)
@@ -148,6 +179,96 @@ private:
     }
 };
 
+// One connection to a server.  Opening it is the DNS lookup and
+// the TCP and TLS handshakes, so it can be done before the
+// request is ready.  Our requests are HTTP/1.0, so it carries one
+// request and is closed once the response has been read.
+class HttpConnection
+{
+public:
+    HttpConnection() : socket_file_descriptor_(-1), port_(0), use_ssl_(false)
+    {
+    }
+
+    ~HttpConnection();
+
+    // make this unable to be copied
+    HttpConnection(HttpConnection const &) = delete;
+    HttpConnection &operator=(HttpConnection const &) = delete;
+
+    // 0 or the error code http_send would return, with error filled
+    int open(URI const &uri, ResponseError &error);
+
+    [[nodiscard]] bool is_open() const;
+
+    // open to the same host, port and scheme as uri
+    [[nodiscard]] bool is_for(URI const &uri) const;
+
+    // false once the server has closed it while it sat unused
+    bool is_alive();
+
+    [[nodiscard]] std::chrono::steady_clock::time_point opened_at() const;
+
+    // sends message, reads the whole response, then closes
+    int exchange(std::string const &message, Response &response);
+
+    void close();
+
+private:
+    int socket_file_descriptor_;
+    std::unique_ptr<SSLClient> ssl_client_;
+    std::string host_;
+    int port_;
+    bool use_ssl_;
+    std::chrono::steady_clock::time_point opened_at_;
+#if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+    bool winsock_started_ = false;
+#endif
+};
+
+// Keeps a connection to one server open in the background, so
+// the request that needs it later only has to send.  Servers drop
+// connections that sit idle without a request, so it is opened
+// again every max_idle.
+class WarmConnection
+{
+public:
+    explicit WarmConnection(Request const &request, std::chrono::seconds max_idle = std::chrono::seconds(20));
+
+    ~WarmConnection();
+
+    // make this unable to be copied
+    WarmConnection(WarmConnection const &) = delete;
+    WarmConnection &operator=(WarmConnection const &) = delete;
+
+    // Stops warming and hands over the connection, waiting for a
+    // handshake that is under way.  Not open when there is none
+    // that is still good, http_send then connects as usual.
+    std::unique_ptr<HttpConnection> take();
+
+private:
+    const URI uri_;
+    const std::chrono::seconds max_idle_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::unique_ptr<HttpConnection> ready_;
+    bool stopping_;
+    std::thread thread_;
+
+    void run_();
+
+    void stop_();
+};
+
+// value of the first header called name, any case, empty if none
+std::string_view response_header(Response const &, std::string_view name);
+
 int http_send(Request &, Response &,  const std::map<std::string, std::string> &post_fields = {});
 
+// as above over connection, which is opened first unless it is
+// already open to the right server
+int http_send(Request &, Response &, HttpConnection &connection,
+              const std::map<std::string, std::string> &post_fields = {});
+
 #endif /* OAUTH2_TINY_WEB_CLIENT_H */
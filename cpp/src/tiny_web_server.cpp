@@ -1,6 +1,7 @@
 // Reference: https://rosettacode.org/wiki/Hello_world/Web_server#C
 #include <map>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <sstream>
 #include <cstdio>
@@ -27,29 +28,29 @@ void err(int code, const char *message) {
 #endif
 
 #include "macros.h"
+#include "percent_encoding.h"
 
+// Keys and values are form decoded, so "4%2F0A+b" is "4/0A b".
 std::map<std::string, std::string> 
 split_querystring(std::string const & querystring ) 
 {
     std::map<std::string, std::string> result;
-    size_t lastpos = 0;
-    std::string key;
-    std::string value;
-    for(size_t ii=0; ii < querystring.size(); ii++ ) {
-        if ( querystring[ii] == '=' ) {
-            key = querystring.substr(lastpos, ii-lastpos);
-            lastpos = ii+1;
-        } else if ( querystring[ii] == '&' ) {
-            value = querystring.substr(lastpos, ii-lastpos);
-            result.insert(std::make_pair(key,value));
-            lastpos = ii+1;
-            key.clear();
-            value.clear();
+    std::string_view rest = querystring;
+    while ( !rest.empty() ) {
+        const size_t end = rest.find('&');
+        const std::string_view pair = rest.substr(0, end);
+        const size_t equals = pair.find('=');
+        if ( equals != std::string_view::npos && equals != 0 ) {
+            std::string key;
+            std::string value;
+            percent_decode_append(key, pair.substr(0, equals), PercentMode::FORM);
+            percent_decode_append(value, pair.substr(equals + 1), PercentMode::FORM);
+            result.insert(std::make_pair(std::move(key), std::move(value)));
         }
-    }
-    if ( !key.empty() ) {
-        value = querystring.substr(lastpos);
-        result.insert(std::make_pair(key,value));
+        if ( end == std::string_view::npos ) {
+            break;
+        }
+        rest.remove_prefix(end + 1);
     }
     return result;
 }
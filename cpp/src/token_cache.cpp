@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <stdexcept>
+#include "token_cache.h"
+
+// a failed refresh is tried again after this, or at expiry if sooner
+static constexpr std::chrono::seconds REFRESH_RETRY(5);
+
+// Longer lifetimes are cut to this.  expires_in can be any 64 bit
+// value, and far beyond it now + lifetime overflows the clock's
+// nanoseconds and lands in the past, so the token would be
+// refreshed again as soon as it arrived.
+static constexpr std::chrono::seconds MAX_LIFETIME(std::chrono::hours(24 * 365));
+
+TokenCache::TokenCache(TokenRefresher refresher, double refresh_fraction)
+        : refresher_(std::move(refresher)), refresh_fraction_(std::clamp(refresh_fraction, 0.0, 1.0)),
+          stopping_(false) {
+    refresh_ = std::thread([this] { run_(); });
+}
+
+TokenCache::~TokenCache() {
+    {
+        std::lock_guard<std::mutex> lock(due_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    refresh_.join();
+}
+
+TokenHandle TokenCache::make_token_(TokenResponse const &response, Clock::time_point now) const {
+    auto token = std::make_shared<CachedToken>();
+    token->response = response;
+    token->obtained = now;
+    token->expires = Clock::time_point::max();
+    token->refresh_at = Clock::time_point::max();
+    if (response.expires_in > 0) {
+        const std::chrono::seconds lifetime(std::min<std::int64_t>(response.expires_in, MAX_LIFETIME.count()));
+        token->expires = now + lifetime;
+        token->refresh_at = now + std::chrono::duration_cast<Clock::duration>(lifetime * refresh_fraction_);
+    }
+    return token;
+}
+
+TokenHandle TokenCache::store(TokenKey const &key, TokenResponse const &response) {
+    TokenHandle token = make_token_(response, Clock::now());
+    {
+        std::unique_lock<std::shared_mutex> lock(tokens_mutex_);
+        tokens_[key] = token;
+    }
+    if (!response.refresh_token.empty() && token->refresh_at != Clock::time_point::max()) {
+        schedule_(key, token, token->refresh_at);
+    }
+    return token;
+}
+
+TokenHandle TokenCache::get(TokenKey const &key) const {
+    std::shared_lock<std::shared_mutex> lock(tokens_mutex_);
+    const auto found = tokens_.find(key);
+    if (found == tokens_.end() || found->second->expired()) {
+        return nullptr;
+    }
+    return found->second;
+}
+
+TokenHandle TokenCache::acquire(TokenKey const &key, TokenFetcher const &fetch, std::chrono::milliseconds max_wait) {
+    TokenHandle token = get(key);
+    if (token) {
+        return token;
+    }
+    return flights_.run(key, [this, &key, &fetch] {
+        // stored by a flight that finished while we were looking
+        TokenHandle stored = get(key);
+        if (stored) {
+            return stored;
+        }
+        TokenResponse response = TokenResponse{};
+        if (!fetch(key, response)) {
+            throw std::runtime_error("token request failed");
+        }
+        return store(key, response);
+    }, max_wait);
+}
+
+void TokenCache::erase(TokenKey const &key) {
+    // a refresh still scheduled for it finds it gone and is dropped
+    std::unique_lock<std::shared_mutex> lock(tokens_mutex_);
+    tokens_.erase(key);
+}
+
+size_t TokenCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(tokens_mutex_);
+    return tokens_.size();
+}
+
+void TokenCache::schedule_(TokenKey const &key, TokenHandle const &token, Clock::time_point when) {
+    bool earliest = false;
+    {
+        std::lock_guard<std::mutex> lock(due_mutex_);
+        earliest = due_.empty() || when < due_.top().when;
+        due_.push(Due{when, key, token});
+    }
+    if (earliest) {
+        wake_.notify_one();
+    }
+}
+
+void TokenCache::refresh_one_(Due const &due) {
+    {
+        std::shared_lock<std::shared_mutex> lock(tokens_mutex_);
+        const auto found = tokens_.find(due.key);
+        if (found == tokens_.end() || found->second != due.token) {
+            return; // replaced or erased since
+        }
+    }
+    try {
+        // an acquire() for the same key waits for this one
+        flights_.run(due.key, [this, &due] {
+            TokenResponse response = TokenResponse{};
+            if (!refresher_(due.key, due.token->response.refresh_token, response)) {
+                throw std::runtime_error("refreshing the access token failed");
+            }
+            // the server may keep the refresh token, RFC 6749 section 6
+            if (response.refresh_token.empty()) {
+                response.refresh_token = due.token->response.refresh_token;
+            }
+            TokenHandle token = make_token_(response, Clock::now());
+            {
+                std::unique_lock<std::shared_mutex> lock(tokens_mutex_);
+                const auto found = tokens_.find(due.key);
+                if (found == tokens_.end()) {
+                    return token;
+                }
+                if (found->second != due.token) {
+                    return found->second;
+                }
+                found->second = token;
+            }
+            if (token->refresh_at != Clock::time_point::max()) {
+                schedule_(due.key, token, token->refresh_at);
+            }
+            return token;
+        });
+    } catch (std::exception const &) {
+        // keep serving the old token while it lasts
+        const Clock::time_point now = Clock::now();
+        if (!due.token->expired(now)) {
+            schedule_(due.key, due.token, std::min(now + REFRESH_RETRY, due.token->expires));
+        }
+    }
+}
+
+void TokenCache::run_() {
+    std::unique_lock<std::mutex> lock(due_mutex_);
+    while (!stopping_) {
+        if (due_.empty()) {
+            wake_.wait(lock);
+            continue;
+        }
+        const Clock::time_point when = due_.top().when;
+        if (Clock::now() < when) {
+            wake_.wait_until(lock, when);
+            continue;
+        }
+        Due due = due_.top();
+        due_.pop();
+        // the refresh goes over the network, readers and store()
+        // must not wait for it
+        lock.unlock();
+        refresh_one_(due);
+        lock.lock();
+    }
+}
+
+#ifdef TEST_TOKEN_CACHE
+#include <atomic>
+#include <iostream>
+
+int main() {
+    std::atomic<int> refreshes(0);
+    std::atomic<int> failures(0);
+    TokenCache cache([&refreshes](TokenKey const &, std::string const &refresh_token, TokenResponse &response) {
+        const int count = ++refreshes;
+        if (count == 2) {
+            return false; // the retry gets it
+        }
+        response.access_token = "access-" + std::to_string(count);
+        response.token_type = "Bearer";
+        response.expires_in = 1;
+        response.refresh_token = count == 1 ? "" : refresh_token;
+        return true;
+    }, 0.5);
+
+    const TokenKey key{"client", "openid", "user"};
+    TokenResponse first = TokenResponse{};
+    first.access_token = "access-0";
+    first.token_type = "Bearer";
+    first.expires_in = 1;
+    first.refresh_token = "refresh";
+    cache.store(key, first);
+
+    TokenResponse forever = TokenResponse{};
+    forever.access_token = "forever";
+    cache.store(TokenKey{"client", "openid", ""}, forever);
+
+    failures += cache.get(key)->response.access_token != "access-0";
+    failures += cache.get(TokenKey{"client", "email", "user"}) != nullptr;
+    std::this_thread::sleep_for(std::chrono::milliseconds(700));
+    const TokenHandle renewed = cache.get(key);
+    std::cout << renewed->response.access_token << ' ' << renewed->response.refresh_token << '\n';
+    failures += renewed->response.access_token != "access-1" || renewed->response.refresh_token != "refresh";
+
+    // a lifetime too long for the clock is cut short, not wrapped
+    // into the past where it would be refreshed straight away
+    TokenResponse huge = TokenResponse{};
+    huge.access_token = "huge";
+    huge.expires_in = 1000000000000;
+    huge.refresh_token = "refresh";
+    const TokenHandle stored = cache.store(TokenKey{"huge", "", ""}, huge);
+    const int refreshes_before = refreshes;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    failures += stored->refresh_at < stored->obtained + std::chrono::hours(24 * 30) || stored->expires < stored->refresh_at;
+    failures += refreshes != refreshes_before || cache.get(TokenKey{"huge", "", ""})->response.access_token != "huge";
+    cache.erase(TokenKey{"huge", "", ""});
+
+    // concurrent callers without a token share one fetch
+    std::atomic<int> fetches(0);
+    const TokenFetcher fetch = [&fetches](TokenKey const &, TokenResponse &response) {
+        fetches++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        response.access_token = "fetched";
+        response.expires_in = 60;
+        return true;
+    };
+    std::vector<std::thread> threads;
+    for (int ii = 0; ii < 4; ii++) {
+        threads.emplace_back([&] { failures += cache.acquire(TokenKey{"other", "", ""}, fetch)->response.access_token != "fetched"; });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    failures += fetches != 1 || cache.acquire(TokenKey{"other", "", ""}, fetch) == nullptr || fetches != 1;
+    try {
+        cache.acquire(TokenKey{"failing", "", ""}, [](TokenKey const &, TokenResponse &) { return false; });
+        failures++;
+    } catch (std::runtime_error const &) {
+    }
+    cache.erase(TokenKey{"other", "", ""});
+
+    // no expires_in, it never expires and is never refreshed
+    failures += cache.get(TokenKey{"client", "openid", ""}) == nullptr;
+    cache.erase(TokenKey{"client", "openid", ""});
+    std::cout << "refreshes: " << refreshes << ", tokens: " << cache.size() << ", failures: " << failures << '\n';
+    return failures == 0 && cache.size() == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
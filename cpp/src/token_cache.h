@@ -0,0 +1,148 @@
+#ifndef OAUTH2_TOKEN_CACHE_H
+#define OAUTH2_TOKEN_CACHE_H
+
+// Tokens we already have, per client, scopes and subject, so a
+// caller only logs in when there is nothing usable.  Expiry is
+// kept on the monotonic clock: changing the wall clock does not
+// expire or revive a token.  A background thread renews tokens
+// that have a refresh_token once refresh_fraction of their
+// lifetime has passed, so get() only ever reads the cache.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "oauth2_types.h"
+#include "single_flight.h"
+
+struct TokenKey
+{
+    std::string client_id;
+    // space separated, as sent in the scope parameter
+    std::string scopes;
+    // the user, empty for client credentials
+    std::string subject;
+
+    bool operator==(TokenKey const &other) const
+    {
+        return client_id == other.client_id && scopes == other.scopes && subject == other.subject;
+    }
+};
+
+struct TokenKeyHash
+{
+    size_t operator()(TokenKey const &key) const
+    {
+        const std::hash<std::string> hash;
+        size_t seed = hash(key.client_id);
+        seed ^= hash(key.scopes) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= hash(key.subject) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+};
+
+struct CachedToken
+{
+    using Clock = std::chrono::steady_clock;
+
+    TokenResponse response;
+    Clock::time_point obtained;
+    // Clock::time_point::max() when the server gave no expires_in
+    Clock::time_point expires;
+    Clock::time_point refresh_at;
+
+    [[nodiscard]] bool expired(Clock::time_point now = Clock::now()) const
+    {
+        return now >= expires;
+    }
+};
+
+using TokenHandle = std::shared_ptr<const CachedToken>;
+
+// Runs the refresh_token grant for key, fills response and returns
+// true on success.  Called from the cache's own thread.
+using TokenRefresher =
+        std::function<bool(TokenKey const &key, std::string const &refresh_token, TokenResponse &response)>;
+
+// Gets a new token for key (client_credentials, an authorization
+// code exchange, ...), fills response and returns true on success.
+using TokenFetcher = std::function<bool(TokenKey const &key, TokenResponse &response)>;
+
+class TokenCache
+{
+public:
+    using Clock = CachedToken::Clock;
+
+    explicit TokenCache(TokenRefresher refresher, double refresh_fraction = 0.75);
+
+    // stops the refresh thread, a refresh in progress is finished
+    ~TokenCache();
+
+    // make this unable to be copied
+    TokenCache(TokenCache const &) = delete;
+    TokenCache &operator=(TokenCache const &) = delete;
+
+    // Keeps a token that was just issued for key.
+    TokenHandle store(TokenKey const &key, TokenResponse const &response);
+
+    // The token for key, or nullptr when there is none or it has
+    // expired.  Never waits for the network.
+    [[nodiscard]] TokenHandle get(TokenKey const &key) const;
+
+    // The token for key, fetching one when there is none.  Callers
+    // asking for the same key at the same time share one fetch,
+    // and its exception when it fails; a caller that waits longer
+    // than max_wait gets SingleFlightTimeout.
+    TokenHandle acquire(TokenKey const &key, TokenFetcher const &fetch,
+                        std::chrono::milliseconds max_wait = std::chrono::seconds(30));
+
+    void erase(TokenKey const &key);
+
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Due
+    {
+        Clock::time_point when;
+        TokenKey key;
+        // the token this refresh is for, skipped if it was replaced
+        TokenHandle token;
+
+        bool operator>(Due const &other) const
+        {
+            return when > other.when;
+        }
+    };
+
+    TokenRefresher refresher_;
+    const double refresh_fraction_;
+    std::unordered_map<TokenKey, TokenHandle, TokenKeyHash> tokens_;
+    // token requests in progress, fetches and refreshes alike
+    SingleFlight<TokenKey, TokenHandle, TokenKeyHash> flights_;
+    mutable std::shared_mutex tokens_mutex_;
+    // refreshes in the order they are due, guarded by due_mutex_
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due_;
+    std::mutex due_mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+    std::thread refresh_;
+
+    TokenHandle make_token_(TokenResponse const &response, Clock::time_point now) const;
+
+    void schedule_(TokenKey const &key, TokenHandle const &token, Clock::time_point when);
+
+    void refresh_one_(Due const &due);
+
+    void run_();
+};
+
+#endif /* OAUTH2_TOKEN_CACHE_H */
@@ -1,497 +1,519 @@
 #ifndef OAUTH2_CPP_URL_H
 #define OAUTH2_CPP_URL_H
 
-#include <cstdlib>
-#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
 #include <iostream>
+#include <stdexcept>
 #include <string>
-#include <map>
+#include <string_view>
+#include <type_traits>
 
 #include "char_utils.h"
 #include "macros.h"
+#include "percent_encoding.h"
+
+// Where each part of a URL ends, or why the text is not a URL.
+// url_parse only reads the text, so it also runs at compile time
+// on constant URLs, see URL_CONSTANT.
+struct UrlParts
+{
+    // protocol "://" domain path ['?' querystring] ['#' fragment]
+    std::uint32_t protocol_end;
+    std::uint32_t domain_end;
+    std::uint32_t path_end;
+    std::uint32_t querystring_end;
+    // characters in the querystring that URL percent-encodes
+    std::uint32_t escapes;
+    // nullptr when the URL is valid
+    const char *error;
+    // the offending character for "invalid character" errors
+    size_t error_pos;
+};
+
+constexpr size_t URL_NO_POSITION = static_cast<size_t>(-1);
+
+constexpr UrlParts url_error(const char *error, size_t pos = URL_NO_POSITION)
+{
+    UrlParts parts = UrlParts{};
+    parts.error = error;
+    parts.error_pos = pos;
+    return parts;
+}
+
+constexpr UrlParts url_parse(std::string_view url)
+{
+    if (url.empty())
+    {
+        return url_error("empty string is not a valid url");
+    }
+    if (url.size() < 5)
+    {
+        return url_error("invalid url found, string is too short");
+    }
+    if (url.size() > UINT32_MAX)
+    {
+        return url_error("url is too long");
+    }
+    size_t protocol_end = 0;
+    if (url.substr(0, 6) == "https:")
+    {
+        protocol_end = 5;
+    }
+    else if (url.substr(0, 5) == "http:")
+    {
+        protocol_end = 4;
+    }
+    else
+    {
+        return url_error("no protocol given, http(s) expected at start of url");
+    }
+    if (url.substr(protocol_end + 1, 2) != "//")
+    {
+        return url_error("invalid url, // after protocol not found");
+    }
+
+    const size_t domain_begin = protocol_end + 3;
+    const size_t domain_end = MIN(url.find_first_of("/?#", domain_begin), url.size());
+    const std::string_view domain = url.substr(domain_begin, domain_end - domain_begin);
+    if (domain.empty())
+    {
+        return url_error("no domain found");
+    }
+    if (domain.front() == '-')
+    {
+        return url_error("invalid domain, cannot start with a hyphen");
+    }
+    if (domain.back() == '-')
+    {
+        return url_error("invalid domain, cannot end with a hyphen");
+    }
+    if (domain.front() == '.' || domain.back() == '.')
+    {
+        return url_error("'.' cannot appear at start or end of domain");
+    }
+    const size_t invalid_domain = char_find_invalid_domain(domain);
+    if (invalid_domain != std::string_view::npos)
+    {
+        return url_error("invalid character found in domain", domain_begin + invalid_domain);
+    }
+    const size_t dots = domain.find("..");
+    if (dots != std::string_view::npos)
+    {
+        return url_error("invalid character found in domain", domain_begin + dots + 1);
+    }
+
+    const size_t path_end = MIN(url.find_first_of("?#", domain_end), url.size());
+    const size_t invalid_path = char_find_invalid_path(url.substr(domain_end, path_end - domain_end));
+    if (invalid_path != std::string_view::npos)
+    {
+        return url_error("invalid character found in path", domain_end + invalid_path);
+    }
+
+    const size_t querystring_end = MIN(url.find('#', path_end), url.size());
+    size_t escapes = 0;
+    for (size_t ii = path_end; ii < querystring_end; ii++)
+    {
+        escapes += is_fragment(url[ii]) ? 0 : 1;
+    }
+    if (querystring_end < url.size())
+    {
+        const size_t invalid_fragment = char_find_invalid_fragment(url.substr(querystring_end + 1));
+        if (invalid_fragment != std::string_view::npos)
+        {
+            return url_error("invalid character found in fragment", querystring_end + 1 + invalid_fragment);
+        }
+    }
+
+    UrlParts parts = UrlParts{};
+    parts.protocol_end = static_cast<std::uint32_t>(protocol_end);
+    parts.domain_end = static_cast<std::uint32_t>(domain_end);
+    parts.path_end = static_cast<std::uint32_t>(path_end);
+    parts.querystring_end = static_cast<std::uint32_t>(querystring_end);
+    parts.escapes = static_cast<std::uint32_t>(escapes);
+    parts.error = nullptr;
+    parts.error_pos = URL_NO_POSITION;
+    return parts;
+}
+
+// A URL known when the program is built, with the request line
+// and Host header for it already formatted.  Make them with
+// URL_CONSTANT so they are checked by the compiler.
+struct UrlConstant
+{
+    std::string_view url;
+    std::string_view verb;
+    std::string_view request_line;
+    std::string_view host_header;
+    UrlParts parts;
+};
+
+// Deliberately not constexpr: reaching it while the compiler
+// evaluates a URL_CONSTANT stops the build and the diagnostic
+// shows the message.
+inline void url_constant_is_invalid(const char *error)
+{
+    throw std::runtime_error(error);
+}
+
+constexpr UrlConstant url_constant(std::string_view url, std::string_view verb, std::string_view request_line,
+                                   std::string_view host_header)
+{
+    const UrlParts parts = url_parse(url);
+    if (parts.error != nullptr)
+    {
+        url_constant_is_invalid(parts.error);
+    }
+    if (parts.escapes != 0)
+    {
+        url_constant_is_invalid("constant url must already be encoded");
+    }
+    return UrlConstant{url, verb, request_line, host_header, parts};
+}
+
+// An https endpoint from string literals, such as the macros in
+// config.h.  Assign it to a constexpr variable, an invalid host
+// or path is then a compile error rather than an exception.
+#define URL_CONSTANT(verb, host, path) \
+    url_constant("https://" host path, verb, verb " " path " HTTP/1.0\r\n", "HOST: " host)
 
 // In this case we are going to define a type URL that
 // will check that the use has something of the right
 // type.  We could just pass a string but this is a useful
 // diversion.
+//
+// The URL is kept as one string, already encoded, and the
+// components are offsets into it handed out as string_views.
+// Copying a URL is a single allocation and moving one never
+// throws.  The views are valid while the URL is alive and not
+// modified by add_param.
 class URL
 {
 public:
     URL() = default;
 
-    explicit URL(const std::string &url)
+    explicit URL(std::string_view url)
     {
         validate_(url);
     }
 
+    // already checked by the compiler
+    explicit URL(UrlConstant const &constant) : data_(constant.url)
+    {
+        set_parts_(constant.parts);
+    }
+
     URL(URL const &) = default;
-    URL(URL &&) = default;
+    URL(URL &&) noexcept = default;
+    URL &operator=(URL const &) = default;
+    URL &operator=(URL &&) noexcept = default;
 
-    std::string protocol;
-    std::string domain;
-    std::string path;
-    std::string querystring;
-    std::string fragment;
+    [[nodiscard]] std::string_view protocol() const
+    {
+        return std::string_view(data_).substr(0, protocol_end_);
+    }
 
-    std::ostream &print(std::ostream &out) const
+    [[nodiscard]] std::string_view domain() const
     {
-        out << "URL          : " << data_ << '\n'
-            << "Encoded      : " << encoded_data_ << '\n'
-            << "  Protocol   : " << protocol << '\n'
-            << "  Domain     : " << domain << '\n'
-            << "  Path       : " << path << '\n'
-            << "  Querystring: " << querystring << '\n'
-            << "  Fragment   : " << fragment << '\n';
-        return out;
+        const size_t begin = protocol_end_ + 3;
+        return std::string_view(data_).substr(begin, domain_end_ - begin);
     }
 
-    [[nodiscard]] std::string encoded_querystring() const
+    [[nodiscard]] std::string_view path() const
     {
-        if (params_.empty())
-        {
-            return querystring;
-        }
-        else
+        return std::string_view(data_).substr(domain_end_, path_end_ - domain_end_);
+    }
+
+    // without the leading '?'
+    [[nodiscard]] std::string_view querystring() const
+    {
+        if (!has_querystring_())
         {
-            std::string qs;
-            size_t counter = 0;
-            for (auto const &[key, value] : params_)
-            {
-                qs += key + "=" + encode_(value);
-                if (counter < params_.size() - 1)
-                {
-                    qs += "&";
-                }
-                counter++;
-            }
-            return qs;
+            return {};
         }
+        return std::string_view(data_).substr(path_end_ + 1, querystring_end_ - path_end_ - 1);
     }
 
-    [[nodiscard]] std::string encoded() const
+    // without the leading '#'
+    [[nodiscard]] std::string_view fragment() const
     {
-        std::cout << params_.size() << std::endl;
-        if (params_.empty())
+        if (querystring_end_ >= data_.size())
         {
-            return encoded_data_;
+            return {};
         }
-        else
+        return std::string_view(data_).substr(querystring_end_ + 1);
+    }
+
+    std::ostream &print(std::ostream &out) const
+    {
+        out << "URL          : " << data_ << '\n'
+            << "  Protocol   : " << protocol() << '\n'
+            << "  Domain     : " << domain() << '\n'
+            << "  Path       : " << path() << '\n'
+            << "  Querystring: " << querystring() << '\n'
+            << "  Fragment   : " << fragment() << '\n';
+        return out;
+    }
+
+    [[nodiscard]] std::string_view encoded_querystring() const
+    {
+        return querystring();
+    }
+
+    [[nodiscard]] std::string const &encoded() const
+    {
+        return data_;
+    }
+
+    // Parameters go on the end of the querystring in the order
+    // they are added.  A key that is already present is left as
+    // it is, OAuth2 does not allow a parameter to repeat.
+    void add_param(std::string_view key, std::string_view value)
+    {
+        const std::string encoded_key = percent_encode(key);
+        if (has_param_(encoded_key))
         {
-            std::string qs;
-            size_t counter = 0;
-            for (auto const &[key, value] : params_)
-            {
-                qs += key + "=" + encode_(value);
-                if (counter < params_.size() - 1)
-                {
-                    qs += "&";
-                }
-                counter++;
-            }
-            std::string url = protocol + "://" + domain + path;
-            if (!qs.empty())
-            {
-                url += "?" + qs;
-            }
-            if (!fragment.empty())
-            {
-                url += "#" + fragment;
-            }
-            return url;
+            return;
         }
+        // encode straight into the gap made for the parameter
+        const char *separator = !has_querystring_() ? "?" : querystring().empty() ? "" : "&";
+        const size_t size = std::strlen(separator) + encoded_key.size() + 1 +
+                            percent_encoded_size(value, PercentMode::COMPONENT);
+        data_.insert(querystring_end_, size, '=');
+        char *out = &data_[querystring_end_];
+        out = std::copy(separator, separator + std::strlen(separator), out);
+        out = std::copy(encoded_key.begin(), encoded_key.end(), out);
+        percent_encode_to(out + 1, value, PercentMode::COMPONENT);
+        querystring_end_ += static_cast<std::uint32_t>(size);
     }
 
-    void add_param(const std::string& key, const std::string& value)
+    bool operator==(URL const &other) const
     {
-        params_.insert(std::make_pair(key, value));
+        return data_ == other.data_;
+    }
+
+    bool operator!=(URL const &other) const
+    {
+        return data_ != other.data_;
     }
 
 private:
+    friend class UrlBuilder;
+
     std::string data_;
-    std::string encoded_data_;
-    std::map<std::string, std::string> params_;
+    // data_ is protocol "://" domain path ['?' querystring] ['#' fragment],
+    // each offset is where that part ends
+    std::uint32_t protocol_end_ = 0;
+    std::uint32_t domain_end_ = 0;
+    std::uint32_t path_end_ = 0;
+    std::uint32_t querystring_end_ = 0;
 
-    size_t set_protocol_(std::string const &url)
+    // data is already encoded and parts describe it
+    URL(std::string data, UrlParts const &parts) : data_(std::move(data))
     {
-        if (url.substr(0, 5) != "http:")
-        {
-            protocol = "http";
-        }
-        if (url.substr(0, 5) != "https:")
-        {
-            protocol = "https";
-        }
-        if (protocol.empty())
-        {
-            throw std::runtime_error("no protocol given, http(s) expected at start of url");
-        }
-        return protocol.size();
+        set_parts_(parts);
     }
 
-    [[nodiscard]] size_t check_protocol_domain_separator_(std::string const &url) const
+    [[nodiscard]] bool has_querystring_() const
     {
-        size_t p = url.find_first_of('/');
-        if (p == std::string::npos)
-        {
-            throw std::runtime_error("invalid url, no // found after protocol");
-        }
-        else if (url[p] == '/' && url.size() < p + 1)
-        {
-            throw std::runtime_error("invalid url, only a single / found and string is too short");
-        }
-        else if (url[p + 1] != '/')
-        {
-            throw std::runtime_error("invalid url, // after protocol not found");
-        }
-        return protocol.size() + 2;
+        return path_end_ < data_.size() && data_[path_end_] == '?';
     }
 
-    size_t set_domain_(std::string const &url, size_t pos)
+    [[nodiscard]] bool has_param_(std::string_view key) const
     {
-        if (pos >= url.size())
-        {
-            return pos;
-        }
-        pos++;
-        size_t end_of_domain = url.find_first_of('/', pos),
-                querystring_pos = url.find_first_of('?', pos),
-                fragment_pos = url.find_first_of('#', pos);
-        end_of_domain = MIN(end_of_domain, fragment_pos);
-        end_of_domain = MIN(end_of_domain, querystring_pos);
-        std::string this_domain = url.substr(pos, end_of_domain - pos);
-        if (this_domain.empty())
+        std::string_view qs = querystring();
+        while (!qs.empty())
         {
-            throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                             std::ostringstream() << "no domain found in '" << url << "'").str());
-        }
-        else
-        {
-            if (this_domain[0] == '-')
-            {
-                throw std::runtime_error("invalid domain, cannot start with a hyphen");
-            }
-            if (this_domain[this_domain.size() - 1] == '-')
+            const size_t end = qs.find('&');
+            const std::string_view param = qs.substr(0, end);
+            if (param.size() > key.size() && param.substr(0, key.size()) == key && param[key.size()] == '=')
             {
-                throw std::runtime_error("invalid domain, cannot end with a hyphen");
+                return true;
             }
-            for (size_t ii = 0; ii < this_domain.size(); ii++)
+            if (end == std::string_view::npos)
             {
-                if (this_domain[ii] == '#' || this_domain[ii] == '?')
-                {
-                    break;
-                }
-                if (ii < this_domain.size() - 2)
-                {
-                    if (this_domain[ii] == '.' && this_domain[ii + 1] == '.')
-                    {
-                        throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                                         std::ostringstream() <<"invalid character '"
-                                                                              << this_domain[ii + 1]
-                                                                              << "' found next to '.' in domain of '"
-                                                                              << url << "'").str());
-                    }
-                }
-                if (this_domain[ii] == '.' && (this_domain[ii] == 0 || ii == this_domain.size() - 1))
-                {
-                    throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                                     std::ostringstream()
-                                                             << "'.'' cannot appear at start or end of domain in url '"
-                                                             << url << "'").str());
-                }
-                if (!is_domain_character(this_domain[ii]))
-                {
-                    throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                                     std::ostringstream()
-                                                             << "invalid character '" << this_domain[ii]
-                                                             << "' found in domain of '" << url << "'").str());
-                }
+                break;
             }
+            qs.remove_prefix(end + 1);
         }
-        domain = this_domain;
-        return pos + domain.size();
+        return false;
     }
 
-    size_t set_path_(std::string const &url, const size_t pos)
+    void set_parts_(UrlParts const &parts)
     {
-        if (pos >= url.size())
-        {
-            return pos;
-        }
-        if (url[pos] == '#' || url[pos] == '?')
-        {
-            return pos;
-        }
-        size_t querystring_pos = url.find_first_of('?', pos),
-                fragment_pos = url.find_first_of('#', pos);
-        if (querystring_pos == std::string::npos && fragment_pos == std::string::npos)
-        {
-            path = url.substr(pos);
-        }
-        else
-        {
-            size_t next_pos = MIN(querystring_pos, fragment_pos);
-            path = url.substr(pos, next_pos - pos);
-        }
-        if (path.empty())
-        {
-            throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                             std::ostringstream() << "empty path in '" << url << "'").str());
-        }
-        for (char ii : path)
+        protocol_end_ = parts.protocol_end;
+        domain_end_ = parts.domain_end;
+        path_end_ = parts.path_end;
+        querystring_end_ = parts.querystring_end;
+    }
+
+    // Our validate function, we are going to
+    // throw an exception if our url fails.
+    // https://isocpp.org/wiki/faq/exceptions#ctors-can-throw
+    void validate_(std::string_view url)
+    {
+        UrlParts parts = url_parse(url);
+        if (parts.error != nullptr)
         {
-            if (!is_valid_path_char(ii))
+            std::string message(parts.error);
+            if (parts.error_pos != URL_NO_POSITION)
             {
-                throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                                 std::ostringstream() << "invalid character '" << ii
-                                                                      << "' found in path of '" << url << "'").str());
+                message += " ('";
+                message += url[parts.error_pos];
+                message += "')";
             }
-        }
-        return MIN(MIN(querystring_pos, fragment_pos), url.size());
+            message += " in '";
+            message += url.substr(0, 256);
+            message += '\'';
+            throw std::runtime_error(message);
+        }
+        // only the querystring can change when it is encoded
+        const std::string_view querystring = url.substr(parts.path_end, parts.querystring_end - parts.path_end);
+        data_.reserve(url.size() + parts.escapes * 2);
+        data_.assign(url.substr(0, parts.path_end));
+        percent_encode_append(data_, querystring, PercentMode::QUERY);
+        data_.append(url.substr(parts.querystring_end));
+        parts.querystring_end = static_cast<std::uint32_t>(data_.size() - (url.size() - parts.querystring_end));
+        set_parts_(parts);
     }
+};
+
+static_assert(std::is_nothrow_move_constructible_v<URL> && std::is_nothrow_move_assignable_v<URL>,
+              "URLs are moved around in requests, moving one must not throw");
+
+struct UrlParam
+{
+    std::string_view key;
+    std::string_view value;
+};
 
-    size_t set_querystring_(std::string const &url, size_t pos)
+// Builds URLs that share a base and a set of parameters, such as
+// an authorization URL that only changes in its state, nonce and
+// code challenge.  The shared parameters are encoded once into a
+// template; build() sizes the result up front, copies the template
+// and encodes only the parameters passed to it, so each URL is a
+// single allocation.  Parameters passed to build() are not checked
+// against the template, keep their keys distinct.
+class UrlBuilder
+{
+public:
+    explicit UrlBuilder(URL base) : base_(std::move(base))
     {
-        if (pos >= url.size())
-        {
-            return pos;
-        }
-        size_t querystring_pos_start = url.find_first_of('?', pos);
-        size_t querystring_pos_end = url.find_first_of('#', pos);
-        if (querystring_pos_start == std::string::npos)
-        {
-            return pos;
-        }
-        if (querystring_pos_end == std::string::npos)
-        {
-            querystring_pos_end = url.size();
-        }
-        querystring = url.substr(querystring_pos_start + 1, querystring_pos_end - (querystring_pos_start + 1));
-        return querystring_pos_end;
     }
 
-    [[nodiscard]] static std::string encode_(std::string const &text)
+    // Adds a parameter to every URL built, see URL::add_param.
+    UrlBuilder &add_param(std::string_view key, std::string_view value)
     {
-        std::ostringstream ss;
-        for (char ii : text)
-        {
-            if (ii == ' ')
-            {
-                ss << "%20";
-            }
-            else if (ii == '\"')
-            {
-                ss << "%22";
-            }
-            else if (ii == '\'')
-            {
-                ss << "%27";
-            }
-            else if (ii == '<')
-            {
-                ss << "%3C";
-            }
-            else if (ii == '>')
-            {
-                ss << "%3E";
-            }
-            else if (ii == '+')
-            {
-                ss << "";
-            }
-            else
-            {
-                ss << ii;
-            }
-        }
-        return ss.str();
+        base_.add_param(key, value);
+        return *this;
     }
 
-    std::string encode_querystring_(std::string const &url)
+    [[nodiscard]] URL const &base() const
     {
-        size_t querystring_pos_start = url.find_first_of('?'),
-                querystring_pos_end = url.find_first_of('#', querystring_pos_start);
-        // check querystring and convert any special characters to the appropriate
-        // %XX code.
-        if (querystring_pos_start == std::string::npos)
-        {
-            return "";
-        }
-        if (querystring_pos_end == std::string::npos)
-        {
-            querystring_pos_end = url.size();
-        }
-        std::ostringstream ss;
-        for (size_t ii = querystring_pos_start + 1; ii < querystring_pos_end; ii++)
-        {
-            if (url[ii] == '#')
-            {
-                break;
-            }
-            if (url[ii] == ' ')
-            {
-                ss << "%20";
-            }
-            else if (url[ii] == '\"')
-            {
-                ss << "%22";
-            }
-            else if (url[ii] == '\'')
-            {
-                ss << "%27";
-            }
-            else if (url[ii] == '<')
-            {
-                ss << "%3C";
-            }
-            else if (url[ii] == '>')
-            {
-                ss << "%3E";
-            }
-            else if (url[ii] == '+')
-            {
-                ss << "";
-            }
-            else
-            {
-                ss << url[ii];
-            }
-        }
-        std::string encoded_query_string = ss.str();
-        querystring = encoded_query_string;
-        return encoded_query_string;
+        return base_;
     }
 
-    size_t set_fragment_(std::string const &url, const size_t pos)
+    [[nodiscard]] URL build(std::initializer_list<UrlParam> params) const
     {
-        size_t fragment_pos_start = url.find_first_of('#'),
-                fragment_pos_end = url.find_first_of('?', fragment_pos_start);
-        if (fragment_pos_start == std::string::npos)
-        {
-            return pos;
-        }
-        if (fragment_pos_end == std::string::npos)
-        {
-            fragment_pos_end = url.size();
-        }
-        for (size_t ii = fragment_pos_start + 1; ii < url.size(); ii++)
-        {
-            if (!is_fragment(url[ii]))
-            {
-                throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                                 std::ostringstream() << "invalid character '" << url[ii]
-                                                                      << "' found in fragment of '" << url
-                                                                      << "'").str());
-            }
-        }
-        fragment = url.substr(fragment_pos_start, fragment_pos_end - fragment_pos_start);
-        return fragment_pos_end;
+        return build(params.begin(), params.end());
     }
 
-    // Our validate function, we are going to
-    // throw an exception if our url fails.
-    // https://isocpp.org/wiki/faq/exceptions#ctors-can-throw
-    void validate_(std::string const &url)
+    [[nodiscard]] URL build(UrlParam const *begin, UrlParam const *end) const
     {
-        data_ = url;
-        encoded_data_ = url;
-        if (encoded_data_.empty())
+        const std::string_view base = base_.encoded();
+        const std::uint32_t querystring_end = base_.querystring_end_;
+        // what goes before the first parameter, then '&' for the rest
+        const char *separator = !base_.has_querystring_() ? "?" : base_.querystring().empty() ? "" : "&";
+        size_t size = base.size();
+        for (UrlParam const *param = begin; param != end; ++param)
         {
-            throw std::runtime_error("empty string is not a valid url");
+            size += 2 + percent_encoded_size(param->key, PercentMode::COMPONENT) +
+                    percent_encoded_size(param->value, PercentMode::COMPONENT);
         }
-        if (encoded_data_.size() < 5)
+        if (begin != end && *separator == '\0')
         {
-            throw std::runtime_error(static_cast<const std::ostringstream&>(
-                                             std::ostringstream() << "invalid url found, string '"
-                                                                  << url << "' is too short").str());
-        }
-        size_t pos;
-        set_protocol_(url);
-        pos = set_domain_(url, check_protocol_domain_separator_(url));
-        if (pos == url.size())
-        {
-            return;
+            size -= 1;
         }
 
-        pos = set_path_(url, pos);
-        pos = set_querystring_(url, pos);
-        encode_querystring_(url);
-        pos = set_fragment_(url, pos);
-        encoded_data_ = protocol + "://" + domain + path + querystring + fragment;
-        if (pos != url.size())
+        std::string data;
+        data.resize(size);
+        char *out = std::copy(base.begin(), base.begin() + querystring_end, &data[0]);
+        for (UrlParam const *param = begin; param != end; ++param)
         {
-            throw std::runtime_error("unexpected characters in url after domain, expected ? or #");
+            if (*separator != '\0')
+            {
+                *out++ = *separator;
+            }
+            separator = "&";
+            out = percent_encode_to(out, param->key, PercentMode::COMPONENT);
+            *out++ = '=';
+            out = percent_encode_to(out, param->value, PercentMode::COMPONENT);
         }
+        std::copy(base.begin() + querystring_end, base.end(), out);
+
+        UrlParts parts = UrlParts{};
+        parts.protocol_end = base_.protocol_end_;
+        parts.domain_end = base_.domain_end_;
+        parts.path_end = base_.path_end_;
+        parts.querystring_end = static_cast<std::uint32_t>(querystring_end + size - base.size());
+        return URL(std::move(data), parts);
     }
+
+private:
+    URL base_;
 };
 
 inline std::string to_string(const URL& url) {
     return url.encoded();
 }
 
-/*
-static std::ostream &operator<<(std::ostream &out, URL &url)
-{
-#ifdef TEST_URL
-    return url.print(out);
-#else
-    out << url.encoded();
-    return out;
-#endif
-}
-*/
-
-/*
-static std::ostream &operator<<(std::ostream &out, URL const &url)
+inline std::ostream &operator<<(std::ostream &out, URL const &url)
 {
 #ifdef TEST_URL
     return url.print(out);
 #else
-    out << url.encoded();
-    return out;
-#endif
-}
-*/
-
-/*
-static std::ostream &operator<<(std::ostream &out, URL *url)
-{
-#ifdef TEST_URL
-    return url->print(out);
-#else
-    out << url->encoded();
-    return out;
-#endif
-}
-*/
-
-/*
-static std::ostream &operator<<(std::ostream &out, URL const *url)
-{
-#ifdef TEST_URL
-    return url->print(out);
-#else
-    out << url->encoded();
-    return out;
+    return out << url.encoded();
 #endif
 }
-*/
 
 #ifdef TEST_URL
 #define ASSERT_EXCEPTION(x)                                                  \
     do                                                                       \
     {                                                                        \
+        bool raised = false;                                                 \
         try                                                                  \
         {                                                                    \
             x;                                                               \
-            throw std::runtime_error("unexpected exception raised in test"); \
         }                                                                    \
-        catch (...)                                                          \
+        catch (std::runtime_error const &)                                   \
+        {                                                                    \
+            raised = true;                                                   \
+        }                                                                    \
+        if (!raised)                                                         \
         {                                                                    \
+            std::cout << "expected an exception from " #x "\n";             \
+            return EXIT_FAILURE;                                             \
         }                                                                    \
     } while (0)
 
+// checked while compiling the test
+static_assert(url_parse("https://www.example.com/a/b?c=d#e").path_end == 27);
+static_assert(url_parse("https://www.example.com/a/b?c=d#e").querystring_end == 31);
+static_assert(url_parse("https://www.exa_mple.com").error_pos == 15);
+static_assert(url_parse("ftp://www.example.com").error != nullptr);
+constexpr UrlConstant test_constant = URL_CONSTANT("GET", "www.example.com", "/a/b");
+static_assert(test_constant.request_line == "GET /a/b HTTP/1.0\r\n");
+// uncomment to see the build fail:
+// constexpr UrlConstant test_invalid = URL_CONSTANT("GET", "www..example.com", "/a/b");
+
 int main()
 {
+    {
+        const URL a(test_constant);
+        std::cout << a.domain() << ' ' << a.path() << ' ' << (a == URL("https://www.example.com/a/b")) << '\n';
+    }
     {
         ASSERT_EXCEPTION(URL(""));
     }
@@ -528,6 +550,11 @@ int main()
     {
         ASSERT_EXCEPTION(URL("https://www.example_.com"));
     }
+    {
+        // long enough for the vectorised checks
+        ASSERT_EXCEPTION(URL("https://www.example.com/a/very/long/path/that/is/checked/in/blocks/with a space"));
+        ASSERT_EXCEPTION(URL("https://www.example.com/#a/very/long/fragment/that/is/checked/in/blocks/\x80"));
+    }
     {
         URL("https://www.example.com#abc");
     }
@@ -535,17 +562,55 @@ int main()
         URL("https://www.example.com?key=value");
     }
     {
-        Url a = URL("https://www.example.com?key=value'abc");
+        URL a = URL("https://www.example.com?key=value abc<+1");
         std::cout << a << std::endl;
     }
     {
-        Url a = URL("https://www.example.com/?key=value'abc#f");
+        URL a = URL("https://www.example.com/?key=value'abc#f");
         std::cout << a << std::endl;
     }
     {
-        Url a = URL("https://31f5ff35.eu-gb.api.example.cloud/private-test/Hello");
+        URL a = URL("https://31f5ff35.eu-gb.api.example.cloud/private-test/Hello");
         std::cout << a << std::endl;
     }
+    {
+        // components are views into the one buffer
+        URL a = URL("https://accounts.google.com/o/oauth2/v2/auth?prompt=consent#top");
+        a.add_param("scope", "openid email");
+        a.add_param("state", "abc");
+        a.add_param("scope", "ignored");
+        const URL b = a;
+        URL c = std::move(a);
+        std::cout << c.encoded() << '\n'
+                  << c.domain() << ' ' << c.path() << ' ' << c.querystring() << ' ' << c.fragment() << '\n'
+                  << (b == c) << (b.path().data() != c.path().data()) << '\n';
+        URL d = URL("http://localhost/callback");
+        d.add_param("code", "x y");
+        std::cout << d.protocol() << ' ' << d.encoded() << '\n';
+    }
+    {
+        // the same URL as add_param, from a template
+        UrlBuilder builder(URL("https://accounts.google.com/o/oauth2/v2/auth#top"));
+        builder.add_param("response_type", "code").add_param("scope", "openid email");
+        URL a = URL("https://accounts.google.com/o/oauth2/v2/auth#top");
+        a.add_param("response_type", "code");
+        a.add_param("scope", "openid email");
+        a.add_param("state", "a/b c");
+        a.add_param("nonce", "123");
+        const URL b = builder.build({{"state", "a/b c"}, {"nonce", "123"}});
+        std::cout << b.encoded() << ' ' << b.querystring() << ' ' << b.fragment() << '\n';
+        if (a != b || b.querystring() != a.querystring() || builder.build({}) != builder.base())
+        {
+            return EXIT_FAILURE;
+        }
+        UrlBuilder empty(URL("https://www.example.com/?"));
+        const URL c = empty.build({{"state", "x"}});
+        std::cout << c.encoded() << ' ' << c.querystring() << '\n';
+        if (c != URL("https://www.example.com/?state=x"))
+        {
+            return EXIT_FAILURE;
+        }
+    }
 }
 #endif
 
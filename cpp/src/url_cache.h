@@ -0,0 +1,184 @@
+#ifndef OAUTH2_URL_CACHE_H
+#define OAUTH2_URL_CACHE_H
+
+// ----------------------------------------------------------
+// Endpoint cache
+// The same few endpoints (discovery, token, userinfo, our own
+// APIs) are requested over and over.  The cache turns a URL
+// string into a validated URL with the request line and Host
+// header already formatted, once, and hands the same immutable
+// entry to every later caller.
+//
+// Lookups are read-copy-update: readers load the current index
+// with one atomic load and never take a lock.  A writer copies
+// the index, adds its entry and publishes the copy.  Old
+// indexes are kept until the cache is destroyed, so a reader
+// can never see one freed; the cache is bounded, which bounds
+// them too.  Once it is full new URLs are still parsed and
+// returned, they are just not kept.
+// ----------------------------------------------------------
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "url.h"
+
+struct EndpointTemplate
+{
+    URL url;
+    std::string verb;
+    // "VERB target HTTP/1.0\r\n"
+    std::string request_line;
+    // "HOST: domain"
+    std::string host_header;
+    // verb ' ' url as it was looked up
+    std::string key;
+};
+
+using EndpointHandle = std::shared_ptr<const EndpointTemplate>;
+
+inline EndpointHandle make_endpoint_template(std::string_view url, std::string_view verb)
+{
+    auto endpoint = std::make_shared<EndpointTemplate>();
+    endpoint->url = URL(url);
+    endpoint->verb = verb;
+    const std::string_view path = endpoint->url.path().empty() ? std::string_view("/") : endpoint->url.path();
+    const std::string_view querystring = endpoint->url.querystring();
+    std::string &line = endpoint->request_line;
+    line.reserve(verb.size() + path.size() + querystring.size() + 13);
+    line.append(verb).append(" ").append(path);
+    if (!querystring.empty())
+    {
+        line.append("?").append(querystring);
+    }
+    line.append(" HTTP/1.0\r\n");
+    endpoint->host_header.append("HOST: ").append(endpoint->url.domain());
+    endpoint->key.append(verb).append(" ").append(url);
+    return endpoint;
+}
+
+class EndpointCache
+{
+public:
+    explicit EndpointCache(size_t capacity = 64) : capacity_(capacity)
+    {
+        auto empty = std::make_unique<const Index>();
+        index_.store(empty.get(), std::memory_order_release);
+        indexes_.push_back(std::move(empty));
+    }
+
+    // make this unable to be copied
+    EndpointCache(EndpointCache const &) = delete;
+    EndpointCache &operator=(EndpointCache const &) = delete;
+
+    // Throws like URL when url is not valid, nothing is cached then.
+    EndpointHandle get(std::string_view url, std::string_view verb = "GET")
+    {
+        // the key is built in a buffer that is reused by the thread
+        static thread_local std::string key;
+        key.assign(verb).append(" ").append(url);
+
+        const Index *index = index_.load(std::memory_order_acquire);
+        const auto found = index->find(key);
+        if (found != index->end())
+        {
+            return found->second;
+        }
+        return insert_(make_endpoint_template(url, verb));
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return index_.load(std::memory_order_acquire)->size();
+    }
+
+private:
+    // keys are views of EndpointTemplate::key
+    using Index = std::unordered_map<std::string_view, EndpointHandle>;
+
+    const size_t capacity_;
+    std::atomic<const Index *> index_;
+    // every index ever published, only touched under writer_
+    std::vector<std::unique_ptr<const Index>> indexes_;
+    std::mutex writer_;
+
+    EndpointHandle insert_(EndpointHandle endpoint)
+    {
+        std::lock_guard<std::mutex> lock(writer_);
+        const Index *current = index_.load(std::memory_order_relaxed);
+        const auto found = current->find(endpoint->key);
+        if (found != current->end())
+        {
+            // another thread got there first, everyone shares its entry
+            return found->second;
+        }
+        if (current->size() >= capacity_)
+        {
+            return endpoint;
+        }
+        auto next = std::make_unique<Index>(*current);
+        next->emplace(endpoint->key, endpoint);
+        index_.store(next.get(), std::memory_order_release);
+        indexes_.push_back(std::move(next));
+        return endpoint;
+    }
+};
+
+#ifdef TEST_URL_CACHE
+#include <iostream>
+#include <thread>
+
+int main()
+{
+    EndpointCache cache(3);
+    const EndpointHandle a = cache.get("https://www.example.com/userinfo?x=a b");
+    const EndpointHandle b = cache.get("https://www.example.com/userinfo?x=a b");
+    const EndpointHandle c = cache.get("https://www.example.com/token", "POST");
+    const EndpointHandle d = cache.get("https://www.example.com");
+    std::cout << a->request_line << a->host_header << '\n'
+              << c->request_line << d->request_line
+              << (a == b) << ' ' << cache.size() << '\n';
+    try
+    {
+        cache.get("https://www..example.com");
+        return EXIT_FAILURE;
+    }
+    catch (std::runtime_error const &)
+    {
+    }
+
+    // full, still answers but keeps nothing new
+    const EndpointHandle e = cache.get("https://www.example.com/other");
+    std::cout << e->request_line << cache.size() << ' ' << (cache.get("https://www.example.com/other") != e) << '\n';
+
+    // readers and a writer at the same time
+    EndpointCache shared;
+    std::vector<std::thread> threads;
+    std::atomic<int> failures(0);
+    for (int tt = 0; tt < 4; tt++)
+    {
+        threads.emplace_back([&shared, &failures, tt] {
+            for (int ii = 0; ii < 2000; ii++)
+            {
+                const std::string url = "https://www.example.com/" + std::to_string((ii + tt) % 50);
+                const EndpointHandle endpoint = shared.get(url);
+                failures += endpoint->url.encoded() != url;
+                failures += endpoint != shared.get(url);
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    std::cout << shared.size() << " endpoints, failures: " << failures << '\n';
+    return failures == 0 && a == b && cache.size() == 3 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#endif /* OAUTH2_URL_CACHE_H */